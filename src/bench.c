@@ -0,0 +1,688 @@
+/*!
+ * \file bench.c
+ * \brief Benchmarks of the parser and of the execution of the pipelines.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * Measures line_parse() over synthetic corpora (short commands, long argument lists, deep pipelines,
+ * heavy quoting), line_parse_cached(), line_clear(), the completion of command names over a PATH
+ * of 5000 executables, the history (1M entries appended by 4 concurrent writers, then walked and
+ * searched), the expansion of patterns over a directory of 20000 files, the expansion of variables and
+ * the environment given to the commands with 50 exported variables, and the latency of pipelines of 1, 4 and 16 external "true" commands
+ * executed by run_line() with each launch backend (fork, spawn, zygote).
+ * The results are written to the standard output as JSON, with the percentiles of the samples:
+ *
+ *     make bench                       # or: ./execs/bench [-s scale] [-m megabytes] [-o file]
+ *
+ * The executable links the objects of the shell (fish.c is compiled with its main() renamed), so a
+ * change of libcmdline or of execute_command_with_args is measured as it is shipped. They are built with
+ * -O2 in execs/optimized, with their own libcmdline, and the compiler and its flags are written in the JSON.
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "cmdline.h"
+#include "complete.h"
+#include "fish.h"
+#include "glob.h"
+#include "history.h"
+#include "launcher.h"
+#include "vars.h"
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*!
+ * \def CORPUS_LINES
+ * \brief Number of lines of each corpus.
+ */
+#define CORPUS_LINES 256
+
+/*!
+ * \def COMPLETE_EXECUTABLES
+ * \brief Number of executables of the PATH of the completion benchmark.
+ */
+#define COMPLETE_EXECUTABLES 5000
+
+/*!
+ * \def GLOB_FILES
+ * \brief Number of files of the directory of the glob benchmark.
+ */
+#define GLOB_FILES 20000
+
+/*!
+ * \def VARS_EXPORTED
+ * \brief Number of variables exported by the variables benchmark.
+ */
+#define VARS_EXPORTED 50
+
+/*!
+ * \def HISTORY_ENTRIES
+ * \brief Number of entries of the history benchmark.
+ */
+#define HISTORY_ENTRIES 1000000
+
+/*!
+ * \def HISTORY_WRITERS
+ * \brief Number of processes appending to the history at the same time.
+ */
+#define HISTORY_WRITERS 4
+
+/*!
+ * \def TRUE_PATH
+ * \brief The command of the pipelines: an absolute path, so the internal command true is not used.
+ */
+#ifndef TRUE_PATH
+#define TRUE_PATH "/bin/true"
+#endif
+
+/*!
+ * \def BENCH_CC
+ * \brief The compiler of the benchmarks, given by the Makefile.
+ */
+#ifndef BENCH_CC
+#define BENCH_CC "unknown"
+#endif
+
+/*!
+ * \def BENCH_CFLAGS
+ * \brief The compiler flags of the benchmarks and of their libcmdline, given by the Makefile.
+ */
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS "unknown"
+#endif
+
+/*!
+ * \struct corpus
+ * \brief A set of synthetic lines parsed by a benchmark.
+ */
+struct corpus {
+    /*! \brief The name of the benchmark. */
+    const char *name;
+    /*! \brief The lines, each ending with '\n'. */
+    char *lines[CORPUS_LINES];
+    /*! \brief The total length of the lines, in bytes. */
+    size_t bytes;
+};
+
+/*!
+ * \struct stats
+ * \brief The summary of the samples of a benchmark, in nanoseconds.
+ */
+struct stats {
+    double min, p50, p90, p99, max, mean;
+};
+
+/*!
+ * \var first_result
+ * \brief true until the first result is written, to separate the JSON objects.
+ */
+static bool first_result = true;
+
+/*!
+ * \fn static uint64_t now_ns()
+ * \brief The current time in nanoseconds (CLOCK_MONOTONIC).
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/*!
+ * \fn static int compare_double(const void *a, const void *b)
+ * \brief Compare two doubles for qsort().
+ */
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*!
+ * \fn static struct stats summarize(double *samples, size_t n)
+ * \brief Sort the samples and compute their percentiles (nearest rank).
+ */
+static struct stats summarize(double *samples, size_t n) {
+    qsort(samples, n, sizeof(double), compare_double);
+    struct stats s = {samples[0], 0, 0, 0, samples[n - 1], 0};
+    double sum = 0;
+    for(size_t i = 0; i < n; ++i) sum += samples[i];
+    s.mean = sum / (double) n;
+    s.p50 = samples[(n - 1) * 50 / 100];
+    s.p90 = samples[(n - 1) * 90 / 100];
+    s.p99 = samples[(n - 1) * 99 / 100];
+    return s;
+}
+
+/*!
+ * \fn static void write_result(FILE *out, const char *group, const char *name, const char *unit, size_t samples, struct stats s, const char *extra)
+ * \brief Write the JSON object of a benchmark.
+ *
+ * \param extra Additional members (starting with ','), or "".
+ */
+static void write_result(FILE *out, const char *group, const char *name, const char *unit, size_t samples,
+                         struct stats s, const char *extra) {
+    fprintf(out, "%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", \"samples\": %zu, "
+                 "\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f%s}",
+            first_result ? "" : ",", group, name, unit, samples, s.min, s.p50, s.p90, s.p99, s.max, s.mean, extra);
+    first_result = false;
+    fflush(out);
+}
+
+/*!
+ * \fn static char *xstrdup(const char *str)
+ * \brief strdup() exiting on failure.
+ */
+static char *xstrdup(const char *str) {
+    char *copy = strdup(str);
+    if(copy == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+    return copy;
+}
+
+/*!
+ * \fn static char *build_line(const char *first, const char *word, const char *separator, size_t n)
+ * \brief Build the line "first word<sep>word<sep>...word\n" with n times word.
+ */
+static char *build_line(const char *first, const char *word, const char *separator, size_t n) {
+    size_t len = strlen(first) + n * (strlen(word) + strlen(separator)) + 2;
+    char *line = malloc(len);
+    if(line == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    char *p = stpcpy(line, first);
+    for(size_t i = 0; i < n; ++i) {
+        if(i > 0 || first[0] != '\0') p = stpcpy(p, separator);
+        p = stpcpy(p, word);
+    }
+    strcpy(p, "\n");
+    return line;
+}
+
+/*!
+ * \fn static void corpus_init(struct corpus *c, const char *name, size_t kind)
+ * \brief Generate the lines of a corpus.
+ *
+ * \param kind 0: short commands, 1: long argument lists, 2: deep pipelines, 3: heavy quoting.
+ */
+static void corpus_init(struct corpus *c, const char *name, size_t kind) {
+    static const char *short_lines[] = {
+        "ls -l\n", "cd /tmp\n", "echo hello world\n", "grep -n main src/fish.c > out.txt\n",
+        "cat < in.txt | wc -l\n", "make -j8 &\n", "git status\n", "true && echo ok || echo ko\n",
+    };
+    char word[64];
+    c->name = name;
+    c->bytes = 0;
+    for(size_t i = 0; i < CORPUS_LINES; ++i) {
+        switch(kind) {
+            case 0:
+                c->lines[i] = xstrdup(short_lines[i % (sizeof(short_lines) / sizeof(short_lines[0]))]);
+                break;
+            case 1:
+                snprintf(word, sizeof(word), "src/module_%zu/file.c", i);
+                c->lines[i] = build_line("cc -Wall -c", word, " ", 500 + i % 64);
+                break;
+            case 2:
+                snprintf(word, sizeof(word), "grep -v pattern%zu", i);
+                c->lines[i] = build_line("cat big.txt", word, " | ", 60 + i % 8);
+                break;
+            default:
+                snprintf(word, sizeof(word), "\"a quoted word %zu\" 'single \"quoted\"' esc\\ aped", i);
+                c->lines[i] = build_line("printf '%s\\n'", word, " ", 40 + i % 16);
+                break;
+        }
+        c->bytes += strlen(c->lines[i]);
+    }
+}
+
+/*!
+ * \fn static void corpus_destroy(struct corpus *c)
+ * \brief Free the lines of a corpus.
+ */
+static void corpus_destroy(struct corpus *c) {
+    for(size_t i = 0; i < CORPUS_LINES; ++i) free(c->lines[i]);
+}
+
+/*!
+ * \fn static void bench_parse(FILE *out, const struct corpus *c, size_t rounds, bool cached)
+ * \brief Measure the parsing of every line of the corpus, rounds times.
+ *
+ * A sample is the mean time of parsing and resetting one line, over one pass of the corpus:
+ * a single parse of a short line is too close to the resolution of the clock.
+ */
+static void bench_parse(FILE *out, const struct corpus *c, size_t rounds, bool cached) {
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    struct line li;
+    line_init(&li);
+
+    for(size_t i = 0; i < CORPUS_LINES; ++i) { // Warm up the arrays of the line, and the cache
+        if((cached ? line_parse_cached(&li, c->lines[i]) : line_parse(&li, c->lines[i])) != 0) {
+            fprintf(stderr, "bench: invalid line in %s: %s", c->name, c->lines[i]);
+            exit(EXIT_FAILURE);
+        }
+        line_clear(&li);
+    }
+    uint64_t total = 0;
+    for(size_t r = 0; r < rounds; ++r) {
+        uint64_t start = now_ns();
+        for(size_t i = 0; i < CORPUS_LINES; ++i) {
+            if(cached) line_parse_cached(&li, c->lines[i]);
+            else line_parse(&li, c->lines[i]);
+            line_clear(&li);
+        }
+        uint64_t elapsed = now_ns() - start;
+        total += elapsed;
+        samples[r] = (double) elapsed / CORPUS_LINES;
+    }
+    line_reset(&li);
+    if(cached) line_cache_clear();
+
+    char extra[128];
+    double seconds = (double) total / 1e9;
+    snprintf(extra, sizeof(extra), ", \"lines_per_s\": %.0f, \"mb_per_s\": %.1f",
+             (double) (rounds * CORPUS_LINES) / seconds, (double) (rounds * c->bytes) / seconds / 1e6);
+    write_result(out, cached ? "line_parse_cached" : "line_parse", c->name, "ns/line", rounds,
+                 summarize(samples, rounds), extra);
+    free(samples);
+}
+
+/*!
+ * \fn static void bench_clear(FILE *out, const struct corpus *c, size_t rounds)
+ * \brief Measure each line_clear() after the parsing of a line of the corpus.
+ *
+ * The samples include one clock_gettime(), reported as clock_ns.
+ */
+static void bench_clear(FILE *out, const struct corpus *c, size_t rounds) {
+    size_t n = rounds * CORPUS_LINES;
+    double *samples = malloc(n * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    struct line li;
+    line_init(&li);
+
+    for(size_t r = 0; r < rounds; ++r) {
+        for(size_t i = 0; i < CORPUS_LINES; ++i) {
+            line_parse(&li, c->lines[i]);
+            uint64_t start = now_ns();
+            line_clear(&li);
+            samples[r * CORPUS_LINES + i] = (double) (now_ns() - start);
+        }
+    }
+    line_reset(&li);
+
+    uint64_t start = now_ns();
+    for(size_t i = 0; i < 1000; ++i) now_ns();
+    char extra[64];
+    snprintf(extra, sizeof(extra), ", \"clock_ns\": %.1f", (double) (now_ns() - start) / 1000);
+    write_result(out, "line_clear", c->name, "ns/call", n, summarize(samples, n), extra);
+    free(samples);
+}
+
+/*!
+ * \fn static void bench_complete(FILE *out, size_t rounds)
+ * \brief Measure complete_line() on a command name, with a PATH made of a temporary directory of executables.
+ *
+ * The first call builds the index of the PATH (reported as build_us). A round of "after_create" creates an
+ * executable before the completion, which then reads the inotify event and inserts it in the index.
+ */
+static void bench_complete(FILE *out, size_t rounds) {
+    char dir[] = "/tmp/fish-bench-XXXXXX";
+    if(mkdtemp(dir) == NULL) { perror("mkdtemp"); exit(EXIT_FAILURE); }
+    char path[sizeof(dir) + 32];
+    for(size_t i = 0; i < COMPLETE_EXECUTABLES; ++i) {
+        snprintf(path, sizeof(path), "%s/cmd%05zu", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+        if(fd == -1) { perror(path); exit(EXIT_FAILURE); }
+        close(fd);
+    }
+    char *saved_path = getenv("PATH") != NULL ? xstrdup(getenv("PATH")) : NULL;
+    setenv("PATH", dir, 1);
+
+    struct completion c;
+    uint64_t start = now_ns();
+    complete_line("cmd", 3, &c);
+    double build_us = (double) (now_ns() - start) / 1000;
+
+    static const struct { const char *name, *line; } cases[] = {
+        {"unique_prefix", "cmd01234"}, {"ten_matches", "cmd0123"}, {"all_matches", "cmd"}, {"argument", "cmd00001 -"},
+    };
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    char extra[96];
+    for(size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+        for(size_t r = 0; r < rounds; ++r) {
+            start = now_ns();
+            complete_line(cases[k].line, strlen(cases[k].line), &c);
+            samples[r] = (double) (now_ns() - start) / 1000;
+        }
+        snprintf(extra, sizeof(extra), ", \"executables\": %d, \"matches\": %zu, \"build_us\": %.1f",
+                 COMPLETE_EXECUTABLES, c.count, build_us);
+        write_result(out, "complete", cases[k].name, "us/call", rounds, summarize(samples, rounds), extra);
+    }
+
+    size_t created = rounds < 100 ? rounds : 100;
+    for(size_t r = 0; r < created; ++r) {
+        snprintf(path, sizeof(path), "%s/new%03zu", dir, r);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+        if(fd == -1) { perror(path); exit(EXIT_FAILURE); }
+        close(fd);
+        start = now_ns();
+        complete_line(path + sizeof(dir), strlen(path + sizeof(dir)), &c);
+        samples[r] = (double) (now_ns() - start) / 1000;
+        if(c.count != 1) { fprintf(stderr, "bench: %s not completed\n", path); exit(EXIT_FAILURE); }
+        unlink(path);
+    }
+    snprintf(extra, sizeof(extra), ", \"executables\": %d, \"matches\": 1", COMPLETE_EXECUTABLES);
+    write_result(out, "complete", "after_create", "us/call", created, summarize(samples, created), extra);
+
+    for(size_t i = 0; i < COMPLETE_EXECUTABLES; ++i) {
+        snprintf(path, sizeof(path), "%s/cmd%05zu", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    if(saved_path != NULL) setenv("PATH", saved_path, 1);
+    else unsetenv("PATH");
+    free(saved_path);
+    complete_clear();
+    free(samples);
+}
+
+/*!
+ * \fn static void bench_glob(FILE *out, size_t rounds)
+ * \brief Measure glob_line() and glob_release() over a temporary directory of GLOB_FILES files.
+ *
+ * "three_patterns" expands three patterns of the same directory, which is read once.
+ */
+static void bench_glob(FILE *out, size_t rounds) {
+    char dir[] = "/tmp/fish-bench-glob-XXXXXX";
+    if(mkdtemp(dir) == NULL) { perror("mkdtemp"); exit(EXIT_FAILURE); }
+    char path[sizeof(dir) + 32];
+    for(size_t i = 0; i < GLOB_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/f%05zu.log", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if(fd == -1) { perror(path); exit(EXIT_FAILURE); }
+        close(fd);
+    }
+
+    static const struct { const char *name, *format; } cases[] = {
+        {"one_pattern", "gzip %s/*.log"}, {"three_patterns", "ls %s/f0*.log %s/f1[0-4]*.log %s/*.txt"},
+    };
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    char text[256], extra[128];
+    struct line li;
+    line_init(&li);
+    for(size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+        snprintf(text, sizeof(text), cases[k].format, dir, dir, dir);
+        if(line_parse(&li, text) != 0) { fprintf(stderr, "bench: cannot parse %s\n", text); exit(EXIT_FAILURE); }
+        struct glob_state gs;
+        size_t args = 0, dirs = 0;
+        for(size_t r = 0; r < rounds; ++r) {
+            glob_init(&gs);
+            uint64_t start = now_ns();
+            glob_line(&gs, &li);
+            args = li.cmds[0].n_args;
+            dirs = gs.n_dirs;
+            glob_release(&gs, &li);
+            samples[r] = (double) (now_ns() - start) / 1000;
+        }
+        snprintf(extra, sizeof(extra), ", \"files\": %d, \"arguments\": %zu, \"directories_read\": %zu",
+                 GLOB_FILES, args, dirs);
+        write_result(out, "glob", cases[k].name, "us/line", rounds, summarize(samples, rounds), extra);
+        line_clear(&li);
+    }
+    line_reset(&li);
+
+    for(size_t i = 0; i < GLOB_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/f%05zu.log", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    free(samples);
+}
+
+/*!
+ * \fn static void bench_vars(FILE *out, size_t rounds)
+ * \brief Measure the variables with VARS_EXPORTED exported variables: the expansion of a line, the
+ * environment of a command (vars_envp(), as for every command started), the environment of a command
+ * written after an assignment, and the export of a variable (which rebuilds the environment).
+ */
+static void bench_vars(FILE *out, size_t rounds) {
+    char name[32], value[64];
+    for(size_t i = 0; i < VARS_EXPORTED; ++i) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%zu", i);
+        snprintf(value, sizeof(value), "value of the variable number %zu", i);
+        vars_set(name, strlen(name), value, true);
+    }
+
+    struct line li;
+    line_init(&li);
+    if(line_parse(&li, "cp $BENCH_VAR_1/${BENCH_VAR_2}.log \"$BENCH_VAR_3 $BENCH_VAR_4\" > $BENCH_VAR_5") != 0) {
+        fprintf(stderr, "bench: cannot parse the line of bench_vars\n");
+        exit(EXIT_FAILURE);
+    }
+    char *assignment[] = {"BENCH_VAR_7=other", NULL};
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    char extra[64];
+    snprintf(extra, sizeof(extra), ", \"exported\": %d", VARS_EXPORTED);
+    for(int k = 0; k < 4; ++k) {
+        for(size_t r = 0; r < rounds; ++r) {
+            snprintf(value, sizeof(value), "%zu", r);
+            uint64_t start = now_ns();
+            char **envp = NULL;
+            switch(k) {
+                case 0: vars_expand_line(&li, 0); vars_restore_line(); break;
+                case 1: envp = vars_envp(); break;
+                case 2: envp = vars_envp_with(assignment, 1); free(envp); break;
+                default: vars_set("BENCH_VAR_0", 11, value, true); break;
+            }
+            samples[r] = (double) (now_ns() - start) / 1000;
+            if(k == 1 && envp == NULL) exit(EXIT_FAILURE);
+        }
+        static const char *names[] = {"expand_line", "envp", "envp_with_assignment", "export"};
+        write_result(out, "vars", names[k], "us/call", rounds, summarize(samples, rounds), extra);
+    }
+    line_reset(&li);
+
+    for(size_t i = 0; i < VARS_EXPORTED; ++i) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%zu", i);
+        vars_unset(name, strlen(name));
+    }
+    free(samples);
+}
+
+/*!
+ * \fn static void bench_history(FILE *out, size_t rounds)
+ * \brief Measure the history: concurrent appends, opening, walking backwards and substring searches.
+ *
+ * HISTORY_WRITERS processes append HISTORY_ENTRIES entries to a temporary file at the same time, then all the
+ * entries must be found by walking the file (the records of the writers must not be interleaved). The first
+ * search, which builds the trigram index, is reported as index_ms.
+ */
+static void bench_history(FILE *out, size_t rounds) {
+    char path[] = "/tmp/fish-bench-history-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd == -1) { perror("mkstemp"); exit(EXIT_FAILURE); }
+    close(fd);
+
+    uint64_t start = now_ns();
+    pid_t writers[HISTORY_WRITERS];
+    for(int w = 0; w < HISTORY_WRITERS; ++w) {
+        pid_t pid = writers[w] = fork();
+        if(pid == -1) { perror("fork"); exit(EXIT_FAILURE); }
+        if(pid == 0) {
+            if(history_open(path) == -1) { perror(path); _exit(EXIT_FAILURE); }
+            char line[128];
+            unsigned seed = (unsigned) w + 1;
+            for(size_t i = w; i < HISTORY_ENTRIES; i += HISTORY_WRITERS) {
+                unsigned r = (unsigned) rand_r(&seed);
+                switch(i % 4) {
+                    case 0: snprintf(line, sizeof(line), "git commit -m 'fix issue %u'", r % 100000); break;
+                    case 1: snprintf(line, sizeof(line), "make -j%u target%u", r % 16, r % 5000); break;
+                    case 2: snprintf(line, sizeof(line), "cd /home/user/project%u/src", r % 1000); break;
+                    default: snprintf(line, sizeof(line), "grep -rn pattern%u src/ | less", r % 1000000); break;
+                }
+                history_add(line, (int64_t) i, (int64_t) r % 1000, (int) (r % 3));
+            }
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    for(int w = 0; w < HISTORY_WRITERS; ++w) { // Not wait(): the fork server is a child too
+        int status;
+        while(waitpid(writers[w], &status, 0) == -1 && errno == EINTR);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) { fprintf(stderr, "bench: history writer failed\n"); exit(EXIT_FAILURE); }
+    }
+    double append_ns = (double) (now_ns() - start) / HISTORY_ENTRIES;
+
+    start = now_ns();
+    if(history_open(path) == -1) { perror(path); exit(EXIT_FAILURE); }
+    double open_us = (double) (now_ns() - start) / 1000;
+
+    start = now_ns();
+    size_t pos = history_end(), n = 0;
+    struct history_entry e;
+    while(history_prev(&pos, &e)) ++n;
+    double walk_ns = (double) (now_ns() - start) / (double) (n > 0 ? n : 1);
+    if(n != HISTORY_ENTRIES) { fprintf(stderr, "bench: %zu history entries found, %d written\n", n, HISTORY_ENTRIES); exit(EXIT_FAILURE); }
+
+    start = now_ns();
+    pos = history_end();
+    history_search("make", &pos, &e);
+    double index_ms = (double) (now_ns() - start) / 1e6;
+
+    char extra[160];
+    snprintf(extra, sizeof(extra), ", \"entries\": %d, \"writers\": %d, \"append_ns\": %.1f, \"open_us\": %.1f, "
+             "\"walk_ns\": %.1f, \"index_ms\": %.1f", HISTORY_ENTRIES, HISTORY_WRITERS, append_ns, open_us, walk_ns, index_ms);
+    static const struct { const char *name, *text; } cases[] = {
+        {"recent", "make -j"}, {"rare", "pattern123456 "}, {"absent", "rsync"}, {"short", "zz"},
+    };
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    for(size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); ++k) {
+        for(size_t r = 0; r < rounds; ++r) {
+            start = now_ns();
+            pos = history_end();
+            history_search(cases[k].text, &pos, &e);
+            samples[r] = (double) (now_ns() - start) / 1000;
+        }
+        write_result(out, "history_search", cases[k].name, "us/search", rounds, summarize(samples, rounds), extra);
+    }
+
+    free(samples);
+    history_close();
+    unlink(path);
+}
+
+/*!
+ * \fn static void bench_pipeline(FILE *out, struct sigaction *sigint, size_t stages, size_t rounds)
+ * \brief Measure the execution of a pipeline of stages "true" commands, from run_line() to the reaping of the last one.
+ */
+static void bench_pipeline(FILE *out, struct sigaction *sigint, size_t stages, size_t rounds) {
+    char *text = build_line("", TRUE_PATH, " | ", stages);
+    struct line li;
+    line_init(&li);
+    if(line_parse(&li, text) != 0) { fprintf(stderr, "bench: invalid line: %s", text); exit(EXIT_FAILURE); }
+    double *samples = malloc(rounds * sizeof(double));
+    if(samples == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%zu_stages", stages);
+    for(int backend = LAUNCH_FORK; backend <= LAUNCH_ZYGOTE; ++backend) {
+        launch_backend = (enum launch_backend) backend;
+        if(launch_backend == LAUNCH_ZYGOTE && zygote_pid() == -1) continue;
+        int status = 0;
+        run_line(&li, sigint, &status); // Warm up the cache of the PATH lookups
+        for(size_t r = 0; r < rounds; ++r) {
+            uint64_t start = now_ns();
+            run_line(&li, sigint, &status);
+            samples[r] = (double) (now_ns() - start) / 1000;
+            if(status != 0) { fprintf(stderr, "bench: %s exited with %d\n", TRUE_PATH, status); exit(EXIT_FAILURE); }
+        }
+        char extra[64];
+        snprintf(extra, sizeof(extra), ", \"backend\": \"%s\"", launch_backend_name(launch_backend));
+        write_result(out, "pipeline", name, "us/pipeline", rounds, summarize(samples, rounds), extra);
+    }
+
+    free(samples);
+    line_reset(&li);
+    free(text);
+}
+
+/*!
+ * \fn static void usage(const char *name)
+ * \brief Print the usage of the benchmarks.
+ */
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s scale] [-m megabytes] [-o file]\n"
+                    "  -s scale  multiply the number of samples (default 1)\n"
+                    "  -m size   grow the heap of the shell by size MB before the pipelines (default 0)\n"
+                    "  -o file   write the JSON results to file instead of the standard output\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    size_t scale = 1, ballast = 0;
+    FILE *out = stdout;
+    int opt;
+    while((opt = getopt(argc, argv, "s:m:o:h")) != -1) {
+        switch(opt) {
+            case 'm':
+                ballast = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                scale = strtoul(optarg, NULL, 10);
+                if(scale == 0) { usage(argv[0]); exit(2); }
+                break;
+            case 'o':
+                out = fopen(optarg, "we");
+                if(out == NULL) { perror(optarg); exit(EXIT_FAILURE); }
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                usage(argv[0]);
+                exit(2);
+        }
+    }
+    if(optind < argc) { usage(argv[0]); exit(2); }
+
+    job_table_init(&jobs);
+    struct standard_signals sigs = manage_sigaction();
+    if(zygote_start() == -1) perror("zygote_start"); // While the shell is small, as FISH_LAUNCHER=zygote does
+
+    static const char *names[] = {"short_commands", "long_arguments", "deep_pipelines", "heavy_quoting"};
+    struct corpus corpora[4];
+    for(size_t k = 0; k < 4; ++k) corpus_init(&corpora[k], names[k], k);
+
+    fprintf(out, "{\n  \"clock\": \"CLOCK_MONOTONIC\",\n  \"cc\": \"%s\",\n  \"cflags\": \"%s\",\n  \"scale\": %zu,\n"
+            "  \"heap_mb\": %zu,\n  \"results\": [", BENCH_CC, BENCH_CFLAGS, scale, ballast);
+    for(size_t k = 0; k < 4; ++k) bench_parse(out, &corpora[k], (k == 0 ? 500 : 20) * scale, false);
+    bench_parse(out, &corpora[0], 500 * scale, true);
+    for(size_t k = 0; k < 4; ++k) bench_clear(out, &corpora[k], (k == 0 ? 20 : 4) * scale);
+    bench_complete(out, 200 * scale);
+    bench_glob(out, 20 * scale);
+    bench_vars(out, 1000 * scale);
+    bench_history(out, 20 * scale);
+    // A shell grown by its history and its caches: fork() copies its page tables, the fork server does not
+    char *heap = ballast > 0 ? malloc(ballast << 20) : NULL;
+    if(heap != NULL) memset(heap, 1, ballast << 20);
+    bench_pipeline(out, &sigs.sigint, 1, 200 * scale);
+    bench_pipeline(out, &sigs.sigint, 4, 100 * scale);
+    bench_pipeline(out, &sigs.sigint, 16, 25 * scale);
+    fprintf(out, "\n  ]\n}\n");
+
+    free(heap);
+    for(size_t k = 0; k < 4; ++k) corpus_destroy(&corpora[k]);
+    if(out != stdout) fclose(out);
+    return 0;
+}
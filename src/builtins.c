@@ -0,0 +1,561 @@
+/*!
+ * \file builtins.c
+ * \brief Implementation of the registry of the internal commands, and of the commands which do not
+ * depend on the state of the shell: echo, true, false, pwd, test / [ and printf.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "builtins.h"
+
+#include "fdcopy.h"
+#include "fish.h"
+#include "history.h"
+#include "jobctl.h"
+#include "parallel.h"
+#include "pipeopt.h"
+#include "timing.h"
+#include "trace.h"
+#include "vars.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int builtin_echo(char *args[], struct line *li);
+static int builtin_true(char *args[], struct line *li);
+static int builtin_false(char *args[], struct line *li);
+static int builtin_pwd(char *args[], struct line *li);
+static int builtin_test(char *args[], struct line *li);
+static int builtin_printf(char *args[], struct line *li);
+
+/*!
+ * \var builtins
+ * \brief The registry, sorted by name (strcmp order) for bsearch().
+ */
+static const struct builtin builtins[] = {
+    {"[", builtin_test},
+    {"bg", builtin_bg},
+    {"cat", builtin_cat, true},
+    {"cd", builtin_cd},
+    {"debug", builtin_debug},
+    {"echo", builtin_echo},
+    {"exit", builtin_exit},
+    {"export", builtin_export},
+    {"false", builtin_false},
+    {"fg", builtin_fg},
+    {"hash", builtin_hash},
+    {"history", builtin_history},
+    {"jobs", builtin_jobs},
+    {"kill", builtin_kill},
+    {"launcher", builtin_launcher},
+    {"parallel", builtin_parallel, true},
+    {"pipeopt", builtin_pipeopt},
+    {"printf", builtin_printf},
+    {"pwd", builtin_pwd},
+    {"tee", builtin_tee, true},
+    {"test", builtin_test},
+    {"time", builtin_time},
+    {"trace", builtin_trace},
+    {"true", builtin_true},
+    {"unset", builtin_unset},
+    {"wait", builtin_wait},
+};
+
+static int builtin_compare(const void *name, const void *entry) {
+    return strcmp(name, ((const struct builtin *) entry)->name);
+}
+
+const struct builtin *builtin_find(const char *name) {
+    return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]), sizeof(builtins[0]), builtin_compare);
+}
+
+const struct builtin *builtin_list(size_t *count) {
+    *count = sizeof(builtins) / sizeof(builtins[0]);
+    return builtins;
+}
+
+/*!
+ * \fn static int redirect(int fd, const char *file, int flags, const char *what)
+ * \brief Open file on fd, after saving fd.
+ *
+ * \return The saved copy of fd, -1 if the file cannot be opened (an error is printed).
+ */
+static int redirect(int fd, const char *file, int flags, const char *what) {
+    uint64_t trace_open = TRACE_NOW();
+    int file_fd = open(file, flags | O_CLOEXEC, 0644);
+    TRACE_COMPLETE("redirect", trace_open, file, file_fd);
+    if(file_fd < 0) {
+        fprintf(stderr, "open %s file '%s': %s\n", what, file, strerror(errno));
+        return -1;
+    }
+    int saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if(saved == -1 || dup2(file_fd, fd) == -1) { perror("dup2"); exit(EXIT_FAILURE); }
+    close(file_fd);
+    return saved;
+}
+
+/*!
+ * \fn static void restore(int fd, int saved)
+ * \brief Put back the file descriptor saved by redirect().
+ */
+static void restore(int fd, int saved) {
+    if(saved == -1) return;
+    if(dup2(saved, fd) == -1) { perror("dup2"); exit(EXIT_FAILURE); }
+    close(saved);
+}
+
+int builtin_run(const struct builtin *builtin, char *args[], struct line *li) {
+    int saved_in = -1, saved_out = -1;
+    fflush(stdout);
+    if(li->file_input != NULL) {
+        saved_in = redirect(STDIN_FILENO, li->file_input, O_RDONLY, "input");
+        if(saved_in == -1) return 1;
+    }
+    if(li->file_output != NULL) {
+        int flags = O_WRONLY | O_CREAT | (li->file_output_append ? O_APPEND : O_TRUNC);
+        saved_out = redirect(STDOUT_FILENO, li->file_output, flags, "output");
+        if(saved_out == -1) {
+            restore(STDIN_FILENO, saved_in);
+            return 1;
+        }
+    }
+
+    uint64_t trace_start = TRACE_NOW();
+    int status = builtin->fn(args, li);
+    TRACE_COMPLETE("builtin", trace_start, builtin->name, status);
+
+    fflush(stdout);
+    restore(STDOUT_FILENO, saved_out);
+    restore(STDIN_FILENO, saved_in);
+    return status;
+}
+
+/*!
+ * \fn static const char *print_escape(const char *p, bool echo_octal, bool *stop)
+ * \brief Print the escape sequence starting at p (on a '\'), as echo -e and printf do.
+ *
+ * \param echo_octal true for the echo syntax of octal values (\\0nnn), false for the printf one (\\nnn).
+ * \param stop Set to true by \\c, which stops the output.
+ * \return The address of the last character of the sequence.
+ */
+static const char *print_escape(const char *p, bool echo_octal, bool *stop) {
+    switch(*++p) {
+        case 'a': putchar('\a'); return p;
+        case 'b': putchar('\b'); return p;
+        case 'f': putchar('\f'); return p;
+        case 'n': putchar('\n'); return p;
+        case 'r': putchar('\r'); return p;
+        case 't': putchar('\t'); return p;
+        case 'v': putchar('\v'); return p;
+        case '\\': putchar('\\'); return p;
+        case 'c': *stop = true; return p;
+        case '\0': putchar('\\'); return p - 1;
+        default: break;
+    }
+    if(*p >= '0' && *p <= '7') {
+        if(echo_octal && *p != '0') {
+            putchar('\\');
+            putchar(*p);
+            return p;
+        }
+        const char *digits = echo_octal ? p + 1 : p;
+        int value = 0, n = 0;
+        while(n < 3 && *digits >= '0' && *digits <= '7') value = value * 8 + (*digits++ - '0'), n++;
+        putchar(value);
+        return digits - 1;
+    }
+    putchar('\\');
+    putchar(*p);
+    return p;
+}
+
+/*!
+ * \fn static int builtin_echo(char *args[], struct line *li)
+ * \brief echo [-neE] [arg...]: print the arguments separated by spaces.
+ * -n: no final newline, -e: interpret the escape sequences, -E: do not interpret them (default).
+ */
+static int builtin_echo(char *args[], struct line *li) {
+    (void) li;
+    bool newline = true, escapes = false;
+    size_t i = 1;
+    for(; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && strspn(args[i] + 1, "neE") == strlen(args[i] + 1); ++i) {
+        for(const char *opt = args[i] + 1; *opt; ++opt) {
+            if(*opt == 'n') newline = false;
+            else escapes = *opt == 'e';
+        }
+    }
+
+    bool stop = false;
+    for(bool first = true; args[i] != NULL && !stop; ++i, first = false) {
+        if(!first) putchar(' ');
+        if(!escapes) {
+            fputs(args[i], stdout);
+            continue;
+        }
+        for(const char *p = args[i]; *p && !stop; ++p) {
+            if(*p == '\\') p = print_escape(p, true, &stop);
+            else putchar(*p);
+        }
+    }
+    if(newline && !stop) putchar('\n');
+    return ferror(stdout) ? 1 : 0;
+}
+
+static int builtin_true(char *args[], struct line *li) {
+    (void) args; (void) li;
+    return 0;
+}
+
+static int builtin_false(char *args[], struct line *li) {
+    (void) args; (void) li;
+    return 1;
+}
+
+/*!
+ * \fn static int builtin_pwd(char *args[], struct line *li)
+ * \brief pwd: print the current working directory.
+ */
+static int builtin_pwd(char *args[], struct line *li) {
+    (void) args; (void) li;
+    char cwd[PATH_MAX];
+    if(getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    puts(cwd);
+    return 0;
+}
+
+/*!
+ * \struct test_state
+ * \brief The arguments of test, read by a recursive descent parser.
+ */
+struct test_state {
+    /*! \brief The arguments (without the name of the command, nor the final "]"). */
+    char **argv;
+    /*! \brief The number of arguments. */
+    int argc;
+    /*! \brief The index of the next argument. */
+    int pos;
+    /*! \brief true once a syntax error was reported. */
+    bool error;
+};
+
+/*!
+ * \fn static long long test_integer(struct test_state *st, const char *str)
+ * \brief Convert an operand of -eq, -lt, ... into an integer.
+ */
+static long long test_integer(struct test_state *st, const char *str) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(str, &end, 10);
+    while(isspace((unsigned char) *end)) end++;
+    if(end == str || *end != '\0' || errno != 0) {
+        if(!st->error) fprintf(stderr, "test: %s: integer expression expected\n", str);
+        st->error = true;
+    }
+    return value;
+}
+
+/*!
+ * \fn static bool test_is_binary(const char *op)
+ * \brief Check whether op is a binary operator of test.
+ */
+static bool test_is_binary(const char *op) {
+    static const char *const ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"};
+    for(size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if(strcmp(op, ops[i]) == 0) return true;
+    }
+    return false;
+}
+
+/*!
+ * \fn static bool test_binary(struct test_state *st, const char *left, const char *op, const char *right)
+ * \brief Evaluate a binary expression of test.
+ */
+static bool test_binary(struct test_state *st, const char *left, const char *op, const char *right) {
+    if(strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+    if(strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+    if(strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+    if(strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+
+    if(op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0) { // -nt, -ot, -ef
+        struct stat l, r;
+        bool has_l = stat(left, &l) == 0, has_r = stat(right, &r) == 0;
+        if(strcmp(op, "-ef") == 0) return has_l && has_r && l.st_dev == r.st_dev && l.st_ino == r.st_ino;
+        if(strcmp(op, "-nt") == 0) {
+            if(!has_l || !has_r) return has_l;
+            return l.st_mtim.tv_sec > r.st_mtim.tv_sec
+                   || (l.st_mtim.tv_sec == r.st_mtim.tv_sec && l.st_mtim.tv_nsec > r.st_mtim.tv_nsec);
+        }
+        if(!has_l || !has_r) return has_r;
+        return l.st_mtim.tv_sec < r.st_mtim.tv_sec
+               || (l.st_mtim.tv_sec == r.st_mtim.tv_sec && l.st_mtim.tv_nsec < r.st_mtim.tv_nsec);
+    }
+
+    long long a = test_integer(st, left), b = test_integer(st, right);
+    if(strcmp(op, "-eq") == 0) return a == b;
+    if(strcmp(op, "-ne") == 0) return a != b;
+    if(strcmp(op, "-lt") == 0) return a < b;
+    if(strcmp(op, "-le") == 0) return a <= b;
+    if(strcmp(op, "-gt") == 0) return a > b;
+    return a >= b; // -ge
+}
+
+/*!
+ * \fn static int test_unary(const char *op, const char *arg)
+ * \brief Evaluate a unary expression of test.
+ * \return 1 if true, 0 if false, -1 if op is not a unary operator.
+ */
+static int test_unary(const char *op, const char *arg) {
+    if(op[0] != '-' || op[1] == '\0' || op[2] != '\0') return -1;
+    struct stat st;
+    switch(op[1]) {
+        case 'n': return arg[0] != '\0';
+        case 'z': return arg[0] == '\0';
+        case 't': return isatty(atoi(arg));
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'e': return stat(arg, &st) == 0;
+        case 'f': return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd': return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 'b': return stat(arg, &st) == 0 && S_ISBLK(st.st_mode);
+        case 'c': return stat(arg, &st) == 0 && S_ISCHR(st.st_mode);
+        case 'p': return stat(arg, &st) == 0 && S_ISFIFO(st.st_mode);
+        case 'S': return stat(arg, &st) == 0 && S_ISSOCK(st.st_mode);
+        case 's': return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'u': return stat(arg, &st) == 0 && (st.st_mode & S_ISUID);
+        case 'g': return stat(arg, &st) == 0 && (st.st_mode & S_ISGID);
+        case 'k': return stat(arg, &st) == 0 && (st.st_mode & S_ISVTX);
+        default: return -1;
+    }
+}
+
+static bool test_or(struct test_state *st);
+
+/*!
+ * \fn static bool test_primary(struct test_state *st)
+ * \brief primary := '(' or ')' | '!' primary | arg binop arg | unop arg | arg
+ */
+static bool test_primary(struct test_state *st) {
+    if(st->pos >= st->argc) {
+        if(!st->error) fprintf(stderr, "test: argument expected\n");
+        st->error = true;
+        return false;
+    }
+    char *arg = st->argv[st->pos];
+    int left = st->argc - st->pos;
+
+    if(left >= 3 && test_is_binary(st->argv[st->pos + 1])) {
+        st->pos += 3;
+        return test_binary(st, arg, st->argv[st->pos - 2], st->argv[st->pos - 1]);
+    }
+    if(strcmp(arg, "!") == 0 && left >= 2) {
+        st->pos++;
+        return !test_primary(st);
+    }
+    if(strcmp(arg, "(") == 0 && left >= 2) {
+        st->pos++;
+        bool value = test_or(st);
+        if(st->pos >= st->argc || strcmp(st->argv[st->pos], ")") != 0) {
+            if(!st->error) fprintf(stderr, "test: ')' expected\n");
+            st->error = true;
+        }
+        st->pos++;
+        return value;
+    }
+    if(left >= 2) {
+        int value = test_unary(arg, st->argv[st->pos + 1]);
+        if(value != -1) {
+            st->pos += 2;
+            return value;
+        }
+    }
+    st->pos++;
+    return arg[0] != '\0';
+}
+
+/*!
+ * \fn static bool test_and(struct test_state *st)
+ * \brief and := primary ('-a' primary)*
+ */
+static bool test_and(struct test_state *st) {
+    bool value = test_primary(st);
+    while(st->pos < st->argc && strcmp(st->argv[st->pos], "-a") == 0) {
+        st->pos++;
+        value = test_primary(st) && value;
+    }
+    return value;
+}
+
+/*!
+ * \fn static bool test_or(struct test_state *st)
+ * \brief or := and ('-o' and)*
+ */
+static bool test_or(struct test_state *st) {
+    bool value = test_and(st);
+    while(st->pos < st->argc && strcmp(st->argv[st->pos], "-o") == 0) {
+        st->pos++;
+        value = test_and(st) || value;
+    }
+    return value;
+}
+
+/*!
+ * \fn static int builtin_test(char *args[], struct line *li)
+ * \brief test expr, or [ expr ]: evaluate a conditional expression.
+ *
+ * Supports the string (= == != < > -n -z), integer (-eq -ne -lt -le -gt -ge), file (-e -f -d -r -w -x -s -L ...,
+ * -nt -ot -ef) tests, with !, -a, -o and parentheses.
+ *
+ * \return 0 if the expression is true, 1 if it is false, 2 if it is invalid.
+ */
+static int builtin_test(char *args[], struct line *li) {
+    (void) li;
+    int argc = 0;
+    while(args[argc] != NULL) argc++;
+
+    if(strcmp(args[0], "[") == 0) {
+        if(strcmp(args[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    struct test_state st = {args + 1, argc - 1, 0, false};
+    if(st.argc == 0) return 1;
+    bool value = test_or(&st);
+    if(!st.error && st.pos < st.argc) {
+        fprintf(stderr, "test: %s: unexpected argument\n", st.argv[st.pos]);
+        st.error = true;
+    }
+    if(st.error) return 2;
+    return value ? 0 : 1;
+}
+
+/*!
+ * \fn static long long printf_integer(const char *str, int *status)
+ * \brief Convert an argument of printf into an integer: a number (decimal, octal or hexadecimal),
+ * or the character code of the character following a quote ('a).
+ */
+static long long printf_integer(const char *str, int *status) {
+    if(str == NULL) return 0;
+    if(str[0] == '\'' || str[0] == '"') return (unsigned char) str[1];
+    char *end;
+    errno = 0;
+    long long value = strtoll(str, &end, 0);
+    if(end == str || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", str);
+        *status = 1;
+    }
+    return value;
+}
+
+/*!
+ * \fn static int builtin_printf(char *args[], struct line *li)
+ * \brief printf format [arg...]: print the arguments according to the format.
+ *
+ * Supports the conversions %s %b %c %d %i %o %u %x %X and %%, with flags, width and precision,
+ * and the escape sequences of the format. The format is reused while arguments remain.
+ */
+static int builtin_printf(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char *format = args[1];
+    char **arg = args + 2;
+    int status = 0;
+    bool stop = false;
+    bool consumed;
+    do {
+        consumed = false;
+        for(const char *p = format; *p && !stop; ++p) {
+            if(*p == '\\') {
+                p = print_escape(p, false, &stop);
+                continue;
+            }
+            if(*p != '%') {
+                putchar(*p);
+                continue;
+            }
+            if(p[1] == '%') {
+                putchar('%');
+                p++;
+                continue;
+            }
+
+            // Copy the conversion specification, then give it to printf(3) with the converted argument
+            char spec[64] = "%";
+            size_t n = 1;
+            for(++p; *p && strchr("-+ #0", *p) && n < 8; ++p) spec[n++] = *p;
+            for(; isdigit((unsigned char) *p) && n < 24; ++p) spec[n++] = *p;
+            if(*p == '.') for(spec[n++] = *p++; isdigit((unsigned char) *p) && n < 40; ++p) spec[n++] = *p;
+            if(*p == '\0') {
+                fprintf(stderr, "printf: %s: missing format character\n", spec);
+                return 1;
+            }
+
+            const char *value = *arg;
+            if(value != NULL) {
+                arg++;
+                consumed = true;
+            }
+            switch(*p) {
+                case 's':
+                    strcpy(spec + n, "s");
+                    printf(spec, value ? value : "");
+                    break;
+                case 'b':
+                    for(const char *b = value ? value : ""; *b && !stop; ++b) {
+                        if(*b == '\\') b = print_escape(b, true, &stop);
+                        else putchar(*b);
+                    }
+                    break;
+                case 'c':
+                    strcpy(spec + n, "c");
+                    if(value != NULL && value[0] != '\0') printf(spec, value[0]);
+                    break;
+                case 'd':
+                case 'i':
+                    strcpy(spec + n, "lld");
+                    printf(spec, printf_integer(value, &status));
+                    break;
+                case 'o':
+                case 'u':
+                case 'x':
+                case 'X':
+                    spec[n] = 'l';
+                    spec[n + 1] = 'l';
+                    spec[n + 2] = *p;
+                    spec[n + 3] = '\0';
+                    printf(spec, (unsigned long long) printf_integer(value, &status));
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid directive\n", *p);
+                    return 1;
+            }
+        }
+    } while(consumed && *arg != NULL && !stop);
+    return status;
+}
@@ -0,0 +1,87 @@
+/*!
+ * \file builtins.h
+ * \brief Header file for the registry of the internal commands.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The internal commands are kept in a table sorted by name and found by binary search.
+ * They run in the process of the shell, with the redirections of the line applied around the call,
+ * so "true", "echo" or "test" cost a function call instead of a fork() + execv().
+ * Inside a pipeline of several commands or in background, an internal command is forked like an external
+ * one, since it has to run at the same time as the other commands or as the shell. The data commands
+ * (cat, tee) and parallel are always forked.
+ */
+#ifndef FISH_BUILTINS_H
+#define FISH_BUILTINS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cmdline.h"
+
+/*!
+ * \typedef builtin_fn
+ * \brief An internal command.
+ *
+ * \param args The arguments of the command (NULL terminated, args[0] is the name of the command).
+ * \param li The line being executed.
+ * \return The status of the command (0 on success), or 256 + a signal number (see execute_command_with_args).
+ */
+typedef int (*builtin_fn)(char *args[], struct line *li);
+
+/*!
+ * \struct builtin
+ * \brief An entry of the registry.
+ */
+struct builtin {
+    /*!
+     * \var name
+     * \brief The name of the command.
+     */
+    const char *name;
+    /*!
+     * \var fn
+     * \brief The function executing the command.
+     */
+    builtin_fn fn;
+    /*!
+     * \var forked
+     * \brief true if the command is forked even alone on its line, because it may block on its input
+     * or run for long: it must stay interruptible by Ctrl-C and Ctrl-Z like an external command.
+     */
+    bool forked;
+};
+
+/*!
+ * \fn const struct builtin *builtin_find(const char *name)
+ * \brief Find an internal command by its name.
+ *
+ * \param name The name of the command.
+ * \return The entry of the command, NULL if name is not an internal command.
+ */
+const struct builtin *builtin_find(const char *name);
+
+/*!
+ * \fn const struct builtin *builtin_list(size_t *count)
+ * \brief Get the whole registry, sorted by name (strcmp order).
+ *
+ * \param count Where to store the number of internal commands.
+ * \return The first entry of the registry.
+ */
+const struct builtin *builtin_list(size_t *count);
+
+/*!
+ * \fn int builtin_run(const struct builtin *builtin, char *args[], struct line *li)
+ * \brief Execute an internal command in the process of the shell.
+ *
+ * The input and output redirections of the line are applied to the standard input and output of the shell
+ * during the call, then restored. stdout is flushed before returning.
+ *
+ * \param builtin The command to execute (see builtin_find).
+ * \param args The arguments of the command.
+ * \param li The line being executed.
+ * \return The status of the command, 1 if a redirection cannot be opened.
+ */
+int builtin_run(const struct builtin *builtin, char *args[], struct line *li);
+
+#endif //FISH_BUILTINS_H
@@ -0,0 +1,245 @@
+/*!
+ * \file cmdhash.c
+ * \brief Implementation of the cache of the commands resolved in the PATH.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The cache is an open addressing hash table (linear probing, FNV-1a) keyed by the command name.
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "cmdhash.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ * \def CMDHASH_INITIAL_SIZE
+ * \brief Initial number of slots of the table (a power of two).
+ */
+#define CMDHASH_INITIAL_SIZE 64
+
+/*!
+ * \struct cmdhash_entry
+ * \brief A slot of the table. The slot is empty when name is NULL.
+ */
+struct cmdhash_entry {
+    /*! \brief The name of the command (key). */
+    char *name;
+    /*! \brief The absolute path of the command. */
+    char *path;
+    /*! \brief The number of lookups answered by this entry. */
+    size_t hits;
+};
+
+/*!
+ * \struct cmdhash
+ * \brief The table and its statistics.
+ */
+static struct cmdhash {
+    /*! \brief The slots, NULL before the first insertion. */
+    struct cmdhash_entry *entries;
+    /*! \brief The number of slots (a power of two). */
+    size_t size;
+    /*! \brief The number of used slots. */
+    size_t count;
+    /*! \brief The value of PATH the entries were resolved with. */
+    char *path_env;
+    /*! \brief Lookups answered by the cache. */
+    size_t hits;
+    /*! \brief Lookups which needed a walk of the PATH. */
+    size_t misses;
+} table;
+
+/*!
+ * \var resolved
+ * \brief Storage for a path which is returned without being cached.
+ */
+static char resolved[PATH_MAX];
+
+static uint64_t fnv1a(const char *str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *str; ++str) {
+        h ^= (unsigned char) *str;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/*!
+ * \fn static bool is_executable(const char *path)
+ * \brief Check that path is a regular file the user is allowed to execute.
+ */
+static bool is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/*!
+ * \fn static size_t find_slot(const char *name)
+ * \brief Find the slot of name, or the empty slot where it should be inserted.
+ */
+static size_t find_slot(const char *name) {
+    size_t mask = table.size - 1;
+    size_t i = fnv1a(name) & mask;
+    while (table.entries[i].name != NULL && strcmp(table.entries[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*!
+ * \fn static void remove_slot(size_t i)
+ * \brief Empty a slot and shift back the following entries of its cluster (no tombstones).
+ */
+static void remove_slot(size_t i) {
+    size_t mask = table.size - 1;
+    free(table.entries[i].name);
+    free(table.entries[i].path);
+    table.entries[i].name = NULL;
+    table.count--;
+
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (table.entries[j].name == NULL) return;
+        size_t home = fnv1a(table.entries[j].name) & mask;
+        // The entry at j can move to i only if its home slot is not in the cyclic range ]i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+            table.entries[i] = table.entries[j];
+            table.entries[j].name = NULL;
+            i = j;
+        }
+    }
+}
+
+static bool grow() {
+    size_t new_size = table.size ? table.size * 2 : CMDHASH_INITIAL_SIZE;
+    struct cmdhash_entry *new_entries = calloc(new_size, sizeof(struct cmdhash_entry));
+    if (new_entries == NULL) return false;
+
+    struct cmdhash_entry *old = table.entries;
+    size_t old_size = table.size;
+    table.entries = new_entries;
+    table.size = new_size;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].name != NULL) {
+            table.entries[find_slot(old[i].name)] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/*!
+ * \fn static const char *walk_path(const char *cmd, const char *path_env, bool *absolute)
+ * \brief Search cmd in the directories of path_env, in order.
+ *
+ * \param absolute Set to true if the result comes from an absolute PATH entry.
+ * \return The path found (stored in resolved), NULL if not found.
+ */
+static const char *walk_path(const char *cmd, const char *path_env, bool *absolute) {
+    size_t cmd_len = strlen(cmd);
+    const char *dir = path_env;
+    for (;;) {
+        const char *end = strchrnul(dir, ':');
+        size_t dir_len = end - dir;
+        if (dir_len == 0) { // An empty entry means the current directory
+            dir = ".";
+            dir_len = 1;
+        }
+        if (dir_len + 1 + cmd_len < sizeof(resolved)) {
+            memcpy(resolved, dir, dir_len);
+            resolved[dir_len] = '/';
+            memcpy(resolved + dir_len + 1, cmd, cmd_len + 1);
+            if (is_executable(resolved)) {
+                *absolute = resolved[0] == '/';
+                return resolved;
+            }
+        }
+        if (*end == '\0') return NULL;
+        dir = end + 1;
+    }
+}
+
+const char *cmdhash_lookup(const char *cmd) {
+    if (strchr(cmd, '/') != NULL) return cmd;
+
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL) path_env = "/usr/local/bin:/usr/bin:/bin";
+
+    if (table.path_env == NULL || strcmp(table.path_env, path_env) != 0) {
+        cmdhash_clear();
+        table.path_env = strdup(path_env);
+    }
+
+    if (table.count > 0) {
+        size_t i = find_slot(cmd);
+        if (table.entries[i].name != NULL) {
+            if (is_executable(table.entries[i].path)) {
+                table.entries[i].hits++;
+                table.hits++;
+                return table.entries[i].path;
+            }
+            remove_slot(i); // The binary was moved or removed: search it again
+        }
+    }
+
+    table.misses++;
+    bool absolute = false;
+    const char *found = walk_path(cmd, path_env, &absolute);
+    if (found == NULL || !absolute || table.path_env == NULL) return found;
+
+    if ((table.count + 1) * 10 > table.size * 7 && !grow()) return found;
+
+    char *name = strdup(cmd);
+    char *path = strdup(found);
+    if (name == NULL || path == NULL) {
+        free(name);
+        free(path);
+        return found;
+    }
+    size_t i = find_slot(cmd);
+    table.entries[i].name = name;
+    table.entries[i].path = path;
+    table.entries[i].hits = 1;
+    table.count++;
+    return path;
+}
+
+void cmdhash_clear() {
+    for (size_t i = 0; i < table.size; ++i) {
+        if (table.entries[i].name != NULL) {
+            free(table.entries[i].name);
+            free(table.entries[i].path);
+            table.entries[i].name = NULL;
+        }
+    }
+    table.count = 0;
+    free(table.path_env);
+    table.path_env = NULL;
+}
+
+void cmdhash_print(FILE *out) {
+    if (table.count == 0) {
+        fprintf(out, "hash: hash table empty\n");
+    } else {
+        fprintf(out, "hits\tcommand\n");
+        for (size_t i = 0; i < table.size; ++i) {
+            if (table.entries[i].name != NULL) {
+                fprintf(out, "%4zu\t%s\n", table.entries[i].hits, table.entries[i].path);
+            }
+        }
+    }
+    fprintf(out, "hash: %zu hits, %zu misses\n", table.hits, table.misses);
+}
@@ -0,0 +1,46 @@
+/*!
+ * \file cmdhash.h
+ * \brief Header file for the cache of the commands resolved in the PATH.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * Like the "hash" builtin of bash, the shell remembers the absolute path of the commands
+ * it already found in the PATH, so launching a command does not probe every PATH entry again.
+ */
+#ifndef FISH_CMDHASH_H
+#define FISH_CMDHASH_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*!
+ * \fn const char *cmdhash_lookup(const char *cmd)
+ * \brief Resolve a command name into the path to execute.
+ *
+ * A command containing a '/' is returned as is.
+ * Otherwise the cache is used, and filled by a walk of the PATH on a miss.
+ * The whole cache is dropped when the PATH changed since the previous lookup,
+ * and a cached path which is no longer executable is resolved again.
+ * Results coming from a relative PATH entry (like "." or an empty entry) are never cached.
+ *
+ * \param cmd The name of the command.
+ * \return The path to execute, NULL if the command is not found.<br>
+ *         The string is owned by the cache and stays valid until the next call of a cmdhash function.
+ */
+const char *cmdhash_lookup(const char *cmd);
+
+/*!
+ * \fn void cmdhash_clear()
+ * \brief Forget all the cached paths. The hit/miss counters are kept.
+ */
+void cmdhash_clear();
+
+/*!
+ * \fn void cmdhash_print(FILE *out)
+ * \brief Print the cached commands with their number of hits, followed by the hit/miss counters.
+ *
+ * \param out The stream to print to.
+ */
+void cmdhash_print(FILE *out);
+
+#endif //FISH_CMDHASH_H
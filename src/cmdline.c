@@ -14,6 +14,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 void line_init(struct line *li) {
@@ -21,28 +26,39 @@ void line_init(struct line *li) {
   memset(li, 0, sizeof(struct line));
 }
 
-
 /*!
- * \fn static bool valid_cmdarg_filename(const char *word)
- * \brief Test the validity of command arguments or file names used in redirections
- * This function is static : it means that it is a local function, accessible only in this source file
+ * \fn static bool line_grow(void **array, size_t *size, size_t needed, size_t elem_size)
+ * \brief Make sure the dynamic array "array" can hold "needed" elements
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The capacity is doubled, so filling an array costs an amortized constant time per element.
+ * The arrays are kept by line_clear(), so they are reused by the next lines.
  *
- * \param word pointer on the first char of string to test
- * \return true if the word is valid, false otherwise
+ * \param array pointer on the array to grow
+ * \param size pointer on the capacity (in elements) of the array
+ * \param needed number of elements the array must be able to hold
+ * \param elem_size size of an element
+ * \return true on success, false if a memory allocation failure occurs
  */
-static bool valid_cmdarg_filename(const char *word){ 
-   const char *forbidden = "<>&|";// forbidden characters in commands arguments and filenames
-
-   size_t lenf = strlen(forbidden);
-   for (size_t i = 0; i < lenf ; ++i){
-      char *ptr = strchr(word, forbidden[i]);
-      if (ptr) {
-         return false;
-      }
-   }
-   return true;
+static bool line_grow(void **array, size_t *size, size_t needed, size_t elem_size) {
+  if (needed <= *size) {
+    return true;
+  }
+  size_t new_size = *size ? *size : 16;
+  while (new_size < needed) {
+    new_size *= 2;
+  }
+  void *new_array = realloc(*array, new_size * elem_size);
+  if (new_array == NULL) {
+    fprintf(stderr, "Memory allocation failure\n");
+    return false;
+  }
+  *array = new_array;
+  *size = new_size;
+  return true;
 }
 
+
 /*!
  * \fn static void parse_error(const char *format, ...)
  * \brief Print the string "Error while parsing: ", followed by the string "format" to stderr
@@ -65,76 +81,475 @@ static void parse_error(const char *format, ...) {
 }
 
 /*!
- * \fn static int line_next_word(const char *str, size_t *index, char **pword)
- * \brief Search a new word in the string "str" from the "index" position
+ * \enum char_class
+ * \brief Bits describing how the tokenizer handles a byte.
+ */
+enum char_class {
+  CC_END = 1 << 0,       /*!< the '\0' ending the line */
+  CC_SPACE = 1 << 1,     /*!< a separator between two words (see isspace(3)) */
+  CC_QUOTE = 1 << 2,     /*!< a quote starting or ending a quoted word */
+  CC_FORBIDDEN = 1 << 3, /*!< a character which is not allowed in commands arguments and filenames */
+  CC_SEPARATOR = 1 << 4, /*!< the ';' ending an unquoted word and the pipeline */
+};
+
+/*!
+ * \var char_class
+ * \brief Class of every byte. A byte without any bit is a plain character of a word.
+ */
+static const unsigned char char_class[256] = {
+  ['\0'] = CC_END,
+  [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+  ['"'] = CC_QUOTE, ['\''] = CC_QUOTE,
+  ['<'] = CC_FORBIDDEN, ['>'] = CC_FORBIDDEN, ['&'] = CC_FORBIDDEN, ['|'] = CC_FORBIDDEN,
+  [';'] = CC_SEPARATOR,
+};
+
+/*!
+ * \def LINE_PADDING
+ * \brief Number of bytes allocated after the end of the copy of a line,
+ * so scan_special() can load whole vectors without reading outside of the buffer.
+ */
+#define LINE_PADDING 32
+
+/*!
+ * \fn static size_t scan_special(const char *str)
+ * \brief Return the index of the first byte of "str" having a class in char_class.
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * Plain characters are skipped 32 (AVX2) or 16 (SSE2) bytes at a time when the compiler targets these
+ * instruction sets, one byte at a time with the char_class table otherwise. It always stops on the final '\0'.
+ * "str" must be followed by LINE_PADDING readable bytes after its '\0'.
+ *
+ * \param str pointer on the first char to scan
+ * \return the index of the first special byte
+ */
+static size_t scan_special(const char *str) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i tab_to_cr = _mm256_set1_epi8('\r' - '\t');
+  for (;; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (str + i));
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, tab_to_cr), shifted); // '\t' <= c <= '\r'
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    unsigned mask = (unsigned) _mm256_movemask_epi8(hit);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i tab_to_cr = _mm_set1_epi8('\r' - '\t');
+  for (;; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(shifted, tab_to_cr), shifted); // '\t' <= c <= '\r'
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    unsigned mask = (unsigned) _mm_movemask_epi8(hit);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#else
+  while (!char_class[(unsigned char) str[i]]) {
+    ++i;
+  }
+  return i;
+#endif
+}
+
+/*!
+ * \enum token_type
+ * \brief Type of a token of the command line.
+ */
+enum token_type {
+  TOK_END,          /*!< end of the line */
+  TOK_WORD,         /*!< a command, an argument or a filename */
+  TOK_PIPE,         /*!< "|" */
+  TOK_REDIR_OUT,    /*!< ">" */
+  TOK_REDIR_APPEND, /*!< ">>" */
+  TOK_REDIR_IN,     /*!< "<" */
+  TOK_BG,           /*!< "&" */
+  TOK_SEQ,          /*!< ";" */
+  TOK_AND,          /*!< "&&" */
+  TOK_OR,           /*!< "||" */
+};
+
+/*!
+ * \struct token
+ * \brief A token of the command line, as returned by line_next_token().
+ */
+struct token {
+  /*! \brief The type of the token. */
+  enum token_type type;
+  /*! \brief The text of the token, '\0'-terminated inside the copy of the line (NULL for TOK_END). */
+  char *word;
+  /*! \brief For a TOK_WORD, false if the word contains a character forbidden in arguments and filenames. */
+  bool valid;
+  /*! \brief For a TOK_WORD, the quote around the word (' or "), '\0' if it is not quoted (see LINE_ARG_GLOB). */
+  char quote;
+};
+
+/*!
+ * \fn static enum token_type operator_type(const char *word, size_t len)
+ * \brief Recognize an operator written as a whole unquoted word.
+ *
+ * \return the type of the operator, or TOK_WORD if "word" is not an operator
+ */
+static enum token_type operator_type(const char *word, size_t len) {
+  if (len == 1) {
+    switch (word[0]) {
+      case '|': return TOK_PIPE;
+      case '>': return TOK_REDIR_OUT;
+      case '<': return TOK_REDIR_IN;
+      case '&': return TOK_BG;
+      default: break;
+    }
+  }
+  else if (len == 2 && word[0] == '>' && word[1] == '>') {
+    return TOK_REDIR_APPEND;
+  }
+  else if (len == 2 && word[0] == '&' && word[1] == '&') {
+    return TOK_AND;
+  }
+  else if (len == 2 && word[0] == '|' && word[1] == '|') {
+    return TOK_OR;
+  }
+  return TOK_WORD;
+}
+
+/*!
+ * \struct lexer
+ * \brief The position of line_next_token() in the copy of the line.
+ */
+struct lexer {
+  /*! \brief The copy of the line owned by the struct line. */
+  char *str;
+  /*! \brief The position of the next character to read. */
+  size_t index;
+  /*! \brief true if the last word was ended by a ';', which was replaced by its '\0'. */
+  bool separator;
+};
+
+/*!
+ * \fn static int line_next_token(struct lexer *lx, struct token *tok)
+ * \brief Read the next token of the string "lx->str" from the "lx->index" position, in a single pass
  * 
  * This function is static : it means that it is a local function, accessible only in this source file.
- * After the call, "index" contains the position of the last character used plus one.
- * If a word is found, it is copied to a dynamically allocated memory space. "pword" is a pointer
- * on a pointer which retrieves the address of this dynamically allocated memory space.
+ * After the call, "lx->index" contains the position of the last character used plus one.
+ * The string "lx->str" is the copy of the line owned by the struct line: the character following the
+ * token (a space, a ';' or the closing quote) is replaced by a '\0' and "tok->word" points on the token
+ * inside "lx->str". No memory is allocated.
+ *
+ * Words are separated by spaces. A word starting with a quote (' or ") ends on the same quote and
+ * is always a TOK_WORD. An unquoted word made only of "|", ">", ">>", "<", "&", "&&" or "||" is an operator.
+ * An unquoted ';' is always a TOK_SEQ, even when it is glued to a word ("a; b" is "a" ";" "b").
  * 
- * \param str pointer on the first char of the line entered by the user
- * \param index pointer on the index
- * \param pword pointer on a pointer which retrieves the address of this dynamically allocated memory space
+ * \param lx pointer on the position in the copy of the line entered by the user
+ * \param tok pointer on the token to fill
  *
- * \return   0 if a word is found or if the end of the line is reached <br>
- *           -1 if a malformed line is detected <br>
- *           -2 if a memory allocation failure occurs
+ * \return   0 if a token is found or if the end of the line is reached (TOK_END) <br>
+ *           -1 if a malformed line is detected
  */
-static int line_next_word(const char *str, size_t *index, char **pword) {
-  assert(str);
-  assert(index);
-  assert(pword);
+static int line_next_token(struct lexer *lx, struct token *tok) {
+  assert(lx);
+  assert(tok);
 
-  size_t i = *index;
-  *pword = NULL;
+  char *str = lx->str;
+  size_t i = lx->index;
+  tok->type = TOK_END;
+  tok->word = NULL;
+  tok->valid = true;
+  tok->quote = '\0';
+
+  /* The ';' ending the previous word was overwritten by its '\0' */
+  if (lx->separator) {
+    lx->separator = false;
+    tok->type = TOK_SEQ;
+    return 0;
+  }
 
   /* Eat space */
-  while (str[i] != '\0' && isspace(str[i])) {
+  while (char_class[(unsigned char) str[i]] & CC_SPACE) {
     ++i;
   }
 
   /* Check if it is the end of the line */
   if (str[i] == '\0') {
-    *index = i;
+    lx->index = i;
+    return 0;
+  }
+
+  if (str[i] == ';') {
+    lx->index = i + 1;
+    tok->type = TOK_SEQ;
     return 0;
   }
 
   size_t start = i;
-  size_t end = i;
-  if (str[i] == '"' || str[i] == '\'') {  // Handle both double quotes and single quotes (default can only handle double quotes)
+  unsigned char cls;
+  if (char_class[(unsigned char) str[i]] & CC_QUOTE) {  // Handle both double quotes and single quotes
     char quoteType = str[i];  // Save the quote type (' or ")
     ++start;
-    do {
+    ++i;
+    for (;;) {
+      i += scan_special(str + i);
+      cls = char_class[(unsigned char) str[i]];
+      if (cls & CC_END || str[i] == quoteType) {
+        break;
+      }
+      if (cls & CC_FORBIDDEN) {
+        tok->valid = false;
+      }
       ++i;
-    } while (str[i] != '\0' && str[i] != quoteType);  // Match the same type of quote
+    }
 
     if (str[i] == '\0') {
       parse_error("Malformed line, unmatched %c\n", quoteType);
       return -1;
     }
-    assert(str[i] == quoteType);
-    end = i;
+    str[i] = '\0';
+    lx->index = i + 1;
+    tok->type = TOK_WORD;
+    tok->word = str + start;
+    tok->quote = quoteType;
+    return 0;
+  }
+
+  for (;;) {
+    i += scan_special(str + i);
+    cls = char_class[(unsigned char) str[i]];
+    if (cls & (CC_END | CC_SPACE | CC_SEPARATOR)) {
+      break;
+    }
+    if (cls & CC_FORBIDDEN) {
+      tok->valid = false;
+    }
     ++i;
   }
-  else {
-    while (str[i] != '\0' && !isspace(str[i])) {
-      ++i;
+
+  tok->word = str + start;
+  tok->type = tok->valid ? TOK_WORD : operator_type(tok->word, i - start);
+  if (str[i] != '\0') {
+    lx->separator = str[i] == ';';
+    str[i] = '\0';
+    ++i;
+  }
+  lx->index = i;
+  return 0;
+}
+
+/*!
+ * \fn static bool line_grow_argv(struct line *li, size_t needed)
+ * \brief Make sure li->argv and li->arg_flags can hold "needed" elements (both have li->argv_size elements).
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * \return true on success, false if a memory allocation failure occurs
+ */
+static bool line_grow_argv(struct line *li, size_t needed) {
+  size_t flags_size = li->argv_size;
+  return line_grow((void **) &li->arg_flags, &flags_size, needed, sizeof(unsigned char))
+      && line_grow((void **) &li->argv, &li->argv_size, needed, sizeof(char *));
+}
+
+/*!
+ * \fn static unsigned char line_word_flags(const struct token *tok)
+ * \brief Compute the flags of a word (LINE_ARG_GLOB, LINE_ARG_VARS, LINE_ARG_ASSIGN).
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * An unquoted "NAME=value" is an assignment, never expanded as a pattern. A '$' is expanded in an
+ * unquoted or double-quoted word, not in a single-quoted one.
+ */
+static unsigned char line_word_flags(const struct token *tok) {
+  const char *word = tok->word;
+  unsigned char flags = 0;
+  if (tok->quote == '\0') {
+    size_t i = 0;
+    if (isalpha((unsigned char) word[0]) || word[0] == '_') {
+      while (isalnum((unsigned char) word[i]) || word[i] == '_') {
+        ++i;
+      }
+    }
+    if (i > 0 && word[i] == '=') {
+      flags = LINE_ARG_ASSIGN;
+    }
+    else if (strpbrk(word, "*?[") != NULL) {
+      flags = LINE_ARG_GLOB;
     }
-    end = i;
   }
+  if (tok->quote != '\'' && strchr(word, '$') != NULL) {
+    flags |= LINE_ARG_VARS;
+  }
+  return flags;
+}
+
+/*!
+ * \fn static bool line_end_cmd(struct line *li, size_t n_cmd, size_t n_args, size_t *argv_len)
+ * \brief Terminate the command number "n_cmd" whose "n_args" arguments are the last ones of li->argv
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * A NULL is appended to li->argv after the arguments, and the command records the offset of its first
+ * argument (li->cmds[n_cmd].args is set by line_parse() once li->argv will not move anymore).
+ *
+ * \param li pointer on the struct line being parsed
+ * \param n_cmd index of the command
+ * \param n_args number of arguments of the command
+ * \param argv_len pointer on the number of elements used in li->argv
+ * \return true on success, false if a memory allocation failure occurs
+ */
+static bool line_end_cmd(struct line *li, size_t n_cmd, size_t n_args, size_t *argv_len) {
+  if (!line_grow_argv(li, *argv_len + 1)
+      || !line_grow((void **) &li->cmds, &li->cmds_size, n_cmd + 1, sizeof(struct cmd))) {
+    return false;
+  }
+  li->arg_flags[*argv_len] = 0;
+  li->argv[(*argv_len)++] = NULL;
+  li->cmds[n_cmd].first_arg = *argv_len - n_args - 1;
+  li->cmds[n_cmd].n_args = n_args;
+  li->cmds[n_cmd].args = NULL;
+  return true;
+}
 
-  *index = i;
+/*!
+ * \fn static char *line_copy(struct line *li, const char *str, size_t len)
+ * \brief Copy "str" in the buffer of "li", which is grown if needed.
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The buffer is kept by line_clear(), so in the steady state parsing a line allocates nothing.
+ * LINE_PADDING bytes are reserved after the copy for scan_special().
+ *
+ * \param li pointer on the struct line owning the buffer
+ * \param str the string to copy
+ * \param len the length of "str"
+ * \return the copy, or NULL if a memory allocation failure occurs
+ */
+static char *line_copy(struct line *li, const char *str, size_t len) {
+  if (li->buffer_size < len + 1 + LINE_PADDING) {
+    size_t size = li->buffer_size ? li->buffer_size : 256;
+    while (size < len + 1 + LINE_PADDING) {
+      size *= 2;
+    }
+    char *buffer = realloc(li->buffer, size);
+    if (buffer == NULL) {
+      fprintf(stderr, "Memory allocation failure\n");
+      return NULL;
+    }
+    li->buffer = buffer;
+    li->buffer_size = size;
+  }
+  memcpy(li->buffer, str, len + 1);
+  memset(li->buffer + len + 1, 0, LINE_PADDING);
+  return li->buffer;
+}
 
-  /* Copy this word */
-  assert(end >= start);
-  *pword = calloc(end - start + 1, sizeof(char));
-  if (*pword == NULL) {
+
+/*!
+ * \fn static const char *connector_name(enum line_connector connector)
+ * \brief Return the operator joining a pipeline to the previous one, for the error messages.
+ */
+static const char *connector_name(enum line_connector connector) {
+  switch (connector) {
+    case LINE_AND: return "&&";
+    case LINE_OR: return "||";
+    default: return ";";
+  }
+}
+
+/*!
+ * \fn static struct line *line_new_pipeline(struct line *li)
+ * \brief Return an empty struct line for the next pipeline of the command list "li".
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The pipelines released by line_clear() are kept in "li->spare" with their arrays, so a line with the
+ * same shape as the previous one allocates nothing.
+ *
+ * \param li pointer on the first pipeline of the list
+ * \return the new pipeline, or NULL if a memory allocation failure occurs
+ */
+static struct line *line_new_pipeline(struct line *li) {
+  struct line *pipeline = li->spare;
+  if (pipeline != NULL) {
+    li->spare = pipeline->next;
+    pipeline->next = NULL;
+    return pipeline;
+  }
+  pipeline = calloc(1, sizeof(struct line));
+  if (pipeline == NULL) {
     fprintf(stderr, "Memory allocation failure\n");
-    return -2;
   }
-  memcpy(*pword, str + start, end - start);
-  return 0;
+  return pipeline;
+}
+
+/*!
+ * \fn static int line_end_pipeline(struct line *pl, size_t n_cmd, size_t n_args, size_t argv_len, bool check)
+ * \brief Terminate the pipeline "pl" whose last command has "n_args" arguments.
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * If "check" is true, a pipeline made only of redirections, or ending with an empty command,
+ * is a syntax error. The commands point into "pl->argv" once this function returns, even on error.
+ *
+ * \param pl pointer on the pipeline being parsed
+ * \param n_cmd number of commands already terminated
+ * \param n_args number of arguments of the last command
+ * \param argv_len number of elements used in pl->argv
+ * \param check true to check the pipeline (false after an error)
+ * \return 0 on success, -1 on a syntax error or a memory allocation failure
+ */
+static int line_end_pipeline(struct line *pl, size_t n_cmd, size_t n_args, size_t argv_len, bool check) {
+  int valret = 0;
+
+  if (check && n_args == 0) {
+    if (n_cmd > 0){
+      parse_error("An empty command detected\n");
+      valret = -1;
+    }
+    // in a real shell, "< fic" is equivalent to "test -r fic"
+    else if (pl->file_input){
+      parse_error("Missing first command\n");
+      valret = -1;
+    }
+    // in a real shell, "> fic" :
+    // - creates the regular file "fic" if it does not exist,
+    // - and truncates it if it already exists
+    // in a real shell, ">> fic" :
+    // - creates the regular file "fic" if it does not exist,
+    // - and doesn't truncate it if it already exists
+    else if (pl->file_output){
+      parse_error("Missing last command\n");
+      valret = -1;
+    }
+  }
+
+  if (check && !valret && n_args != 0) {
+    if (line_end_cmd(pl, n_cmd, n_args, &argv_len)) {
+      ++n_cmd;
+    } else {
+      valret = -1;
+    }
+  }
+
+  // pl->argv may have moved while growing: the commands point into it only once it is complete
+  for (size_t i = 0; i < n_cmd; ++i) {
+    pl->cmds[i].args = pl->argv + pl->cmds[i].first_arg;
+  }
+  pl->n_cmds = n_cmd;
+  return valret;
 }
 
 
@@ -143,48 +558,81 @@ int line_parse(struct line *li, const char *str) {
   assert(str);
 
   size_t len = strlen(str);
-  assert(len >= 1);
-  if (str[len -1] != '\n'){
-    fprintf(stderr, "The command line is too long\n");
-    char c = 0;
-    while (c != '\n'){
-      c = fgetc(stdin);
-    }
+  char *copy = line_copy(li, str, len);
+  if (copy == NULL) {
     return -1;
   }
 
-  size_t index = 0;
+  struct lexer lx = { .str = copy, .index = 0, .separator = false };
+  struct line *cur = li;   // the pipeline being parsed
+  struct line *prev = NULL; // the pipeline before it in the list
   size_t curr_n_cmd = 0;
   size_t curr_n_arg = 0;
+  size_t argv_len = 0; // number of elements used in cur->argv (arguments and NULL terminators)
   int valret = 0;
 
   for (;;) {
-    /* get the next word */
-    char *word;
-    int err = line_next_word(str, &index, &word);
+    /* get the next token */
+    struct token tok;
+    int err = line_next_token(&lx, &tok);
     if (err) {
       valret = -1;
       break;
     }
 
-    if (!word) {
+    if (tok.type == TOK_END) {
       break;
     }
 
 #ifdef DEBUG
-    fprintf(stderr, "\tnew word: \"%s\"\n", word);
+    fprintf(stderr, "\tnew token (%d): \"%s\"\n", tok.type, tok.word);
 #endif
 
-    if (strcmp(word, "|") == 0) {
-      free(word);
+    if (tok.type == TOK_SEQ || tok.type == TOK_AND || tok.type == TOK_OR) {
+      enum line_connector connector = tok.type == TOK_AND ? LINE_AND : tok.type == TOK_OR ? LINE_OR : LINE_SEQ;
+
+      if (cur->background) {
+        parse_error("No '%s' allowed after a '&'\n", connector_name(connector));
+        valret = -1;
+        break;
+      }
+
+      if (curr_n_cmd == 0 && curr_n_arg == 0 && !cur->file_input && !cur->file_output) {
+        parse_error("An empty command before '%s' detected\n", connector_name(connector));
+        valret = -1;
+        break;
+      }
+
+      if (line_end_pipeline(cur, curr_n_cmd, curr_n_arg, argv_len, true)) {
+        valret = -1;
+        curr_n_cmd = cur->n_cmds;
+        curr_n_arg = 0;
+        break;
+      }
 
-      if (li->background) {
+      struct line *next = line_new_pipeline(li);
+      if (next == NULL) {
+        valret = -1;
+        curr_n_cmd = cur->n_cmds;
+        curr_n_arg = 0;
+        break;
+      }
+      next->connector = connector;
+      cur->next = next;
+      prev = cur;
+      cur = next;
+      curr_n_cmd = 0;
+      curr_n_arg = 0;
+      argv_len = 0;
+    }
+    else if (tok.type == TOK_PIPE) {
+      if (cur->background) {
         parse_error("No pipe allowed after a '&'\n");
         valret = -1;
         break;
       }
 
-      if (li->file_output) {
+      if (cur->file_output) {
         parse_error("No pipe allowed after an output redirection\n");
         valret = -1;
         break;
@@ -196,58 +644,60 @@ int line_parse(struct line *li, const char *str) {
         break;
       }
 
-      li->cmds[curr_n_cmd].n_args = curr_n_arg;
+      if (!line_end_cmd(cur, curr_n_cmd, curr_n_arg, &argv_len)) {
+        valret = -1;
+        break;
+      }
       curr_n_arg = 0;
       ++curr_n_cmd;
     }
-    else if (strcmp(word, ">") == 0 || strcmp(word, ">>") == 0) {
-      bool append = strcmp(word, ">>") == 0;
-      free(word);
+    else if (tok.type == TOK_REDIR_OUT || tok.type == TOK_REDIR_APPEND) {
+      bool append = tok.type == TOK_REDIR_APPEND;
 
-      if (li->file_output) {
+      if (cur->file_output) {
         parse_error("Output redirection already defined\n");
         valret = -1;
         break;
       }
 
-      if (li->background) {
+      if (cur->background) {
         parse_error("No output redirection allowed after a '&'\n");
         valret = -1;
         break;
       }
 
-      err = line_next_word(str, &index, &word);
+      err = line_next_token(&lx, &tok);
       if (err) {
         valret = -1;
         break;
       }
 
-      if (!word) {
+      if (tok.type == TOK_END) {
         parse_error("Waiting for a filename after an output redirection\n");
         valret = -1;
         break;
       }
 
-      if (!valid_cmdarg_filename(word)){
-        parse_error("Filename \"%s\" is not valid\n", word);
-        free(word);
+      if (tok.type != TOK_WORD || !tok.valid){
+        parse_error("Filename \"%s\" is not valid\n", tok.word ? tok.word : ";");
         valret = -1;
         break;
       }
-      li->file_output = word;
-      li->file_output_append = append;
+      cur->file_output = tok.word;
+      cur->file_output_append = append;
+      cur->file_output_flags = line_word_flags(&tok) & LINE_ARG_VARS;
+      cur->n_vars += cur->file_output_flags != 0;
 
     }
-    else if (strcmp(word, "<") == 0) {
-      free(word);
+    else if (tok.type == TOK_REDIR_IN) {
 
-      if (li->file_input) {
+      if (cur->file_input) {
         parse_error("Input redirection already defined\n");
         valret = -1;
         break;
       }
 
-      if (li->background) {
+      if (cur->background) {
         parse_error("No input redirection allowed after a '&'\n");
         valret = -1;
         break;
@@ -259,32 +709,32 @@ int line_parse(struct line *li, const char *str) {
         break;
       }
 
-      err = line_next_word(str, &index, &word);
+      err = line_next_token(&lx, &tok);
       if (err) {
         valret = -1;
         break;
       }
 
-      if (!word) {
+      if (tok.type == TOK_END) {
         parse_error("Waiting for a filename after an input redirection\n");
         valret = -1;
         break;
       }
 
-      if (!valid_cmdarg_filename(word)){
-        parse_error("Filename \"%s\" is not valid\n", word);
-        free(word);
+      if (tok.type != TOK_WORD || !tok.valid){
+        parse_error("Filename \"%s\" is not valid\n", tok.word ? tok.word : ";");
         valret = -1;
         break;
       }
 
-      li->file_input = word;
+      cur->file_input = tok.word;
+      cur->file_input_flags = line_word_flags(&tok) & LINE_ARG_VARS;
+      cur->n_vars += cur->file_input_flags != 0;
 
     }
-    else if (strcmp(word, "&") == 0) {
-      free(word);
+    else if (tok.type == TOK_BG) {
 
-      if (li->background) {
+      if (cur->background) {
         parse_error("More than one '&' detected\n");
         valret = -1;
         break;
@@ -296,89 +746,407 @@ int line_parse(struct line *li, const char *str) {
         break;
       }
 
-      li->background = true;
+      cur->background = true;
     }
     else {
-      if (li->background) {
-        free(word);
+      if (cur->background) {
         parse_error("No more commands allowed after a '&'\n");
         valret = -1;
         break;
       }
-      if (curr_n_cmd == MAX_CMDS) {
-        free(word);
-        parse_error("Too much commands. Max: %i\n", MAX_CMDS);
-        valret = -1;
-        break;
-      }
-      if (curr_n_arg == MAX_ARGS) {
-        free(word);
-        parse_error("Too much arguments. Max: %i\n", MAX_ARGS);
+      if (!tok.valid){
+        parse_error("Argument \"%s\" is not valid\n", tok.word);
         valret = -1;
         break;
       }
 
-      if (!valid_cmdarg_filename(word)){
-        parse_error("Argument \"%s\" is not valid\n", word);
-        free(word);
+      if (!line_grow_argv(cur, argv_len + 1)) {
         valret = -1;
         break;
       }
-
-      li->cmds[curr_n_cmd].args[curr_n_arg] = word;
+      // the variables and the patterns are expanded before the command is executed
+      unsigned char flags = line_word_flags(&tok);
+      cur->arg_flags[argv_len] = flags;
+      cur->n_globs += (flags & LINE_ARG_GLOB) != 0;
+      cur->n_vars += (flags & LINE_ARG_VARS) != 0;
+      cur->argv[argv_len++] = tok.word;
       ++curr_n_arg;
     }
   } //end of the loop for
 
-  if (!valret && curr_n_arg == 0) {
-    if (curr_n_cmd > 0){
-      parse_error("An empty command detected\n");
+  if (!valret && prev != NULL && curr_n_cmd == 0 && curr_n_arg == 0 && !cur->file_input && !cur->file_output) {
+    if (cur->connector != LINE_SEQ) {
+      parse_error("Waiting for a command after '%s'\n", connector_name(cur->connector));
       valret = -1;
     }
-    // in a real shell, "< fic" is equivalent to "test -r fic"
-    else if (li->file_input){
-      parse_error("Missing first command\n");
-      valret = -1;
-    }
-    // in a real shell, "> fic" :
-    // - creates the regular file "fic" if it does not exist,
-    // - and truncates it if it already exists
-    // in a real shell, ">> fic" :
-    // - creates the regular file "fic" if it does not exist,
-    // - and doesn't truncate it if it already exists
-    else if (li->file_output){
-      parse_error("Missing last command\n");
-      valret = -1;
+    else { // a final ';' ends the last pipeline
+      cur->connector = LINE_NONE;
+      prev->next = NULL;
+      cur->next = li->spare;
+      li->spare = cur;
+      return 0;
     }
   }
 
-  if (curr_n_arg != 0) {
-    li->cmds[curr_n_cmd].n_args = curr_n_arg;
-    ++curr_n_cmd;
+  if (line_end_pipeline(cur, curr_n_cmd, curr_n_arg, argv_len, !valret)) {
+    valret = -1;
   }
-  li->n_cmds = curr_n_cmd;
   return valret;
 }
 
+/*!
+ * \fn static void line_clear_pipeline(struct line *li)
+ * \brief Empty one pipeline, keeping its arrays.
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ */
+static void line_clear_pipeline(struct line *li) {
+  li->n_cmds = 0;
+  li->n_globs = 0;
+  li->n_vars = 0;
+  li->file_input = NULL;
+  li->file_input_flags = 0;
+  li->file_output_flags = 0;
+  li->file_output = NULL;
+  li->file_output_append = false;
+  li->background = false;
+  li->connector = LINE_NONE;
+}
+
+void line_clear(struct line *li) {
+  assert(li);
+
+  // The arguments and filenames point into the buffer: nothing to free one by one,
+  // and the arrays are kept for the next line
+  line_clear_pipeline(li);
+  while (li->next != NULL) {
+    struct line *pipeline = li->next;
+    li->next = pipeline->next;
+    line_clear_pipeline(pipeline);
+    pipeline->next = li->spare;
+    li->spare = pipeline;
+  }
+}
+
 void line_reset(struct line *li) {
   assert(li);
 
-  for (size_t i = 0; i < li->n_cmds; ++i) {
-    for (size_t j = 0; j < li->cmds[i].n_args; ++j) {
-      free(li->cmds[i].args[j]);
-      li->cmds[i].args[j] = NULL; // useless here because of the call of memset()
+  struct line *lists[2] = { li->next, li->spare };
+  for (size_t i = 0; i < 2; ++i) {
+    while (lists[i] != NULL) {
+      struct line *pipeline = lists[i];
+      lists[i] = pipeline->next;
+      free(pipeline->cmds);
+      free(pipeline->argv);
+      free(pipeline->arg_flags);
+      free(pipeline);
     }
   }
+  free(li->cmds);
+  free(li->argv);
+  free(li->arg_flags);
+  free(li->buffer);
+  memset(li, 0, sizeof(struct line));
+}
+
+
+/*!
+ * \def LINE_CACHE_SIZE
+ * \brief Maximal number of lines kept by the parse cache.
+ */
+#define LINE_CACHE_SIZE 64
+
+/*!
+ * \def LINE_CACHE_BUCKETS
+ * \brief Number of buckets of the hash index of the parse cache (a power of two).
+ */
+#define LINE_CACHE_BUCKETS 128
 
-  if (li->file_input) {
-    free(li->file_input);
-    li->file_input = NULL; // useless here because of the call of memset()
+/*!
+ * \def LINE_CACHE_MAX_LEN
+ * \brief Lines longer than this are parsed without being cached.
+ */
+#define LINE_CACHE_MAX_LEN 4096
+
+/*!
+ * \def LINE_CACHE_NONE
+ * \brief Index of no entry, for the links of the parse cache.
+ */
+#define LINE_CACHE_NONE (-1)
+
+/*!
+ * \struct line_cache_entry
+ * \brief A line of the parse cache: its text and its parsed list, never modified until it is evicted.
+ */
+struct line_cache_entry {
+  /*! \brief The hash of the text. */
+  uint64_t hash;
+  /*! \brief The text of the line, as given to line_parse_cached() (NULL if the entry is free). */
+  char *text;
+  /*! \brief The length of the text. */
+  size_t len;
+  /*! \brief The parsed command list, whose words point into its own buffer. */
+  struct line li;
+  /*! \brief The number of parses answered by this entry. */
+  size_t hits;
+  /*! \brief Next entry in the same bucket. */
+  int bucket_next;
+  /*! \brief More recently used entry. */
+  int lru_prev;
+  /*! \brief Less recently used entry. */
+  int lru_next;
+};
+
+/*!
+ * \struct line_cache
+ * \brief The parse cache: a hash index over a fixed number of entries, ordered from the most recently used.
+ */
+static struct line_cache {
+  /*! \brief The entries. */
+  struct line_cache_entry entries[LINE_CACHE_SIZE];
+  /*! \brief First entry of every bucket. */
+  int buckets[LINE_CACHE_BUCKETS];
+  /*! \brief Most recently used entry. */
+  int lru_head;
+  /*! \brief Least recently used entry, evicted when the cache is full. */
+  int lru_tail;
+  /*! \brief Number of used entries. */
+  size_t count;
+  /*! \brief Parses answered by the cache. */
+  size_t hits;
+  /*! \brief Parses done by line_parse(). */
+  size_t misses;
+  /*! \brief Entries dropped to make room for a new line. */
+  size_t evictions;
+  /*! \brief false until the links are initialized. */
+  bool ready;
+} cache;
+
+static uint64_t fnv1a(const char *str, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char) str[i];
+    h *= 1099511628211ULL;
   }
+  return h;
+}
 
-  if (li->file_output) {
-    free(li->file_output);
-    li->file_output = NULL; // useless here because of the call of memset()
+/*!
+ * \fn static int line_clone(struct line *dst, const struct line *src, size_t len)
+ * \brief Copy the command list "src" into the empty command list "dst".
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The buffer of "src" (the "len" bytes of the line, with its words '\0'-terminated) is copied in the buffer
+ * of "dst", and the pointers of the arrays are moved from one buffer to the other: no word is tokenized
+ * nor checked again. The arrays and pipelines of "dst" are reused, as by line_parse().
+ *
+ * \param dst pointer on the command list to fill, emptied by line_clear()
+ * \param src pointer on the command list to copy
+ * \param len length of the line parsed in "src"
+ * \return 0 on success, -1 if a memory allocation failure occurs
+ */
+static int line_clone(struct line *dst, const struct line *src, size_t len) {
+  const char *from = src->buffer;
+  char *to = line_copy(dst, from, len);
+  if (to == NULL) {
+    return -1;
   }
 
-  memset(li, 0, sizeof(struct line));
+  struct line *pl = dst;
+  for (const struct line *sp = src; sp != NULL; sp = sp->next) {
+    if (sp != src) {
+      struct line *next = line_new_pipeline(dst);
+      if (next == NULL) {
+        return -1;
+      }
+      pl->next = next;
+      pl = next;
+    }
+    size_t argv_len = 0;
+    if (sp->n_cmds > 0) {
+      const struct cmd *last = &sp->cmds[sp->n_cmds - 1];
+      argv_len = last->first_arg + last->n_args + 1;
+    }
+    if (!line_grow_argv(pl, argv_len)
+        || !line_grow((void **) &pl->cmds, &pl->cmds_size, sp->n_cmds, sizeof(struct cmd))) {
+      return -1;
+    }
+    for (size_t i = 0; i < argv_len; ++i) {
+      pl->argv[i] = sp->argv[i] ? to + (sp->argv[i] - from) : NULL;
+    }
+    if (argv_len > 0) {
+      memcpy(pl->arg_flags, sp->arg_flags, argv_len);
+    }
+    pl->n_globs = sp->n_globs;
+    pl->n_vars = sp->n_vars;
+    pl->file_input_flags = sp->file_input_flags;
+    pl->file_output_flags = sp->file_output_flags;
+    for (size_t i = 0; i < sp->n_cmds; ++i) {
+      pl->cmds[i].first_arg = sp->cmds[i].first_arg;
+      pl->cmds[i].n_args = sp->cmds[i].n_args;
+      pl->cmds[i].args = pl->argv + sp->cmds[i].first_arg;
+    }
+    pl->n_cmds = sp->n_cmds;
+    pl->file_input = sp->file_input ? to + (sp->file_input - from) : NULL;
+    pl->file_output = sp->file_output ? to + (sp->file_output - from) : NULL;
+    pl->file_output_append = sp->file_output_append;
+    pl->background = sp->background;
+    pl->connector = sp->connector;
+  }
+  return 0;
+}
+
+/*!
+ * \fn static void line_cache_unlink(int index)
+ * \brief Remove an entry from the LRU list.
+ */
+static void line_cache_unlink(int index) {
+  struct line_cache_entry *e = &cache.entries[index];
+  if (e->lru_prev != LINE_CACHE_NONE) {
+    cache.entries[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    cache.lru_head = e->lru_next;
+  }
+  if (e->lru_next != LINE_CACHE_NONE) {
+    cache.entries[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    cache.lru_tail = e->lru_prev;
+  }
+}
+
+/*!
+ * \fn static void line_cache_push_front(int index)
+ * \brief Insert an entry at the head of the LRU list (most recently used).
+ */
+static void line_cache_push_front(int index) {
+  struct line_cache_entry *e = &cache.entries[index];
+  e->lru_prev = LINE_CACHE_NONE;
+  e->lru_next = cache.lru_head;
+  if (cache.lru_head != LINE_CACHE_NONE) {
+    cache.entries[cache.lru_head].lru_prev = index;
+  } else {
+    cache.lru_tail = index;
+  }
+  cache.lru_head = index;
+}
+
+/*!
+ * \fn static void line_cache_evict(int index)
+ * \brief Remove an entry from its bucket and from the LRU list, and free its text.
+ *
+ * The parsed list of the entry is only reset: its arrays are reused by the next line stored in the entry.
+ */
+static void line_cache_evict(int index) {
+  struct line_cache_entry *e = &cache.entries[index];
+  int *link = &cache.buckets[e->hash & (LINE_CACHE_BUCKETS - 1)];
+  while (*link != index) {
+    link = &cache.entries[*link].bucket_next;
+  }
+  *link = e->bucket_next;
+  line_cache_unlink(index);
+  line_clear(&e->li);
+  free(e->text);
+  e->text = NULL;
+  --cache.count;
+}
+
+static void line_cache_init() {
+  for (size_t i = 0; i < LINE_CACHE_BUCKETS; ++i) {
+    cache.buckets[i] = LINE_CACHE_NONE;
+  }
+  cache.lru_head = LINE_CACHE_NONE;
+  cache.lru_tail = LINE_CACHE_NONE;
+  cache.ready = true;
+}
+
+/*!
+ * \fn static void line_cache_insert(const struct line *li, const char *str, size_t len, uint64_t hash)
+ * \brief Store a copy of the command list "li", parsed from "str", evicting the least recently used line if needed.
+ *
+ * A memory allocation failure only prevents the line from being cached.
+ */
+static void line_cache_insert(const struct line *li, const char *str, size_t len, uint64_t hash) {
+  int index = LINE_CACHE_NONE;
+  if (cache.count < LINE_CACHE_SIZE) {
+    for (int i = 0; i < LINE_CACHE_SIZE; ++i) {
+      if (cache.entries[i].text == NULL) {
+        index = i;
+        break;
+      }
+    }
+  } else {
+    index = cache.lru_tail;
+    line_cache_evict(index);
+    ++cache.evictions;
+  }
+
+  struct line_cache_entry *e = &cache.entries[index];
+  e->text = malloc(len + 1);
+  if (e->text == NULL || line_clone(&e->li, li, len)) {
+    free(e->text);
+    e->text = NULL;
+    line_clear(&e->li);
+    return;
+  }
+  memcpy(e->text, str, len + 1);
+  e->hash = hash;
+  e->len = len;
+  e->hits = 0;
+  int *bucket = &cache.buckets[hash & (LINE_CACHE_BUCKETS - 1)];
+  e->bucket_next = *bucket;
+  *bucket = index;
+  line_cache_push_front(index);
+  ++cache.count;
+}
+
+
+int line_parse_cached(struct line *li, const char *str) {
+  assert(li);
+  assert(str);
+
+  size_t len = strlen(str);
+  if (len > LINE_CACHE_MAX_LEN) {
+    return line_parse(li, str);
+  }
+  if (!cache.ready) {
+    line_cache_init();
+  }
+
+  uint64_t hash = fnv1a(str, len);
+  for (int i = cache.buckets[hash & (LINE_CACHE_BUCKETS - 1)]; i != LINE_CACHE_NONE; i = cache.entries[i].bucket_next) {
+    struct line_cache_entry *e = &cache.entries[i];
+    if (e->hash == hash && e->len == len && memcmp(e->text, str, len) == 0) {
+      if (line_clone(li, &e->li, len)) {
+        line_clear(li);
+        return line_parse(li, str);
+      }
+      ++e->hits;
+      ++cache.hits;
+      if (cache.lru_head != i) {
+        line_cache_unlink(i);
+        line_cache_push_front(i);
+      }
+      return 0;
+    }
+  }
+
+  ++cache.misses;
+  int err = line_parse(li, str);
+  if (!err) {
+    line_cache_insert(li, str, len, hash);
+  }
+  return err;
+}
+
+void line_cache_clear() {
+  while (cache.ready && cache.lru_head != LINE_CACHE_NONE) {
+    int index = cache.lru_head;
+    line_cache_evict(index);
+    line_reset(&cache.entries[index].li);
+  }
+}
+
+void line_cache_print(FILE *out) {
+  fprintf(out, "Parse cache: %zu/%d lines, %zu hits, %zu misses, %zu evictions\n",
+          cache.count, LINE_CACHE_SIZE, cache.hits, cache.misses, cache.evictions);
 }
@@ -11,18 +11,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
-
-/*!
- * \def MAX_ARGS
- * \brief The maximum of arguments for a single command.
- */
-#define MAX_ARGS 16
-
-/*!
- * \def MAX_CMDS
- * \brief The maximum of commands for a single command line.
- */
-#define MAX_CMDS 16
+#include <stdio.h>
 
 /*!
  * \struct cmd
@@ -30,36 +19,81 @@
  *
  * This structure holds the arguments of a single command. The arguments are stored as an array of
  * strings, with the last element being NULL. The number of arguments is stored in the "n_args" field.
+ * The array is a slice of the "argv" array of the struct line: there is no limit on the number of arguments.
  */
 struct cmd {
     /*!
      * \var args
-     * \brief Array of arguments for the command.
+     * \brief Array of arguments for the command, NULL terminated (points into the "argv" field of the line).
      */
-    char *args[MAX_ARGS + 1];
+    char **args;
     /*!
      * \var n_args
      * \brief Number of arguments for the command.
      */
     size_t n_args;
+    /*!
+     * \var first_arg
+     * \brief Offset of the first argument of the command in the "argv" field of the line.
+     */
+    size_t first_arg;
+};
+
+
+/*!
+ * \enum line_connector
+ * \brief How a pipeline of a command list is joined to the previous one.
+ */
+enum line_connector {
+    LINE_NONE, /*!< the first pipeline of the list */
+    LINE_SEQ,  /*!< ";": always executed */
+    LINE_AND,  /*!< "&&": executed if the previous pipeline succeeded */
+    LINE_OR,   /*!< "||": executed if the previous pipeline failed */
 };
 
 
+/*!
+ * \def LINE_ARG_GLOB
+ * \brief Flag of an unquoted argument containing '*', '?' or '[': a pattern expanded to the matching
+ * filenames before the command is executed (see glob.h). A quoted argument is never expanded.
+ */
+#define LINE_ARG_GLOB 1
+
+/*!
+ * \def LINE_ARG_VARS
+ * \brief Flag of an unquoted or double-quoted argument or filename containing a '$': its variables are
+ * replaced by their values before the command is executed (see vars.h).
+ */
+#define LINE_ARG_VARS 2
+
+/*!
+ * \def LINE_ARG_ASSIGN
+ * \brief Flag of an unquoted "NAME=value" argument. In front of a command, it sets the variable in the
+ * environment of the command only (see vars.h). It is never expanded as a pattern.
+ */
+#define LINE_ARG_ASSIGN 4
+
 /*!
  * \struct line
  * \brief Structure representing a command line with multiple commands and redirections.
  *
  * This structure holds the commands and redirections of a single command line. The commands are stored
- * as an array of "cmd" structures, with the last element being NULL. The number of commands is stored
- * in the "n_cmds" field. The structure also holds the filenames for input and output redirections, as
+ * as an array of "cmd" structures. The number of commands is stored in the "n_cmds" field.
+ * The arguments of all the commands are stored in a single flat array "argv", each command being followed
+ * by a NULL. The structure also holds the filenames for input and output redirections, as
  * well as a flag for background execution.
+ *
+ * A command list is a chain of pipelines linked by the "next" field: the struct line given to line_parse()
+ * is the first one, and owns the buffer holding the words of every pipeline of the list.
+ *
+ * The arrays grow as needed while parsing and are kept by line_clear(), so they are reused by the next lines.
  */
 struct line {
     /*!
      * \var cmds
      * \brief Array of commands in the command line.
      */
-    struct cmd cmds[MAX_CMDS];
+    struct cmd *cmds;
     /*!
      * \var n_cmds
      * \brief Number of commands in the command line.
@@ -85,6 +119,71 @@ struct line {
      * \brief Flag indicating background execution.
      */
     bool background;
+    /*!
+     * \var cmds_size
+     * \brief Allocated number of elements of "cmds".
+     */
+    size_t cmds_size;
+    /*!
+     * \var argv
+     * \brief Arguments of all the commands, each command being terminated by a NULL.
+     */
+    char **argv;
+    /*!
+     * \var argv_size
+     * \brief Allocated number of elements of "argv".
+     */
+    size_t argv_size;
+    /*!
+     * \var arg_flags
+     * \brief Flags of the elements of "argv" (LINE_ARG_GLOB...), at the same indexes. Allocated with "argv".
+     */
+    unsigned char *arg_flags;
+    /*!
+     * \var n_globs
+     * \brief Number of arguments of the pipeline flagged LINE_ARG_GLOB.
+     */
+    size_t n_globs;
+    /*!
+     * \var n_vars
+     * \brief Number of arguments and filenames of the pipeline flagged LINE_ARG_VARS.
+     */
+    size_t n_vars;
+    /*!
+     * \var file_input_flags
+     * \brief Flags of "file_input" (LINE_ARG_VARS or 0).
+     */
+    unsigned char file_input_flags;
+    /*!
+     * \var file_output_flags
+     * \brief Flags of "file_output" (LINE_ARG_VARS or 0).
+     */
+    unsigned char file_output_flags;
+    /*!
+     * \var buffer
+     * \brief Copy of the parsed string. The arguments and the filenames point into it.
+     */
+    char *buffer;
+    /*!
+     * \var buffer_size
+     * \brief Allocated size of the buffer, kept between two lines.
+     */
+    size_t buffer_size;
+    /*!
+     * \var connector
+     * \brief How this pipeline is joined to the previous one of the list (LINE_NONE for the first one).
+     */
+    enum line_connector connector;
+    /*!
+     * \var next
+     * \brief Next pipeline of the command list, NULL for the last one.
+     */
+    struct line *next;
+    /*!
+     * \var spare
+     * \brief Pipelines released by line_clear(), reused by the next lists (only used in the first pipeline).
+     */
+    struct line *spare;
 };
 
 /*!
@@ -106,24 +205,70 @@ void line_init(struct line *li);
  * and ">>", input redirection "<", and background execution "&". Proper parsing updates the
  * structure "li" with commands, their arguments, and redirection or background information.
  *
+ * The line is a command list: pipelines separated by ";", "&&" or "||". "li" holds the first pipeline,
+ * and the next ones are chained by li->next, with their connector. A final ";" is allowed.
+ * A '&' is only allowed at the end of the last pipeline.
+ *
  * The parsing process checks for various syntax errors like missing filenames after redirections,
- * invalid command or argument formats, improper use of pipes or redirections, and excess in the
- * number of commands or arguments as specified by MAX_CMDS and MAX_ARGS constants.
+ * invalid command or argument formats, and improper use of pipes or redirections.
+ * The number of commands and arguments is only limited by the memory.
  *
  * \param li Pointer to the struct line where the parsed command line will be stored.
- * \param str Null-terminated string containing the command line to be parsed.
+ * \param str Null-terminated string containing the command line to be parsed. It may end with a '\n',
+ *            its length is not limited.
  * \return Returns 0 on successful parsing with a properly formed command line. <br>
  *         Returns -1 on failure, indicating a syntax error or invalid command line structure.
  *
- * \note This function uses dynamic memory allocation for storing individual arguments and filenames.
- *       It is the caller's responsibility to free these resources when no longer needed.
+ * \note The string is copied once in a buffer owned by "li", and the words are '\0'-terminated in place:
+ *       the arguments and filenames point into this buffer, no memory is allocated per word.
+ *       They stay valid until the next call of line_parse(), line_clear() or line_reset() on "li".
  */
 int line_parse(struct line *li, const char *str);
 
+/*!
+ * \fn int line_parse_cached(struct line *li, const char *str)
+ * \brief Same as line_parse(), answered by a cache of the recently parsed lines when possible.
+ *
+ * The cache keeps the parsed command lists of the last 64 valid lines, keyed by a hash of their text,
+ * and evicts the least recently used one. On a hit, the cached list is copied into "li" without
+ * tokenizing nor checking the line again. Invalid lines are never cached, so their error
+ * is printed every time.
+ *
+ * \param li Pointer to the struct line where the parsed command line will be stored, emptied by line_clear().
+ * \param str Null-terminated string containing the command line to be parsed.
+ * \return 0 on success, -1 on a syntax error (see line_parse()).
+ */
+int line_parse_cached(struct line *li, const char *str);
+
+/*!
+ * \fn void line_cache_clear()
+ * \brief Free the lines kept by the parse cache. The hit/miss counters are kept.
+ */
+void line_cache_clear();
+
+/*!
+ * \fn void line_cache_print(FILE *out)
+ * \brief Print the number of lines kept by the parse cache and its hit/miss counters.
+ *
+ * \param out The stream to print to.
+ */
+void line_cache_print(FILE *out);
+
+/*!
+ * Clear a struct line
+ * 
+ * The line is emptied, but the buffer holding the words, the pipelines of the list and their arrays
+ * of commands and arguments are kept to parse the next line without allocating: the cost does not depend on the
+ * number of words of the line. line_reset() frees them once the struct line is no longer used.
+ * 
+ * @param li pointer on the struct line to be cleared
+ */
+void line_clear(struct line *li);
+
 /*!
  * Reset a struct line
  * 
- * Free dynamically allocated memory
+ * Free the buffer holding the words, the pipelines of the list and their arrays of commands and arguments
  * All bytes occupied by the structure are set to 0
  * 
  * @param li pointer on the struct line to be reset
@@ -1,7 +1,14 @@
 #include "cmdline.h"
+#include "glob.h"
+#include "vars.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define OK 0
 #define KO 1
@@ -45,6 +52,387 @@ static void try(const char *str, int expected) {
   line_reset(&li);
 }
 
+/*!
+ * Tell if two parsed command lists have the same pipelines, words and redirections
+ *
+ * @param a first command list
+ * @param b second command list
+ * @return 1 if they are the same, 0 otherwise
+ */
+static int same_line(const struct line *a, const struct line *b) {
+  for (; a && b; a = a->next, b = b->next) {
+    if (a->n_cmds != b->n_cmds || a->n_globs != b->n_globs || a->n_vars != b->n_vars || a->background != b->background || a->connector != b->connector
+        || a->file_output_append != b->file_output_append
+        || (!a->file_input != !b->file_input) || (a->file_input && strcmp(a->file_input, b->file_input))
+        || (!a->file_output != !b->file_output) || (a->file_output && strcmp(a->file_output, b->file_output))) {
+      return 0;
+    }
+    for (size_t i = 0; i < a->n_cmds; ++i) {
+      if (a->cmds[i].n_args != b->cmds[i].n_args || b->cmds[i].args[b->cmds[i].n_args] != NULL) {
+        return 0;
+      }
+      for (size_t j = 0; j < a->cmds[i].n_args; ++j) {
+        if (strcmp(a->cmds[i].args[j], b->cmds[i].args[j])
+            || a->arg_flags[a->cmds[i].first_arg + j] != b->arg_flags[b->cmds[i].first_arg + j]) {
+          return 0;
+        }
+      }
+    }
+  }
+  return a == b;
+}
+
+/*!
+ * Test the parse cache with a valid command line "str"
+ *
+ * The line is parsed by line_parse(), then twice by line_parse_cached() (a miss, then a hit, unless
+ * the line is already cached): the three command lists must be the same.
+ *
+ * @param str valid command line to test
+ */
+static void try_cached(const char *str) {
+  static int n = 0;
+  static struct line ref, li;
+
+  if (n == 0){
+    line_init(&ref);
+    line_init(&li);
+  }
+
+  printf("CACHE TEST #%i\n", ++n);
+  int ok = line_parse(&ref, str) == 0;
+  for (int i = 0; ok && i < 2; ++i) {
+    ok = line_parse_cached(&li, str) == 0 && same_line(&ref, &li);
+    line_clear(&li);
+  }
+  if (ok) {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  } else {
+    printf("%sUNEXPECTED RETURN WITH: %s%s\n", RED, str, NC);
+  }
+  line_reset(&ref);
+}
+
+
+/*!
+ * Write a command list as text, to compare it with the expected words
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * Every word is written between brackets. If "flags" is not 0, it is followed by '*' if it is a pattern
+ * (LINE_ARG_GLOB), '$' if it holds variables (LINE_ARG_VARS) and '=' if it is an assignment (LINE_ARG_ASSIGN).
+ *
+ * @param li command list
+ * @param flags 0 to leave out the flags (the arguments do not match "arg_flags" anymore after an expansion)
+ * @param out buffer of "size" bytes
+ * @param size size of "out"
+ */
+static void line_render(const struct line *li, int flags, char *out, size_t size) {
+  static const char *connectors[] = { "", " ; ", " && ", " || " };
+  size_t len = 0;
+  out[0] = '\0';
+#define RENDER(...) len += (size_t) snprintf(out + len, len < size ? size - len : 0, __VA_ARGS__)
+#define RENDER_FLAGS(f) RENDER("%s%s%s", (flags && ((f) & LINE_ARG_GLOB)) ? "*" : "", \
+                               (flags && ((f) & LINE_ARG_VARS)) ? "$" : "", (flags && ((f) & LINE_ARG_ASSIGN)) ? "=" : "")
+  for (; li; li = li->next) {
+    RENDER("%s", connectors[li->connector]);
+    for (size_t i = 0; i < li->n_cmds; ++i) {
+      for (size_t j = 0; j < li->cmds[i].n_args; ++j) {
+        RENDER("%s[%s]", i == 0 && j == 0 ? "" : j == 0 ? " | " : " ", li->cmds[i].args[j]);
+        RENDER_FLAGS(li->arg_flags[li->cmds[i].first_arg + j]);
+      }
+    }
+    if (li->file_input) {
+      RENDER(" < [%s]", li->file_input);
+      RENDER_FLAGS(li->file_input_flags);
+    }
+    if (li->file_output) {
+      RENDER(" %s [%s]", li->file_output_append ? ">>" : ">", li->file_output);
+      RENDER_FLAGS(li->file_output_flags);
+    }
+    if (li->background) {
+      RENDER(" &");
+    }
+  }
+#undef RENDER_FLAGS
+#undef RENDER
+}
+
+/*!
+ * Test the words of a valid command line "str"
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The same line is used for every call and only cleared by line_clear() between two calls, so the words
+ * of a line must not be altered by the words of the previous one. The arguments, redirections and
+ * connectors of the line must be "words" (see line_render()).
+ *
+ * @param str valid command line to test
+ * @param words expected words of the line, without their flags
+ */
+static void try_words(const char *str, const char *words) {
+  static int n = 0;
+  static struct line li;
+  char text[1024];
+
+  if (n == 0){
+    line_init(&li);
+  }
+
+  printf("WORDS TEST #%i\n", ++n);
+  int ok = line_parse(&li, str) == 0;
+  if (ok) {
+    line_render(&li, 0, text, sizeof(text));
+    ok = strcmp(text, words) == 0;
+  } else {
+    strcpy(text, "(parse error)");
+  }
+  if (ok) {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  } else {
+    printf("%sUNEXPECTED WORDS WITH: %s%s%s\n", RED, str, text, NC);
+  }
+  line_clear(&li);
+}
+
+/*!
+ * Test the expansion of the patterns of a valid command line "str"
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The words of the line and their flags must be "words" (see line_render()), the words after glob_line()
+ * must be "expanded", and glob_release() must give the line its words back.
+ *
+ * @param str valid command line to test
+ * @param words expected words and flags of the line
+ * @param expanded expected words of the line once expanded
+ */
+static void try_glob(const char *str, const char *words, const char *expanded) {
+  static int n = 0;
+  struct line li;
+  struct glob_state gs;
+  char text[1024];
+
+  printf("GLOB TEST #%i\n", ++n);
+  line_init(&li);
+  glob_init(&gs);
+  int ok = line_parse(&li, str) == 0;
+  if (ok) {
+    line_render(&li, 1, text, sizeof(text));
+    ok = strcmp(text, words) == 0;
+  }
+  if (ok) {
+    glob_line(&gs, &li);
+    line_render(&li, 0, text, sizeof(text));
+    ok = strcmp(text, expanded) == 0;
+    glob_release(&gs, &li);
+  }
+  if (ok) {
+    line_render(&li, 1, text, sizeof(text));
+    ok = strcmp(text, words) == 0;
+  }
+  if (ok) {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  } else {
+    printf("%sUNEXPECTED WORDS WITH: %s%s%s\n", RED, str, text, NC);
+  }
+  line_reset(&li);
+}
+
+/*!
+ * Files and directories of the glob tests, created in a temporary directory (directories end with '/')
+ */
+static const char *glob_tree[] = {
+  "a.log", "b.log", "c.txt", ".hidden.log", "ab.c", "dir/", "dir/x.c", "dir/deep/", "dir/deep/y.c",
+  "dir/.hide/", "dir/.hide/z.c", "empty/",
+};
+
+/*!
+ * Test the expansion of the patterns in a temporary directory
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ */
+static void try_globs() {
+  char dir[] = "/tmp/cmdline_test.XXXXXX";
+  char cwd[4096];
+  size_t n = sizeof(glob_tree) / sizeof(glob_tree[0]);
+  if (mkdtemp(dir) == NULL || getcwd(cwd, sizeof(cwd)) == NULL || chdir(dir) == -1) {
+    perror("glob tests");
+    return;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    size_t len = strlen(glob_tree[i]);
+    if (glob_tree[i][len - 1] == '/') {
+      mkdir(glob_tree[i], 0755);
+    } else {
+      close(open(glob_tree[i], O_WRONLY | O_CREAT, 0644));
+    }
+  }
+
+  try_glob("gzip *.log \"a*\" 'b?' [ab]?.c\n", "[gzip] [*.log]* [a*] [b?] [[ab]?.c]*",
+           "[gzip] [a.log] [b.log] [a*] [b?] [ab.c]");
+  try_glob("ls [!a]*.log [a-b].log ?.txt\n", "[ls] [[!a]*.log]* [[a-b].log]* [?.txt]*",
+           "[ls] [b.log] [a.log] [b.log] [c.txt]");
+  try_glob("ls [^ab]* | wc\n", "[ls] [[^ab]*]* | [wc]", "[ls] [c.txt] [dir] [empty] | [wc]");
+  try_glob("ls .*.log *.none\n", "[ls] [.*.log]* [*.none]*", "[ls] [.hidden.log] [*.none]");
+  try_glob("ls **/*.c dir/**\n", "[ls] [**/*.c]* [dir/**]*",
+           "[ls] [ab.c] [dir/deep/y.c] [dir/x.c] [dir/deep] [dir/deep/y.c] [dir/x.c]");
+  try_glob("ls */ d*/*/\n", "[ls] [*/]* [d*/*/]*", "[ls] [dir/] [empty/] [dir/deep/]");
+  try_glob("cat < *.log > *.txt\n", "[cat] < [*.log] > [*.txt]", "[cat] < [*.log] > [*.txt]");
+
+  for (size_t i = n; i-- > 0;) {
+    if (glob_tree[i][strlen(glob_tree[i]) - 1] == '/') {
+      rmdir(glob_tree[i]);
+    } else {
+      unlink(glob_tree[i]);
+    }
+  }
+  if (chdir(cwd) == -1 || rmdir(dir) == -1) {
+    perror("glob tests");
+  }
+}
+
+/*!
+ * Test the expansion of the variables of a valid command line "str"
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The words after vars_expand_line() must be "expanded" (see line_render()), and vars_restore_line()
+ * must give the line its words and flags back.
+ *
+ * @param str valid command line to test
+ * @param status value of "$?"
+ * @param expanded expected words of the line once expanded
+ */
+static void try_vars(const char *str, int status, const char *expanded) {
+  static int n = 0;
+  struct line li;
+  char words[1024], text[1024];
+
+  printf("VARS TEST #%i\n", ++n);
+  line_init(&li);
+  int ok = line_parse(&li, str) == 0;
+  if (ok) {
+    line_render(&li, 1, words, sizeof(words));
+    vars_expand_line(&li, status);
+    line_render(&li, 0, text, sizeof(text));
+    ok = strcmp(text, expanded) == 0;
+    vars_restore_line();
+  }
+  if (ok) {
+    line_render(&li, 1, text, sizeof(text));
+    ok = strcmp(text, words) == 0;
+  }
+  if (ok) {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  } else {
+    printf("%sUNEXPECTED WORDS WITH: %s%s%s\n", RED, str, text, NC);
+  }
+  line_reset(&li);
+}
+
+/*!
+ * Tell if the envp array "envp" holds the string "entry" exactly "count" times, and no other
+ * variable of the same name
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ */
+static int envp_holds(char **envp, const char *entry, int count) {
+  size_t len = strcspn(entry, "=") + 1;
+  int found = 0;
+  for (; *envp; ++envp) {
+    if (strncmp(*envp, entry, len) == 0) {
+      if (strcmp(*envp, entry) != 0) {
+        return 0;
+      }
+      ++found;
+    }
+  }
+  return found == count;
+}
+
+/*!
+ * Find the next name "TEST_W<n>" whose hash (FNV-1a, as in vars.c) ends with the 13 bits of "low"
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * In a table of at most 8192 slots, the home slot of such a name is the last one if "low" is 8191,
+ * and the first one if "low" is 0.
+ */
+static void wrap_name(char *name, int *n, uint64_t low) {
+  for (;;) {
+    sprintf(name, "TEST_W%d", (*n)++);
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = name; *c; ++c) {
+      hash ^= (unsigned char) *c;
+      hash *= 1099511628211ULL;
+    }
+    if ((hash & 8191) == low) {
+      return;
+    }
+  }
+}
+
+/*!
+ * Test the table of the variables: set, unset (backward shift) and the envp arrays
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * A cluster of variables starting in the last slot goes on at the start of the table: unsetting them
+ * one by one must shift the others back across the end of the table. Then a thousand variables are
+ * unset in a scrambled order. Every variable must still be found, or not, after each unset.
+ */
+static void try_vars_table() {
+  char wrap[6][16];
+  int next = 0;
+  for (int i = 0; i < 6; ++i) { // homes: last, last, first, last, first, last
+    wrap_name(wrap[i], &next, (i == 2 || i == 4) ? 0 : 8191);
+    vars_set(wrap[i], strlen(wrap[i]), wrap[i], false);
+  }
+  printf("VARS TEST wrap\n");
+  int ok = 1;
+  for (int k = 0; k < 6; ++k) {
+    vars_unset(wrap[k], strlen(wrap[k]));
+    for (int i = 0; i < 6; ++i) {
+      const char *got = vars_get(wrap[i], strlen(wrap[i]));
+      ok &= i <= k ? got == NULL : got != NULL && strcmp(got, wrap[i]) == 0;
+    }
+  }
+  printf("%s%s%s\n", ok ? GREEN : RED, ok ? "TEST OK!" : "UNEXPECTED VARIABLES AFTER AN UNSET", NC);
+
+  enum { N = 1000, STEP = 373 };
+  static char gone[N];
+  char name[16], value[16];
+
+  printf("VARS TEST table\n");
+  ok = 1;
+  for (int i = 0; i < N; ++i) {
+    sprintf(name, "TEST_V%d", i);
+    sprintf(value, "%d", i);
+    ok &= vars_set(name, strlen(name), value, i % 2 == 0) == 0;
+  }
+  for (int k = 0; ok && k < N; ++k) {
+    int removed = (int) (((long) k * STEP) % N); // STEP is prime with N: every variable once
+    sprintf(name, "TEST_V%d", removed);
+    vars_unset(name, strlen(name));
+    gone[removed] = 1;
+    for (int i = 0; ok && i < N; ++i) {
+      sprintf(name, "TEST_V%d", i);
+      sprintf(value, "%d", i);
+      const char *got = vars_get(name, strlen(name));
+      ok = gone[i] ? got == NULL : got != NULL && strcmp(got, value) == 0;
+    }
+  }
+  ok = ok && vars_set("1BAD", 4, "x", false) == -1 && vars_get("TEST_V0", 7) == NULL;
+  printf("%s%s%s\n", ok ? GREEN : RED, ok ? "TEST OK!" : "UNEXPECTED VARIABLES AFTER AN UNSET", NC);
+
+  printf("VARS TEST envp\n");
+  vars_set("TEST_E", 6, "env", true);
+  vars_set("TEST_S", 6, "shell", false);
+  ok = envp_holds(vars_envp(), "TEST_E=env", 1) && envp_holds(vars_envp(), "TEST_S=shell", 0);
+  char *assignments[] = { "TEST_E=1", "TEST_O=x", "TEST_E=2", "TEST_S=3" };
+  char **envp = vars_envp_with(assignments, 4);
+  ok = ok && envp_holds(envp, "TEST_E=2", 1) && envp_holds(envp, "TEST_O=x", 1) && envp_holds(envp, "TEST_S=3", 1);
+  free(envp);
+  vars_unset("TEST_E", 6);
+  ok = ok && envp_holds(vars_envp(), "TEST_E=env", 0) && getenv("TEST_E") == NULL;
+  printf("%s%s%s\n", ok ? GREEN : RED, ok ? "TEST OK!" : "UNEXPECTED ENVIRONMENT", NC);
+}
+
 
 int main() {
 
@@ -134,6 +522,87 @@ int main() {
   try("> qux \n", KO);
   try(">> qux \n", KO);
   
+  // words are kept in the buffer of the line between two calls
+  try_words("bar \"baz qux\" | quux 'a b' > out\n", "[bar] [baz qux] | [quux] [a b] > [out]");
+  try_words("bar\n", "[bar]");
+  try_words("bar \"baz\"qux > out\n", "[bar] [baz] [qux] > [out]"); // a quoted word ends with its quote
+  try_words("< qux bar baz | quux >> out &\n", "[bar] [baz] | [quux] < [qux] >> [out] &");
+  try_words("bar\n", "[bar]");
+
+  // words longer than the vectors of the tokenizer
+  try_words("a_command_name_longer_than_thirty_two_bytes --an-option-longer-than-thirty-two-bytes | baz\n",
+            "[a_command_name_longer_than_thirty_two_bytes] [--an-option-longer-than-thirty-two-bytes] | [baz]");
+  try_words("bar\t\"a quoted argument longer than thirty two bytes\"\t>>\tqux\n",
+            "[bar] [a quoted argument longer than thirty two bytes] >> [qux]");
+  try_words("bar                                    baz\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\tqux\n",
+            "[bar] [baz] [qux]");
+  try_words("bar 'a quoted \"argument\" with ; and tabs\t\tinside, longer than 64 bytes' < in\n",
+            "[bar] [a quoted \"argument\" with ; and tabs\t\tinside, longer than 64 bytes] < [in]");
+  try("bar an_argument_longer_than_thirty_two_bytes_with_a_|_inside\n", KO);
+  try("bar \"a quoted | is not an operator\"\n", KO);
+  try("bar \"|\" baz\n", KO);
+
+  // no limit on the number of arguments and commands
+  char long_line[64 * 1024];
+  size_t len = 0;
+  len += sprintf(long_line + len, "rm");
+  for (int i = 0; i < 5000; ++i) {
+    len += sprintf(long_line + len, " f%d", i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    len += sprintf(long_line + len, " | cat");
+  }
+  sprintf(long_line + len, "\n");
+  try(long_line, OK);
+
+  // command lists
+  try_words("bar ; baz\n", "[bar] ; [baz]");
+  try_words("bar; baz;\n", "[bar] ; [baz]");
+  try_words("bar && baz || qux\n", "[bar] && [baz] || [qux]");
+  try_words("bar < qux | baz > out && quux &\n", "[bar] | [baz] < [qux] > [out] && [quux] &");
+  try_words("bar \"a;b\" ; baz\n", "[bar] [a;b] ; [baz]");
+  try_words("bar\n", "[bar]");
+  try_words("quux && quuz ; corge || grault\n", "[quux] && [quuz] ; [corge] || [grault]");
+  try(";\n", KO);
+  try("bar ; ; baz\n", KO);
+  try("bar &&\n", KO);
+  try("|| bar\n", KO);
+  try("bar & ; baz\n", KO);
+  try("bar | && baz\n", KO);
+  try("bar > ; baz\n", KO);
+
+  // parse cache
+  try_cached("bar\n");
+  try_cached("bar \"baz qux\" | quux 'a b' > out\n");
+  try_cached("< qux bar | baz >> out && quux & \n");
+  try_cached("bar ; baz || qux ; quux | corge\n");
+  try_cached("gzip *.log \"a*\" | grep 'b?' [ab]?.c ; rm **/*.o\n");
+  try_cached("CC=cc make \"$HOME\" '$PATH' ${X}/*.c > $OUT\n");
+  struct line evict;
+  line_init(&evict);
+  for (int i = 0; i < 100; ++i) { // evicts the first lines
+    char evict_line[32];
+    sprintf(evict_line, "bar %d ; baz\n", i);
+    line_parse_cached(&evict, evict_line);
+    line_clear(&evict);
+  }
+  line_reset(&evict);
+  try_cached("bar\n");
+  line_cache_print(stdout);
+  line_cache_clear();
+
+  // patterns
+  try_globs();
+
+  // variables
+  char pid_line[256];
+  vars_set("T", 1, "val", false);
+  sprintf(pid_line, "[echo] [val] [valx] [val y] [$T] [$] [a$] [3] [%d] [${T] [${1}] [] [CC=val] | [cat] > [val.out]",
+          (int) getpid());
+  try_vars("echo $T ${T}x \"$T y\" '$T' $ a$ $? $$ ${T ${1} $UNSET_VAR CC=$T | cat > $T.out\n", 3, pid_line);
+  try_vars("CC=cc make \"$T\" < ${T}.in\n", 0, "[CC=cc] [make] [val] < [val.in]");
+  try_vars_table();
+
 
   return 0;
 }
@@ -0,0 +1,471 @@
+/*!
+ * \file complete.c
+ * \brief Implementation of the completion of the words of a line.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "complete.h"
+
+#include "builtins.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ * \def INDEX_MAX_DIRS
+ * \brief Maximal number of PATH directories indexed (one bit each in struct exe).
+ */
+#define INDEX_MAX_DIRS 64
+
+/*!
+ * \def INDEX_EVENTS
+ * \brief The inotify events which may change the executables of a directory.
+ */
+#define INDEX_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*!
+ * \struct exe
+ * \brief An executable name of the index.
+ */
+struct exe {
+    /*! \brief The name. */
+    char *name;
+    /*! \brief The PATH directories containing it (bit i for the directory i). */
+    uint64_t dirs;
+};
+
+/*!
+ * \struct index
+ * \brief The executables of the PATH, sorted by name.
+ */
+static struct index {
+    /*! \brief The value of PATH the index was built with, NULL before the first build. */
+    char *path_env;
+    /*! \brief The indexed directories. */
+    char *dirs[INDEX_MAX_DIRS];
+    /*! \brief The inotify watch of each directory, -1 if it is not watched. */
+    int watches[INDEX_MAX_DIRS];
+    /*! \brief The modification time of each directory when it was scanned (zero if it did not exist). */
+    struct timespec mtimes[INDEX_MAX_DIRS];
+    /*! \brief The number of directories. */
+    size_t n_dirs;
+    /*! \brief The inotify instance, -1 if unavailable. */
+    int inotify;
+    /*! \brief The executables. */
+    struct exe *exes;
+    /*! \brief The number of executables. */
+    size_t count;
+    /*! \brief The allocated number of executables. */
+    size_t size;
+    /*! \brief The number of executables added or removed by inotify events. */
+    size_t updates;
+    /*! \brief The number of complete builds. */
+    size_t builds;
+} idx = {.inotify = -1};
+
+/*!
+ * \struct candidates
+ * \brief The result of the last completion.
+ */
+static struct candidates {
+    /*! \brief The candidates. */
+    const char **matches;
+    /*! \brief The number of candidates. */
+    size_t count;
+    /*! \brief The allocated number of candidates. */
+    size_t size;
+    /*! \brief The storage of the file names, released at the next completion. */
+    char **owned;
+    /*! \brief The number of owned strings. */
+    size_t n_owned;
+    /*! \brief The allocated number of owned strings. */
+    size_t owned_size;
+    /*! \brief The word typed, without its quote. */
+    char *word;
+} found;
+
+/*!
+ * \fn static void *grow(void *array, size_t *size, size_t needed, size_t elem_size)
+ * \brief Grow an array to hold at least needed elements (exits on failure).
+ */
+static void *grow(void *array, size_t *size, size_t needed, size_t elem_size) {
+    if(needed <= *size) return array;
+    size_t new_size = *size == 0 ? 64 : *size;
+    while(new_size < needed) new_size *= 2;
+    void *grown = realloc(array, new_size * elem_size);
+    if(grown == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+    *size = new_size;
+    return grown;
+}
+
+/*!
+ * \fn static size_t lower_bound(const char *name)
+ * \brief The index of the first executable not lower than name.
+ */
+static size_t lower_bound(const char *name) {
+    size_t lo = 0, hi = idx.count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(strcmp(idx.exes[mid].name, name) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*!
+ * \fn static bool executable_at(int dir_fd, const char *name)
+ * \brief Check that name is a regular file (or a link to one) the user is allowed to execute.
+ */
+static bool executable_at(int dir_fd, const char *name) {
+    struct stat st;
+    return fstatat(dir_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode) && faccessat(dir_fd, name, X_OK, 0) == 0;
+}
+
+/*!
+ * \fn static void index_set(const char *name, size_t dir, bool present)
+ * \brief Record that name is an executable of the directory dir, or is not any more.
+ */
+static void index_set(const char *name, size_t dir, bool present) {
+    size_t i = lower_bound(name);
+    bool known = i < idx.count && strcmp(idx.exes[i].name, name) == 0;
+    uint64_t bit = (uint64_t) 1 << dir;
+    if(present && !known) {
+        idx.exes = grow(idx.exes, &idx.size, idx.count + 1, sizeof(struct exe));
+        memmove(idx.exes + i + 1, idx.exes + i, (idx.count - i) * sizeof(struct exe));
+        idx.exes[i].name = strdup(name);
+        if(idx.exes[i].name == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+        idx.exes[i].dirs = bit;
+        idx.count++;
+        idx.updates++;
+    } else if(present) {
+        idx.exes[i].dirs |= bit;
+    } else if(known && (idx.exes[i].dirs &= ~bit) == 0) {
+        free(idx.exes[i].name);
+        memmove(idx.exes + i, idx.exes + i + 1, (idx.count - i - 1) * sizeof(struct exe));
+        idx.count--;
+        idx.updates++;
+    }
+}
+
+/*!
+ * \fn static struct timespec dir_mtime(const char *dir)
+ * \brief The modification time of a directory, zero if it cannot be read.
+ */
+static struct timespec dir_mtime(const char *dir) {
+    struct stat st;
+    return stat(dir, &st) == 0 ? st.st_mtim : (struct timespec) {0, 0};
+}
+
+/*!
+ * \fn static int compare_exe(const void *a, const void *b)
+ * \brief Compare two executables by name for qsort().
+ */
+static int compare_exe(const void *a, const void *b) {
+    return strcmp(((const struct exe *) a)->name, ((const struct exe *) b)->name);
+}
+
+void complete_clear() {
+    for(size_t i = 0; i < idx.count; ++i) free(idx.exes[i].name);
+    for(size_t d = 0; d < idx.n_dirs; ++d) free(idx.dirs[d]);
+    if(idx.inotify != -1) close(idx.inotify); // Removes the watches
+    free(idx.exes);
+    free(idx.path_env);
+    idx.exes = NULL;
+    idx.count = idx.size = idx.n_dirs = 0;
+    idx.path_env = NULL;
+    idx.inotify = -1;
+}
+
+/*!
+ * \fn static void index_build(const char *path_env)
+ * \brief Scan the directories of path_env and watch them.
+ *
+ * The relative entries ("." or an empty one) are skipped: they depend on the current directory.
+ */
+static void index_build(const char *path_env) {
+    complete_clear();
+    idx.builds++;
+    idx.path_env = strdup(path_env);
+    idx.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(idx.path_env == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+
+    const char *dir = path_env;
+    while(idx.n_dirs < INDEX_MAX_DIRS) {
+        const char *end = strchrnul(dir, ':');
+        if(dir[0] == '/') {
+            char *copy = strndup(dir, (size_t) (end - dir));
+            if(copy == NULL) { perror("strndup"); exit(EXIT_FAILURE); }
+            size_t d = idx.n_dirs++;
+            idx.dirs[d] = copy;
+            // Watched before the scan, so no executable created during it is missed
+            idx.watches[d] = idx.inotify == -1 ? -1 : inotify_add_watch(idx.inotify, copy, INDEX_EVENTS | IN_ONLYDIR);
+            idx.mtimes[d] = dir_mtime(copy);
+            DIR *dp = opendir(copy);
+            if(dp != NULL) {
+                struct dirent *entry;
+                while((entry = readdir(dp)) != NULL) {
+                    if(entry->d_name[0] == '.' || entry->d_type == DT_DIR) continue;
+                    if(!executable_at(dirfd(dp), entry->d_name)) continue;
+                    idx.exes = grow(idx.exes, &idx.size, idx.count + 1, sizeof(struct exe));
+                    idx.exes[idx.count].name = strdup(entry->d_name);
+                    if(idx.exes[idx.count].name == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+                    idx.exes[idx.count++].dirs = (uint64_t) 1 << d;
+                }
+                closedir(dp);
+            }
+        }
+        if(*end == '\0') break;
+        dir = end + 1;
+    }
+
+    // Sort, then merge the names found in several directories
+    qsort(idx.exes, idx.count, sizeof(struct exe), compare_exe);
+    size_t n = 0;
+    for(size_t i = 0; i < idx.count; ++i) {
+        if(n > 0 && strcmp(idx.exes[n - 1].name, idx.exes[i].name) == 0) {
+            idx.exes[n - 1].dirs |= idx.exes[i].dirs;
+            free(idx.exes[i].name);
+        } else {
+            idx.exes[n++] = idx.exes[i];
+        }
+    }
+    idx.count = n;
+}
+
+/*!
+ * \fn static void index_update()
+ * \brief Bring the index up to date: rebuild it if PATH changed, apply the pending inotify events otherwise.
+ *
+ * A directory without a watch (no inotify instance, too many watches, or a missing directory) costs a
+ * stat() instead: the index is rebuilt when its modification time changed, so when a file was added,
+ * removed or renamed in it.
+ */
+static void index_update() {
+    const char *path_env = getenv("PATH");
+    if(path_env == NULL) path_env = "/usr/local/bin:/usr/bin:/bin";
+    if(idx.path_env == NULL || strcmp(idx.path_env, path_env) != 0) {
+        index_build(path_env);
+        return;
+    }
+    for(size_t d = 0; d < idx.n_dirs; ++d) {
+        if(idx.watches[d] != -1) continue;
+        struct timespec mtime = dir_mtime(idx.dirs[d]);
+        if(mtime.tv_sec != idx.mtimes[d].tv_sec || mtime.tv_nsec != idx.mtimes[d].tv_nsec) {
+            index_build(path_env);
+            return;
+        }
+    }
+    if(idx.inotify == -1) return;
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while((len = read(idx.inotify, events, sizeof(events))) > 0) {
+        for(char *p = events; p < events + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if(ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) { // Events were lost, or a directory moved
+                index_build(path_env);
+                return;
+            }
+            if(ev->len == 0 || ev->name[0] == '.' || ev->mask & IN_ISDIR) continue;
+            for(size_t d = 0; d < idx.n_dirs; ++d) {
+                if(idx.watches[d] != ev->wd) continue;
+                bool present = false;
+                if(ev->mask & (IN_CREATE | IN_MOVED_TO | IN_ATTRIB)) {
+                    int dir_fd = open(idx.dirs[d], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    present = dir_fd != -1 && executable_at(dir_fd, ev->name);
+                    if(dir_fd != -1) close(dir_fd);
+                }
+                index_set(ev->name, d, present);
+            }
+        }
+    }
+}
+
+/*!
+ * \fn static void add_match(const char *match)
+ * \brief Add a candidate (not copied).
+ */
+static void add_match(const char *match) {
+    found.matches = grow(found.matches, &found.size, found.count + 1, sizeof(char *));
+    found.matches[found.count++] = match;
+}
+
+/*!
+ * \fn static void add_owned_match(char *match)
+ * \brief Add an allocated candidate, freed at the next completion.
+ */
+static void add_owned_match(char *match) {
+    if(match == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    found.owned = grow(found.owned, &found.owned_size, found.n_owned + 1, sizeof(char *));
+    found.owned[found.n_owned++] = match;
+    add_match(match);
+}
+
+/*!
+ * \fn static void complete_command(const char *prefix)
+ * \brief Add the internal commands and the executables of the PATH starting with prefix, in order, without duplicates.
+ */
+static void complete_command(const char *prefix) {
+    index_update();
+    size_t len = strlen(prefix);
+    size_t n_builtins;
+    const struct builtin *builtins = builtin_list(&n_builtins);
+    size_t b = 0;
+    while(b < n_builtins && strncmp(builtins[b].name, prefix, len) < 0) ++b;
+
+    // Merge the two sorted lists
+    for(size_t i = lower_bound(prefix);; ) {
+        bool exe_ok = i < idx.count && strncmp(idx.exes[i].name, prefix, len) == 0;
+        bool builtin_ok = b < n_builtins && strncmp(builtins[b].name, prefix, len) == 0;
+        if(!exe_ok && !builtin_ok) break;
+        int cmp = !exe_ok ? 1 : !builtin_ok ? -1 : strcmp(idx.exes[i].name, builtins[b].name);
+        if(cmp <= 0) add_match(idx.exes[i++].name);
+        else add_match(builtins[b].name);
+        if(cmp >= 0) ++b;
+    }
+}
+
+/*!
+ * \fn static int compare_strings(const void *a, const void *b)
+ * \brief Compare two strings for qsort().
+ */
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/*!
+ * \fn static void complete_file(const char *word, bool executables)
+ * \brief Add the files of the directory of word whose name starts with the rest of word.
+ *
+ * The hidden files are only proposed when the name starts with a '.'.
+ *
+ * \param executables true to keep only the directories and the executables (a command with a '/').
+ */
+static void complete_file(const char *word, bool executables) {
+    const char *slash = strrchr(word, '/');
+    size_t dir_len = slash != NULL ? (size_t) (slash - word) + 1 : 0;
+    const char *name = word + dir_len;
+    size_t name_len = strlen(name);
+    char *dir = dir_len > 0 ? strndup(word, dir_len) : strdup(".");
+    if(dir == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+
+    DIR *dp = opendir(dir);
+    if(dp != NULL) {
+        size_t first = found.count;
+        struct dirent *entry;
+        while((entry = readdir(dp)) != NULL) {
+            const char *n = entry->d_name;
+            if(strncmp(n, name, name_len) != 0) continue;
+            if(n[0] == '.' && (name[0] != '.' || strcmp(n, ".") == 0 || strcmp(n, "..") == 0)) continue;
+            bool is_dir = entry->d_type == DT_DIR;
+            struct stat st;
+            if((entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) && fstatat(dirfd(dp), n, &st, 0) == 0) {
+                is_dir = S_ISDIR(st.st_mode);
+            }
+            if(executables && !is_dir && !executable_at(dirfd(dp), n)) continue;
+            char *match;
+            if(asprintf(&match, "%.*s%s%s", (int) dir_len, word, n, is_dir ? "/" : "") == -1) match = NULL;
+            add_owned_match(match);
+        }
+        closedir(dp);
+        qsort(found.matches + first, found.count - first, sizeof(char *), compare_strings);
+    }
+    free(dir);
+}
+
+/*!
+ * \fn static bool is_operator(const char *word, size_t len, bool *command)
+ * \brief Tell if an unquoted word is an operator, and what it is followed by.
+ *
+ * \param command Set to true after "|", "&", "&&" and "||" (a command), to false after a redirection (a file).
+ */
+static bool is_operator(const char *word, size_t len, bool *command) {
+    static const char *commands[] = {"|", "&", "&&", "||"};
+    static const char *files[] = {"<", ">", ">>"};
+    for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i) {
+        if(strlen(commands[i]) == len && strncmp(word, commands[i], len) == 0) { *command = true; return true; }
+    }
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        if(strlen(files[i]) == len && strncmp(word, files[i], len) == 0) { *command = false; return true; }
+    }
+    return false;
+}
+
+size_t complete_line(const char *line, size_t cursor, struct completion *c) {
+    for(size_t i = 0; i < found.n_owned; ++i) free(found.owned[i]);
+    found.n_owned = 0;
+    found.count = 0;
+
+    // Cut the words before the cursor as the tokenizer of the parser does
+    bool command = true;
+    size_t i = 0, start = cursor;
+    char quote = '\0';
+    while(i < cursor) {
+        if(line[i] == ' ' || line[i] == '\t') { ++i; continue; }
+        if(line[i] == ';') { command = true; ++i; continue; }
+        start = i;
+        if(line[i] == '"' || line[i] == '\'') {
+            quote = line[i];
+            const char *close = memchr(line + i + 1, quote, cursor - i - 1);
+            if(close == NULL) break; // The word under the cursor
+            i = (size_t) (close - line) + 1;
+            quote = '\0';
+        } else {
+            while(i < cursor && line[i] != ' ' && line[i] != '\t' && line[i] != ';') ++i;
+            if(i == cursor) break;
+            bool next_command;
+            if(is_operator(line + start, i - start, &next_command)) {
+                command = next_command;
+                start = cursor;
+                continue;
+            }
+        }
+        command = false; // An argument follows a command name
+        start = cursor;
+    }
+
+    size_t word_start = start + (quote != '\0');
+    free(found.word);
+    found.word = strndup(line + word_start, cursor - word_start);
+    if(found.word == NULL) { perror("strndup"); exit(EXIT_FAILURE); }
+
+    if(command && strchr(found.word, '/') == NULL) complete_command(found.word);
+    else complete_file(found.word, command);
+
+    c->start = start;
+    c->word = found.word;
+    c->quote = quote;
+    c->command = command;
+    c->matches = found.matches;
+    c->count = found.count;
+    c->common = 0;
+    if(found.count > 0) {
+        c->common = strlen(found.matches[0]);
+        for(size_t m = 1; m < found.count; ++m) {
+            size_t n = 0;
+            while(n < c->common && found.matches[m][n] == found.matches[0][n]) ++n;
+            c->common = n;
+        }
+    }
+    return found.count;
+}
+
+void complete_print_stats(FILE *out) {
+    fprintf(out, "Completion: %zu executables in %zu directories, %zu builds, %zu incremental updates%s\n",
+            idx.count, idx.n_dirs, idx.builds, idx.updates, idx.inotify == -1 ? " (no inotify)" : "");
+}
@@ -0,0 +1,91 @@
+/*!
+ * \file complete.h
+ * \brief Header file for the completion of the words of a line.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * A command name is completed from the internal commands and the executables of the PATH, other
+ * words from the files of their directory (the current one by default). The executables of the
+ * PATH are kept in an array sorted by name, built on the first completion: the matches of a prefix
+ * are found by binary search. The array is then updated from the inotify(7) events of the PATH
+ * directories, applied before each completion, and rebuilt only when PATH changes, or when the
+ * modification time of a directory inotify cannot watch changes.
+ */
+#ifndef FISH_COMPLETE_H
+#define FISH_COMPLETE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*!
+ * \struct completion
+ * \brief The completions of the word under the cursor.
+ */
+struct completion {
+    /*!
+     * \var start
+     * \brief The index of the word in the line (its opening quote included).
+     */
+    size_t start;
+    /*!
+     * \var word
+     * \brief The word typed before the cursor, without its quote.
+     */
+    const char *word;
+    /*!
+     * \var quote
+     * \brief The quote opening the word, '\0' if none.
+     */
+    char quote;
+    /*!
+     * \var command
+     * \brief true if the word is a command name.
+     */
+    bool command;
+    /*!
+     * \var matches
+     * \brief The candidates, sorted, each replacing the whole word (a directory ends with '/').
+     * Valid until the next call of complete_line().
+     */
+    const char **matches;
+    /*!
+     * \var count
+     * \brief The number of candidates.
+     */
+    size_t count;
+    /*!
+     * \var common
+     * \brief The length of the longest common prefix of the candidates.
+     */
+    size_t common;
+};
+
+/*!
+ * \fn size_t complete_line(const char *line, size_t cursor, struct completion *c)
+ * \brief Find the completions of the word ending at the cursor.
+ *
+ * The words are cut as line_parse() does: a word is quoted as a whole or not at all, and the operators
+ * ("|", ";", "&&", "||", "&") start a new command. A word after "<", ">" or ">>", or containing a '/',
+ * is a file.
+ *
+ * \param line The line being edited.
+ * \param cursor The position of the cursor in line.
+ * \param c Where to store the completions.
+ * \return The number of candidates.
+ */
+size_t complete_line(const char *line, size_t cursor, struct completion *c);
+
+/*!
+ * \fn void complete_print_stats(FILE *out)
+ * \brief Print the size of the index of the PATH and the number of incremental updates.
+ */
+void complete_print_stats(FILE *out);
+
+/*!
+ * \fn void complete_clear()
+ * \brief Free the index of the PATH and stop watching its directories.
+ */
+void complete_clear();
+
+#endif //FISH_COMPLETE_H
@@ -0,0 +1,630 @@
+/*!
+ * \file editor.c
+ * \brief Implementation of the line editor of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ *
+ * Used for the functions memrchr and memmem.
+ */
+#define _GNU_SOURCE
+
+#include "editor.h"
+
+#include "complete.h"
+#include "history.h"
+#include "prompt.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/*!
+ * \def EDITOR_LIST_MAX
+ * \brief Maximal number of completions listed by Tab.
+ */
+#define EDITOR_LIST_MAX 200
+
+/*!
+ * \def CTRL_KEY
+ * \brief The byte sent by Ctrl and a letter.
+ */
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+/*!
+ * \fn static void *grow(void *array, size_t *size, size_t needed)
+ * \brief Grow a byte buffer to hold at least needed bytes (exits on failure).
+ */
+static void *grow(void *array, size_t *size, size_t needed) {
+    if(needed <= *size) return array;
+    size_t new_size = *size == 0 ? 256 : *size;
+    while(new_size < needed) new_size *= 2;
+    void *grown = realloc(array, new_size);
+    if(grown == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+    *size = new_size;
+    return grown;
+}
+
+/*!
+ * \fn static void out_append(struct editor *ed, const char *s, size_t len)
+ * \brief Add bytes to the pending output.
+ */
+static void out_append(struct editor *ed, const char *s, size_t len) {
+    ed->out = grow(ed->out, &ed->out_size, ed->out_len + len);
+    memcpy(ed->out + ed->out_len, s, len);
+    ed->out_len += len;
+}
+
+/*!
+ * \fn static void out_string(struct editor *ed, const char *s)
+ * \brief Add a string to the pending output.
+ */
+static void out_string(struct editor *ed, const char *s) {
+    out_append(ed, s, strlen(s));
+}
+
+/*!
+ * \fn static void out_flush(struct editor *ed)
+ * \brief Write the pending output on stdout.
+ */
+static void out_flush(struct editor *ed) {
+    fflush(stdout); // What printf() buffered must come first
+    size_t done = 0;
+    while(done < ed->out_len) {
+        ssize_t n = write(STDOUT_FILENO, ed->out + done, ed->out_len - done);
+        if(n == -1) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        done += n;
+    }
+    ed->out_len = 0;
+}
+
+/*!
+ * \fn static size_t columns(const char *s, size_t len)
+ * \brief The number of characters of a UTF-8 string (its width, ignoring wide characters).
+ */
+static size_t columns(const char *s, size_t len) {
+    size_t n = 0;
+    for(size_t i = 0; i < len; ++i) {
+        if(((unsigned char) s[i] & 0xc0) != 0x80) ++n;
+    }
+    return n;
+}
+
+/*!
+ * \fn static void out_line(struct editor *ed, bool whole_prompt)
+ * \brief Add the prompt and the line to the pending output, and put the cursor back in place.
+ *
+ * During a search of the history, the last line of the prompt is replaced by the text searched.
+ *
+ * \param whole_prompt false to only write the last line of the prompt again, after a carriage return.
+ */
+static void out_line(struct editor *ed, bool whole_prompt) {
+    size_t len = 0, head = 0;
+    const char *prompt = prompt_text(ed->status, &len);
+    if(prompt == NULL) len = 0;
+    const char *newline = prompt != NULL ? memrchr(prompt, '\n', len) : NULL;
+    if(newline != NULL) head = (size_t) (newline + 1 - prompt);
+
+    if(whole_prompt) out_append(ed, prompt, head);
+    out_string(ed, "\r");
+    if(ed->searching) {
+        out_string(ed, ed->search_failed ? "(failed search)`" : "(search)`");
+        out_append(ed, ed->query, ed->query_len);
+        out_string(ed, "': ");
+    } else {
+        out_append(ed, prompt + head, len - head);
+    }
+    out_append(ed, ed->buf, ed->len);
+    out_string(ed, "\x1b[K");
+    size_t back = columns(ed->buf + ed->cursor, ed->len - ed->cursor);
+    if(back > 0) {
+        char move[32];
+        snprintf(move, sizeof(move), "\x1b[%zuD", back);
+        out_string(ed, move);
+    }
+}
+
+/*!
+ * \fn static void set_raw(struct editor *ed, bool raw)
+ * \brief Put the terminal in raw mode, or restore its modes.
+ *
+ * In raw mode, the keys are read one by one, without echo, and Ctrl-C, Ctrl-Z and Ctrl-V are plain bytes.
+ * The output is still processed ('\n' moves to the start of the next line).
+ */
+static void set_raw(struct editor *ed, bool raw) {
+    if(raw == ed->raw) return;
+    if(raw) {
+        if(tcgetattr(ed->fd, &ed->cooked) == -1) return;
+        struct termios modes = ed->cooked;
+        modes.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        modes.c_cc[VMIN] = 1;
+        modes.c_cc[VTIME] = 0;
+        if(tcsetattr(ed->fd, TCSANOW, &modes) == -1) return;
+    } else {
+        tcsetattr(ed->fd, TCSANOW, &ed->cooked);
+    }
+    ed->raw = raw;
+}
+
+/*!
+ * \fn static void replace(struct editor *ed, size_t start, size_t end, const char *s, size_t len)
+ * \brief Replace the bytes [start, end[ of the line by s, and put the cursor after s.
+ */
+static void replace(struct editor *ed, size_t start, size_t end, const char *s, size_t len) {
+    ed->buf = grow(ed->buf, &ed->size, ed->len - (end - start) + len + 1);
+    memmove(ed->buf + start + len, ed->buf + end, ed->len - end + 1);
+    memcpy(ed->buf + start, s, len);
+    ed->len = ed->len - (end - start) + len;
+    ed->cursor = start + len;
+}
+
+/*!
+ * \fn static size_t prev_char(const struct editor *ed, size_t i)
+ * \brief The index of the UTF-8 character before the index i.
+ */
+static size_t prev_char(const struct editor *ed, size_t i) {
+    if(i == 0) return 0;
+    do --i; while(i > 0 && ((unsigned char) ed->buf[i] & 0xc0) == 0x80);
+    return i;
+}
+
+/*!
+ * \fn static size_t next_char(const struct editor *ed, size_t i)
+ * \brief The index of the UTF-8 character after the one at the index i.
+ */
+static size_t next_char(const struct editor *ed, size_t i) {
+    if(i >= ed->len) return ed->len;
+    do ++i; while(i < ed->len && ((unsigned char) ed->buf[i] & 0xc0) == 0x80);
+    return i;
+}
+
+/*!
+ * \fn static bool needs_quote(const char *s, size_t len)
+ * \brief Check whether a completion would not be read as a single word by the parser.
+ */
+static bool needs_quote(const char *s, size_t len) {
+    if(len > 0 && (s[0] == '"' || s[0] == '\'')) return true;
+    for(size_t i = 0; i < len; ++i) {
+        if(s[i] == ' ' || s[i] == '\t' || s[i] == ';') return true;
+    }
+    return false;
+}
+
+/*!
+ * \fn static void list_matches(struct editor *ed, const struct completion *c)
+ * \brief Print the completions in columns below the line, then the prompt and the line again.
+ *
+ * The files are shown without the directory typed.
+ */
+static void list_matches(struct editor *ed, const struct completion *c) {
+    const char *slash = strrchr(c->word, '/');
+    size_t skip = slash != NULL ? (size_t) (slash - c->word) + 1 : 0;
+    size_t count = c->count < EDITOR_LIST_MAX ? c->count : EDITOR_LIST_MAX;
+
+    size_t width = 80, widest = 1;
+    struct winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) width = ws.ws_col;
+    for(size_t i = 0; i < count; ++i) {
+        size_t w = columns(c->matches[i] + skip, strlen(c->matches[i] + skip));
+        if(w > widest) widest = w;
+    }
+    size_t n_cols = width / (widest + 2);
+    if(n_cols == 0) n_cols = 1;
+    size_t n_rows = (count + n_cols - 1) / n_cols;
+
+    out_string(ed, "\n");
+    for(size_t row = 0; row < n_rows; ++row) {
+        for(size_t col = 0; col < n_cols; ++col) {
+            size_t i = col * n_rows + row; // Sorted by column, as ls(1) does
+            if(i >= count) break;
+            const char *name = c->matches[i] + skip;
+            size_t len = strlen(name);
+            out_append(ed, name, len);
+            if(col + 1 < n_cols && i + n_rows < count) {
+                for(size_t pad = columns(name, len); pad < widest + 2; ++pad) out_string(ed, " ");
+            }
+        }
+        out_string(ed, "\n");
+    }
+    if(count < c->count) {
+        char more[64];
+        snprintf(more, sizeof(more), "(%zu more)\n", c->count - count);
+        out_string(ed, more);
+    }
+    out_line(ed, true);
+}
+
+/*!
+ * \fn static void complete(struct editor *ed)
+ * \brief Complete the word before the cursor (Tab).
+ *
+ * A single completion replaces the word and is followed by a space (unless it is a directory). Several
+ * completions are reduced to their longest common prefix, and listed when this prefix adds nothing.
+ * A completion which would be cut by the parser is quoted.
+ */
+static void complete(struct editor *ed) {
+    struct completion c;
+    if(complete_line(ed->buf, ed->cursor, &c) == 0) {
+        out_string(ed, "\a");
+        return;
+    }
+    const char *match = c.matches[0];
+    size_t len = c.count == 1 ? strlen(match) : c.common;
+    if(c.count > 1 && len == strlen(c.word)) {
+        list_matches(ed, &c);
+        return;
+    }
+
+    char quote = c.quote;
+    if(quote == '\0' && needs_quote(match, len)) quote = memchr(match, '"', len) != NULL ? '\'' : '"';
+    bool final = c.count == 1 && match[len - 1] != '/';
+
+    char *text = malloc(len + 4);
+    if(text == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t n = 0;
+    if(quote != '\0') text[n++] = quote;
+    memcpy(text + n, match, len);
+    n += len;
+    if(final && quote != '\0') text[n++] = quote;
+    if(final) text[n++] = ' ';
+    replace(ed, c.start, ed->cursor, text, n);
+    free(text);
+}
+
+/*!
+ * \fn static void save_line(struct editor *ed)
+ * \brief Keep the line typed, before showing the entries of the history.
+ */
+static void save_line(struct editor *ed) {
+    ed->saved = grow(ed->saved, &ed->saved_size, ed->len + 1);
+    memcpy(ed->saved, ed->buf, ed->len + 1);
+}
+
+/*!
+ * \fn static bool is_shown(const struct editor *ed, const struct history_entry *e)
+ * \brief Check whether an entry is the line shown (the duplicates are skipped).
+ */
+static bool is_shown(const struct editor *ed, const struct history_entry *e) {
+    return e->line_len == ed->len && memcmp(e->line, ed->buf, ed->len) == 0;
+}
+
+/*!
+ * \fn static void history_up(struct editor *ed)
+ * \brief Show the previous entry of the history (Up).
+ */
+static void history_up(struct editor *ed) {
+    if(!ed->browsing) {
+        save_line(ed);
+        ed->history_pos = history_end(); // With the lines of the other shells
+        ed->browsing = true;
+    }
+    size_t pos = ed->history_pos;
+    struct history_entry e;
+    while(history_prev(&pos, &e)) {
+        if(is_shown(ed, &e)) continue;
+        ed->history_pos = pos;
+        replace(ed, 0, ed->len, e.line, e.line_len);
+        return;
+    }
+    out_string(ed, "\a");
+}
+
+/*!
+ * \fn static void history_down(struct editor *ed)
+ * \brief Show the next entry of the history, or the line typed after the last one (Down).
+ */
+static void history_down(struct editor *ed) {
+    if(!ed->browsing) {
+        out_string(ed, "\a");
+        return;
+    }
+    size_t pos = ed->history_pos;
+    struct history_entry e;
+    while(history_next(&pos, &e)) {
+        if(is_shown(ed, &e)) continue;
+        ed->history_pos = pos;
+        replace(ed, 0, ed->len, e.line, e.line_len);
+        return;
+    }
+    replace(ed, 0, ed->len, ed->saved, strlen(ed->saved));
+    ed->browsing = false;
+}
+
+/*!
+ * \fn static void search(struct editor *ed, size_t pos)
+ * \brief Show the most recent entry before a position containing the text searched, with the cursor on the text.
+ */
+static void search(struct editor *ed, size_t pos) {
+    struct history_entry e;
+    ed->search_failed = true;
+    while(history_search(ed->query, &pos, &e)) {
+        if(is_shown(ed, &e) && pos < ed->history_pos) continue; // An older duplicate of the line shown
+        ed->search_failed = false;
+        ed->history_pos = pos;
+        replace(ed, 0, ed->len, e.line, e.line_len);
+        const char *match = memmem(ed->buf, ed->len, ed->query, ed->query_len);
+        ed->cursor = match != NULL ? (size_t) (match - ed->buf) : ed->len;
+        return;
+    }
+    out_string(ed, "\a");
+}
+
+/*!
+ * \fn static bool handle_search_key(struct editor *ed, unsigned char key)
+ * \brief Handle a key during a search of the history (Ctrl-R).
+ *
+ * A printable byte or Backspace changes the text searched, and Ctrl-R shows an older match. Ctrl-G and
+ * Ctrl-C cancel the search. Any other key ends the search, keeping the line found, and is then handled
+ * as usual (Enter executes the line).
+ *
+ * \return true if the key was handled.
+ */
+static bool handle_search_key(struct editor *ed, unsigned char key) {
+    if(key >= 0x20 && key != 0x7f) {
+        ed->query = grow(ed->query, &ed->query_size, ed->query_len + 2);
+        ed->query[ed->query_len++] = (char) key;
+        ed->query[ed->query_len] = '\0';
+        search(ed, history_end());
+        return true;
+    }
+    switch(key) {
+        case 0x7f: // Backspace
+        case CTRL_KEY('H'):
+            while(ed->query_len > 0 && ((unsigned char) ed->query[--ed->query_len] & 0xc0) == 0x80);
+            ed->query[ed->query_len] = '\0';
+            search(ed, history_end());
+            return true;
+        case CTRL_KEY('R'):
+            if(ed->search_failed) out_string(ed, "\a");
+            else search(ed, ed->history_pos);
+            return true;
+        case CTRL_KEY('G'):
+        case CTRL_KEY('C'):
+            replace(ed, 0, ed->len, ed->saved, strlen(ed->saved));
+            ed->searching = false;
+            return true;
+        default:
+            ed->searching = false;
+            return false;
+    }
+}
+
+/*!
+ * \fn static size_t escape_length(const char *s, size_t len)
+ * \brief The length of the escape sequence at the start of s (starting with ESC), 0 if it is incomplete.
+ */
+static size_t escape_length(const char *s, size_t len) {
+    if(len < 2) return 0;
+    if(s[1] == 'O') return len < 3 ? 0 : 3;
+    if(s[1] != '[') return 2; // Alt and a key: ignored
+    for(size_t i = 2; i < len; ++i) {
+        if(s[i] >= 0x40 && s[i] <= 0x7e) return i + 1; // The final byte of a CSI sequence
+    }
+    return 0;
+}
+
+/*!
+ * \fn static void handle_escape(struct editor *ed, const char *s, size_t len)
+ * \brief Handle the keys sent as escape sequences: arrows, Home, End and Delete.
+ *
+ * Up and Down browse the history.
+ */
+static void handle_escape(struct editor *ed, const char *s, size_t len) {
+    char final = s[len - 1];
+    if(len == 4 && s[1] == '[' && s[3] == '~') final = s[2]; // "\e[1~", "\e[3~", ...
+    switch(final) {
+        case 'A': // Up
+            history_up(ed);
+            break;
+        case 'B': // Down
+            history_down(ed);
+            break;
+        case 'C': // Right
+            ed->cursor = next_char(ed, ed->cursor);
+            break;
+        case 'D': // Left
+            ed->cursor = prev_char(ed, ed->cursor);
+            break;
+        case 'H': // Home
+        case '1':
+        case '7':
+            ed->cursor = 0;
+            break;
+        case 'F': // End
+        case '4':
+        case '8':
+            ed->cursor = ed->len;
+            break;
+        case '3': // Delete
+            replace(ed, ed->cursor, next_char(ed, ed->cursor), "", 0);
+            break;
+        default:
+            break;
+    }
+}
+
+/*!
+ * \fn static void handle_input(struct editor *ed)
+ * \brief Handle the bytes not handled yet, up to the end of the line, then redraw the line.
+ */
+static void handle_input(struct editor *ed) {
+    bool redraw = false;
+    while(ed->in_start < ed->in_end && !ed->done && !ed->eof) {
+        const char *s = ed->in + ed->in_start;
+        size_t left = ed->in_end - ed->in_start;
+        unsigned char key = (unsigned char) s[0];
+        size_t used = 1;
+        redraw = true;
+
+        if(ed->searching && key != 0x1b && handle_search_key(ed, key)) {
+            // Handled by the search
+        } else if(key == 0x1b) {
+            ed->searching = false;
+            used = escape_length(s, left);
+            if(used == 0) break; // Wait for the rest of the sequence
+            handle_escape(ed, s, used);
+        } else if(key >= 0x20 && key != 0x7f) {
+            // Insert all the printable bytes at once (a paste)
+            while(used < left && (unsigned char) s[used] >= 0x20 && s[used] != 0x7f) ++used;
+            replace(ed, ed->cursor, ed->cursor, s, used);
+        } else {
+            switch(key) {
+                case '\r':
+                case '\n':
+                    ed->cursor = ed->len;
+                    ed->done = true;
+                    break;
+                case '\t':
+                    complete(ed);
+                    break;
+                case 0x7f: // Backspace
+                case CTRL_KEY('H'):
+                    replace(ed, prev_char(ed, ed->cursor), ed->cursor, "", 0);
+                    break;
+                case CTRL_KEY('D'):
+                    if(ed->len == 0) ed->eof = true; // Delete otherwise
+                    else replace(ed, ed->cursor, next_char(ed, ed->cursor), "", 0);
+                    break;
+                case CTRL_KEY('A'):
+                    ed->cursor = 0;
+                    break;
+                case CTRL_KEY('E'):
+                    ed->cursor = ed->len;
+                    break;
+                case CTRL_KEY('B'):
+                    ed->cursor = prev_char(ed, ed->cursor);
+                    break;
+                case CTRL_KEY('F'):
+                    ed->cursor = next_char(ed, ed->cursor);
+                    break;
+                case CTRL_KEY('U'):
+                    replace(ed, 0, ed->cursor, "", 0);
+                    break;
+                case CTRL_KEY('K'):
+                    ed->len = ed->cursor;
+                    ed->buf[ed->len] = '\0';
+                    break;
+                case CTRL_KEY('W'): {
+                    size_t start = ed->cursor;
+                    while(start > 0 && ed->buf[start - 1] == ' ') --start;
+                    while(start > 0 && ed->buf[start - 1] != ' ') --start;
+                    replace(ed, start, ed->cursor, "", 0);
+                    break;
+                }
+                case CTRL_KEY('R'):
+                    save_line(ed);
+                    ed->searching = true;
+                    ed->search_failed = false;
+                    ed->query = grow(ed->query, &ed->query_size, 1);
+                    ed->query[0] = '\0';
+                    ed->query_len = 0;
+                    ed->history_pos = history_end();
+                    ed->browsing = false;
+                    break;
+                case CTRL_KEY('L'):
+                    out_string(ed, "\x1b[H\x1b[2J");
+                    out_line(ed, true);
+                    redraw = false;
+                    break;
+                case CTRL_KEY('C'):
+                    ed->len = ed->cursor = 0;
+                    ed->buf[0] = '\0';
+                    out_string(ed, "^C\n");
+                    out_line(ed, true);
+                    redraw = false;
+                    break;
+                default:
+                    break;
+            }
+        }
+        ed->in_start += used;
+    }
+
+    if(redraw) out_line(ed, false);
+    if(ed->done || ed->eof) out_string(ed, "\n");
+    out_flush(ed);
+}
+
+void editor_init(struct editor *ed, int fd) {
+    memset(ed, 0, sizeof(*ed));
+    ed->fd = fd;
+}
+
+void editor_start(struct editor *ed, int last_status_code) {
+    ed->status = last_status_code;
+    ed->buf = grow(ed->buf, &ed->size, 1);
+    ed->buf[0] = '\0';
+    ed->len = ed->cursor = 0;
+    ed->done = false;
+    ed->browsing = false;
+    ed->searching = false;
+
+    set_raw(ed, true);
+    out_line(ed, true);
+    handle_input(ed);
+}
+
+void editor_read(struct editor *ed) {
+    if(ed->in_start > 0) {
+        memmove(ed->in, ed->in + ed->in_start, ed->in_end - ed->in_start);
+        ed->in_end -= ed->in_start;
+        ed->in_start = 0;
+    }
+    ed->in = grow(ed->in, &ed->in_size, ed->in_end + 4096);
+
+    ssize_t n;
+    do {
+        n = read(ed->fd, ed->in + ed->in_end, ed->in_size - ed->in_end);
+    } while(n == -1 && errno == EINTR);
+    if(n == -1 && errno == EAGAIN) return;
+    if(n == -1) ed->error = errno;
+    else if(n == 0) ed->eof = true;
+    else ed->in_end += n;
+    handle_input(ed);
+}
+
+bool editor_has_line(struct editor *ed) {
+    return ed->done || ed->eof || ed->error != 0;
+}
+
+void editor_redraw(struct editor *ed) {
+    out_line(ed, true);
+    out_flush(ed);
+}
+
+ssize_t editor_next_line(struct editor *ed, char **line) {
+    set_raw(ed, false);
+    if(ed->error != 0) {
+        errno = ed->error;
+        return -2;
+    }
+    if(!ed->done) return -1;
+
+    ed->line = grow(ed->line, &ed->line_size, ed->len + 1);
+    memcpy(ed->line, ed->buf, ed->len + 1);
+    ed->done = false;
+    *line = ed->line;
+    return (ssize_t) ed->len;
+}
+
+void editor_destroy(struct editor *ed) {
+    set_raw(ed, false);
+    free(ed->buf);
+    free(ed->in);
+    free(ed->out);
+    free(ed->line);
+    free(ed->saved);
+    free(ed->query);
+    complete_clear();
+    editor_init(ed, ed->fd);
+}
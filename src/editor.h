@@ -0,0 +1,243 @@
+/*!
+ * \file editor.h
+ * \brief Header file for the line editor of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The editor puts the terminal in raw mode while a line is typed, so the keys are handled by the
+ * shell: moving the cursor, deleting, completing the word under the cursor with Tab (see
+ * complete.h), and recalling the lines of the history with Up and Down or searching them with Ctrl-R
+ * (see history.h). The terminal modes are restored before a line is returned, so the commands run with
+ * the modes of the shell. The bytes typed ahead, or pasted with several lines, are kept for the
+ * next lines. A line longer than the terminal is not wrapped back when it is redrawn.
+ */
+#ifndef FISH_EDITOR_H
+#define FISH_EDITOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <termios.h>
+
+/*!
+ * \struct editor
+ * \brief Structure holding the state of the line editor.
+ */
+struct editor {
+    /*!
+     * \var fd
+     * \brief The terminal read.
+     */
+    int fd;
+    /*!
+     * \var cooked
+     * \brief The terminal modes restored when a line is returned.
+     */
+    struct termios cooked;
+    /*!
+     * \var raw
+     * \brief true while the terminal is in raw mode.
+     */
+    bool raw;
+    /*!
+     * \var status
+     * \brief The status shown by the prompt (see prompt_text).
+     */
+    int status;
+    /*!
+     * \var buf
+     * \brief The line being edited, '\0' terminated.
+     */
+    char *buf;
+    /*!
+     * \var len
+     * \brief The length of the line.
+     */
+    size_t len;
+    /*!
+     * \var size
+     * \brief The allocated size of buf.
+     */
+    size_t size;
+    /*!
+     * \var cursor
+     * \brief The index of the cursor in the line.
+     */
+    size_t cursor;
+    /*!
+     * \var in
+     * \brief The bytes read and not handled yet (after a complete line, or an incomplete escape sequence).
+     */
+    char *in;
+    /*!
+     * \var in_start
+     * \brief The index of the first byte not handled in in.
+     */
+    size_t in_start;
+    /*!
+     * \var in_end
+     * \brief The index following the last byte read in in.
+     */
+    size_t in_end;
+    /*!
+     * \var in_size
+     * \brief The allocated size of in.
+     */
+    size_t in_size;
+    /*!
+     * \var out
+     * \brief The output pending, written with a single write(2).
+     */
+    char *out;
+    /*!
+     * \var out_len
+     * \brief The length of the output pending.
+     */
+    size_t out_len;
+    /*!
+     * \var out_size
+     * \brief The allocated size of out.
+     */
+    size_t out_size;
+    /*!
+     * \var done
+     * \brief true once Enter was typed: the line is complete.
+     */
+    bool done;
+    /*!
+     * \var eof
+     * \brief true once Ctrl-D was typed on an empty line, or read(2) returned 0.
+     */
+    bool eof;
+    /*!
+     * \var error
+     * \brief The errno of a failed read(2), 0 if none.
+     */
+    int error;
+    /*!
+     * \var saved
+     * \brief The line typed before browsing or searching the history, '\0' terminated.
+     */
+    char *saved;
+    /*!
+     * \var saved_size
+     * \brief The allocated size of saved.
+     */
+    size_t saved_size;
+    /*!
+     * \var browsing
+     * \brief true while an entry of the history is shown by Up and Down.
+     */
+    bool browsing;
+    /*!
+     * \var history_pos
+     * \brief The position of the entry of the history shown (see history_end).
+     */
+    size_t history_pos;
+    /*!
+     * \var searching
+     * \brief true during a search of the history (Ctrl-R).
+     */
+    bool searching;
+    /*!
+     * \var search_failed
+     * \brief true if no entry contains the text searched.
+     */
+    bool search_failed;
+    /*!
+     * \var query
+     * \brief The text searched, '\0' terminated.
+     */
+    char *query;
+    /*!
+     * \var query_len
+     * \brief The length of the text searched.
+     */
+    size_t query_len;
+    /*!
+     * \var query_size
+     * \brief The allocated size of query.
+     */
+    size_t query_size;
+    /*!
+     * \var line
+     * \brief The last line returned by editor_next_line().
+     */
+    char *line;
+    /*!
+     * \var line_size
+     * \brief The allocated size of line.
+     */
+    size_t line_size;
+};
+
+/*!
+ * \fn void editor_init(struct editor *ed, int fd)
+ * \brief Initialize a line editor on a terminal. No memory is allocated before the first line.
+ *
+ * \param ed The editor to initialize.
+ * \param fd The terminal to read.
+ */
+void editor_init(struct editor *ed, int fd);
+
+/*!
+ * \fn void editor_start(struct editor *ed, int last_status_code)
+ * \brief Write the prompt, put the terminal in raw mode and start an empty line.
+ *
+ * The bytes typed ahead are handled at once, so a line may already be complete.
+ *
+ * \param ed The editor.
+ * \param last_status_code The status shown by the prompt (see prompt_text).
+ */
+void editor_start(struct editor *ed, int last_status_code);
+
+/*!
+ * \fn void editor_read(struct editor *ed)
+ * \brief Read the bytes available on the terminal and handle the keys, up to the end of a line.
+ *
+ * Called when the terminal is readable (see event_wait).
+ *
+ * \param ed The editor.
+ */
+void editor_read(struct editor *ed);
+
+/*!
+ * \fn bool editor_has_line(struct editor *ed)
+ * \brief Check whether editor_next_line() can return.
+ *
+ * \param ed The editor.
+ * \return true if the line is complete, the end of the input was reached, or an error occurred.
+ */
+bool editor_has_line(struct editor *ed);
+
+/*!
+ * \fn void editor_redraw(struct editor *ed)
+ * \brief Write the prompt and the line again, after something else was printed on the terminal.
+ *
+ * \param ed The editor.
+ */
+void editor_redraw(struct editor *ed);
+
+/*!
+ * \fn ssize_t editor_next_line(struct editor *ed, char **line)
+ * \brief Get the line typed, and restore the terminal modes.
+ *
+ * The line stays valid until the next call.
+ *
+ * \param ed The editor.
+ * \param line Where to store the address of the line.
+ * \return The length of the line, <br>
+ *         -1 at the end of the input, <br>
+ *         -2 if an error occurs (errno is set).
+ */
+ssize_t editor_next_line(struct editor *ed, char **line);
+
+/*!
+ * \fn void editor_destroy(struct editor *ed)
+ * \brief Restore the terminal modes and free the buffers of the editor.
+ *
+ * \param ed The editor to destroy.
+ */
+void editor_destroy(struct editor *ed);
+
+#endif //FISH_EDITOR_H
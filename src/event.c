@@ -0,0 +1,118 @@
+/*!
+ * \file event.c
+ * \brief Implementation of the event loop of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "event.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*!
+ * \var self_pipe
+ * \brief The pipe written by the signal handlers and polled by event_wait().
+ */
+static int self_pipe[2] = {-1, -1};
+
+void event_init() {
+    if(self_pipe[PREAD] != -1) { // In a forked child: do not share the self-pipe of the parent
+        close(self_pipe[PREAD]);
+        close(self_pipe[PWRITE]);
+    }
+    if(pipe(self_pipe) == -1) { perror("pipe (self-pipe)"); exit(EXIT_FAILURE); }
+    for(int i = 0; i < 2; i++) {
+        // Non-blocking: a full pipe must not block the handler, an empty one must not block the drain
+        if(fcntl(self_pipe[i], F_SETFL, O_NONBLOCK) == -1 || fcntl(self_pipe[i], F_SETFD, FD_CLOEXEC) == -1) {
+            perror("fcntl (self-pipe)");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void event_notify() {
+    int saved_errno = errno;
+    char byte = 0;
+    // If the pipe is full, a wake-up is already pending: the byte can be dropped
+    if(write(self_pipe[PWRITE], &byte, 1) == -1) {}
+    errno = saved_errno;
+}
+
+/*!
+ * \var child_fd
+ * \brief A file descriptor reported as EVENT_CHILD when readable, -1 if none (see event_watch_children()).
+ */
+static int child_fd = -1;
+
+void event_watch_children(int fd) {
+    child_fd = fd;
+}
+
+/*!
+ * \var poll_fds
+ * \brief The self-pipe and child_fd, followed by the file descriptors given to event_wait_fds(), grown on demand.
+ */
+static struct pollfd *poll_fds = NULL;
+
+/*!
+ * \var poll_fds_size
+ * \brief Allocated number of elements of poll_fds.
+ */
+static size_t poll_fds_size = 0;
+
+int event_wait_fds(struct pollfd *fds, size_t nfds) {
+    if(nfds + 2 > poll_fds_size) {
+        size_t new_size = (nfds + 2) * 2;
+        struct pollfd *new_fds = realloc(poll_fds, new_size * sizeof(struct pollfd));
+        if(new_fds == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        poll_fds = new_fds;
+        poll_fds_size = new_size;
+    }
+    poll_fds[0].fd = self_pipe[PREAD];
+    poll_fds[0].events = POLLIN;
+    poll_fds[1].fd = child_fd; // Ignored by poll() when negative
+    poll_fds[1].events = POLLIN;
+    for(size_t i = 0; i < nfds; i++) {
+        poll_fds[i + 2] = fds[i];
+        fds[i].revents = 0;
+    }
+
+    for(;;) {
+        int n = poll(poll_fds, nfds + 2, -1);
+        if(n == -1) {
+            if(errno == EINTR) continue; // The handler wrote in the self-pipe: poll again to see it
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        int events = 0;
+        if(poll_fds[0].revents & POLLIN) {
+            char drain[64];
+            while(read(self_pipe[PREAD], drain, sizeof(drain)) > 0) {}
+            events |= EVENT_CHILD;
+        }
+        if(poll_fds[1].revents & (POLLIN | POLLHUP | POLLERR)) events |= EVENT_CHILD;
+        for(size_t i = 0; i < nfds; i++) {
+            fds[i].revents = poll_fds[i + 2].revents;
+            if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) events |= EVENT_INPUT;
+        }
+        if(events) return events;
+    }
+}
+
+int event_wait(int fd) {
+    struct pollfd input = {.fd = fd, .events = POLLIN};
+    return event_wait_fds(&input, fd >= 0 ? 1 : 0);
+}
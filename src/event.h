@@ -0,0 +1,74 @@
+/*!
+ * \file event.h
+ * \brief Header file for the event loop of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The signal handlers do no work: they only write a byte in a "self-pipe". The main thread waits
+ * with poll(2) on this pipe and on an input file descriptor, then reaps the children itself,
+ * so the bookkeeping of the jobs never races with a handler.
+ */
+#ifndef FISH_EVENT_H
+#define FISH_EVENT_H
+
+#include <poll.h>
+#include <stddef.h>
+
+/*!
+ * \def EVENT_INPUT
+ * \brief Flag returned by event_wait(): the input file descriptor is readable.
+ */
+#define EVENT_INPUT 1
+/*!
+ * \def EVENT_CHILD
+ * \brief Flag returned by event_wait(): SIGCHLD was received, children are waiting to be reaped.
+ */
+#define EVENT_CHILD 2
+
+/*!
+ * \fn void event_init()
+ * \brief Create the self-pipe. Must be called before the signal handlers are installed.
+ *
+ * A child forked to run an internal command which waits for its own children must call it again,
+ * so the notifications of the parent and of the child are not mixed.
+ */
+void event_init();
+
+/*!
+ * \fn void event_notify()
+ * \brief Wake up event_wait(). Async-signal-safe: called by the SIGCHLD handler.
+ */
+void event_notify();
+
+/*!
+ * \fn void event_watch_children(int fd)
+ * \brief Also report EVENT_CHILD when fd is readable (the reports of the fork server, see zygote.h).
+ *
+ * The file descriptor is not read: the caller consumes it when it reaps the children.
+ *
+ * \param fd The file descriptor to watch, -1 to stop watching it.
+ */
+void event_watch_children(int fd);
+
+/*!
+ * \fn int event_wait(int fd)
+ * \brief Wait until fd is readable or a child changed of state.
+ *
+ * \param fd The input file descriptor to watch, -1 to only wait for children.
+ * \return A combination of EVENT_INPUT and EVENT_CHILD.
+ */
+int event_wait(int fd);
+
+/*!
+ * \fn int event_wait_fds(struct pollfd *fds, size_t nfds)
+ * \brief Wait until one of the file descriptors is ready or a child changed of state.
+ *
+ * Like event_wait() for several file descriptors: the revents fields of fds are set as poll(2) does.
+ *
+ * \param fds The file descriptors to watch, with the events wanted (a negative fd is ignored).
+ * \param nfds The number of elements of fds.
+ * \return A combination of EVENT_INPUT (at least one element of fds has revents) and EVENT_CHILD.
+ */
+int event_wait_fds(struct pollfd *fds, size_t nfds);
+
+#endif //FISH_EVENT_H
@@ -0,0 +1,296 @@
+/*!
+ * \file fdcopy.c
+ * \brief Implementation of the in-kernel copies between file descriptors, and of the internal commands cat and tee.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "fdcopy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*!
+ * \def FDCOPY_CHUNK
+ * \brief Maximal number of bytes moved by one splice() or sendfile().
+ */
+#define FDCOPY_CHUNK (1 << 20)
+
+/*!
+ * \def FDCOPY_BUFFER
+ * \brief Size of the buffer of the read() / write() fallback.
+ */
+#define FDCOPY_BUFFER (64 * 1024)
+
+/*!
+ * \fn static bool unsupported(int err)
+ * \brief Tell if a splice(), tee() or sendfile() failed because of the type of the descriptors.
+ */
+static bool unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF;
+}
+
+/*!
+ * \fn static int error_side(int err)
+ * \brief Tell which side of a failed splice() or sendfile() is responsible for the error.
+ *
+ * \return -2 for an error of the output, -1 otherwise.
+ */
+static int error_side(int err) {
+    return err == EPIPE || err == ENOSPC || err == EFBIG || err == EDQUOT ? -2 : -1;
+}
+
+/*!
+ * \fn static int write_all(int out, const char *buf, size_t len)
+ * \brief Write the whole buffer.
+ *
+ * \return 0 on success, -2 on a write error.
+ */
+static int write_all(int out, const char *buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(out, buf, len);
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) return -2;
+        buf += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+/*!
+ * \fn static int copy_rw(int in, int out, size_t limit)
+ * \brief Copy up to limit bytes from in to out with read() and write().
+ *
+ * \param limit The number of bytes to copy, SIZE_MAX to copy until the end of in.
+ * \return 0 on success, -1 on a read error, -2 on a write error.
+ */
+static int copy_rw(int in, int out, size_t limit) {
+    char buf[FDCOPY_BUFFER];
+    while(limit > 0) {
+        ssize_t n = read(in, buf, limit < sizeof(buf) ? limit : sizeof(buf));
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) return -1;
+        if(n == 0) return 0;
+        if(write_all(out, buf, (size_t) n)) return -2;
+        limit -= (size_t) n;
+    }
+    return 0;
+}
+
+int fdcopy(int in, int out) {
+    struct stat st_in, st_out;
+    if(fstat(in, &st_in) == -1) return -1;
+    if(fstat(out, &st_out) == -1) return -2;
+
+    if(S_ISFIFO(st_in.st_mode) || S_ISFIFO(st_out.st_mode)) {
+        for(;;) {
+            ssize_t n = splice(in, NULL, out, NULL, FDCOPY_CHUNK, SPLICE_F_MOVE);
+            if(n == 0) return 0;
+            if(n > 0 || errno == EINTR) continue;
+            if(unsupported(errno)) break;
+            return error_side(errno);
+        }
+    } else if(S_ISREG(st_in.st_mode)) {
+        for(;;) {
+            ssize_t n = sendfile(out, in, NULL, FDCOPY_CHUNK);
+            if(n == 0) return 0;
+            if(n > 0 || errno == EINTR) continue;
+            if(unsupported(errno)) break;
+            return error_side(errno);
+        }
+    }
+    return copy_rw(in, out, SIZE_MAX);
+}
+
+/*!
+ * \fn static int drain(int pipe_in, int out, size_t len, bool *use_splice)
+ * \brief Move exactly len bytes from a pipe of the shell to out.
+ *
+ * \param use_splice Whether splice() works on out, set to false the first time it does not.
+ * \return 0 on success, -2 on a write error.
+ */
+static int drain(int pipe_in, int out, size_t len, bool *use_splice) {
+    while(len > 0 && *use_splice) {
+        ssize_t n = splice(pipe_in, NULL, out, NULL, len, SPLICE_F_MOVE);
+        if(n > 0) len -= (size_t) n;
+        else if(n == -1 && errno == EINTR) continue;
+        else if(n == -1 && unsupported(errno)) *use_splice = false;
+        else return -2;
+    }
+    int err = copy_rw(pipe_in, out, len);
+    return err ? -2 : 0;
+}
+
+/*!
+ * \fn static int tee_rw(int in, const int outs[], size_t n_outs)
+ * \brief fdtee() with read() and write().
+ */
+static int tee_rw(int in, const int outs[], size_t n_outs) {
+    char buf[FDCOPY_BUFFER];
+    for(;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) return -1;
+        if(n == 0) return 0;
+        for(size_t i = 0; i < n_outs; ++i) {
+            if(write_all(outs[i], buf, (size_t) n)) return -2;
+        }
+    }
+}
+
+/*!
+ * \fn static int tee_pipe_rw(int pipe_in, size_t len, size_t skip, const int outs[], size_t n_outs)
+ * \brief Read the len bytes of a pipe of the shell and write them to every output, but the first skip bytes of outs[0].
+ *
+ * \return 0 on success, -1 on a read error, -2 on a write error.
+ */
+static int tee_pipe_rw(int pipe_in, size_t len, size_t skip, const int outs[], size_t n_outs) {
+    char buf[FDCOPY_BUFFER];
+    while(len > 0) {
+        ssize_t n = read(pipe_in, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if(n == -1 && errno == EINTR) continue;
+        if(n <= 0) return -1;
+        size_t skipped = skip < (size_t) n ? skip : (size_t) n;
+        if(write_all(outs[0], buf + skipped, (size_t) n - skipped)) return -2;
+        skip -= skipped;
+        for(size_t i = 1; i < n_outs; ++i) {
+            if(write_all(outs[i], buf, (size_t) n)) return -2;
+        }
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+int fdtee(int in, const int outs[], size_t n_outs) {
+    int data[2] = {-1, -1}, copy[2] = {-1, -1};
+    bool *use_splice = calloc(n_outs, sizeof(bool));
+    if(n_outs == 0 || use_splice == NULL || pipe2(data, O_CLOEXEC) == -1 || pipe2(copy, O_CLOEXEC) == -1) {
+        free(use_splice);
+        if(data[0] != -1) { close(data[0]); close(data[1]); }
+        return tee_rw(in, outs, n_outs);
+    }
+    for(size_t i = 0; i < n_outs; ++i) use_splice[i] = true;
+
+    int err = 0;
+    bool first = true, short_tee = false;
+    for(;;) {
+        ssize_t n = splice(in, NULL, data[1], NULL, FDCOPY_CHUNK, SPLICE_F_MOVE);
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1 && first && unsupported(errno)) { // nothing moved yet: in is not spliceable
+            err = tee_rw(in, outs, n_outs);
+            break;
+        }
+        if(n == -1) { err = -1; break; }
+        if(n == 0) break;
+        first = false;
+
+        // The data pipe is only consumed by the last output, the others get a duplicate of it
+        for(size_t i = 0; !err && !short_tee && i + 1 < n_outs; ++i) {
+            ssize_t m;
+            do {
+                m = tee(data[0], copy[1], (size_t) n, 0); // The copy pipe is empty and as large as the data pipe
+            } while(m == -1 && errno == EINTR);
+            size_t len = m > 0 ? (size_t) m : 0;
+            if(len > 0) err = drain(copy[0], outs[i], len, &use_splice[i]);
+            // tee() does not consume the data pipe, so a second call would duplicate its start again:
+            // after a short duplicate, the chunk and the rest of in are copied with read() and write()
+            if(!err && len < (size_t) n) {
+                short_tee = true;
+                err = tee_pipe_rw(data[0], (size_t) n, len, outs + i, n_outs - i);
+            }
+        }
+        if(!err && !short_tee) err = drain(data[0], outs[n_outs - 1], (size_t) n, &use_splice[n_outs - 1]);
+        if(!err && short_tee) err = tee_rw(in, outs, n_outs);
+        if(err || short_tee) break;
+    }
+
+    int saved_errno = errno;
+    close(data[0]); close(data[1]);
+    close(copy[0]); close(copy[1]);
+    free(use_splice);
+    errno = saved_errno;
+    return err;
+}
+
+int builtin_cat(char *args[], struct line *li) {
+    (void) li;
+    size_t first = 1;
+    if(args[first] != NULL && strcmp(args[first], "-u") == 0) ++first; // Never buffered anyway
+    fflush(stdout);
+
+    static char *stdin_only[] = {"-", NULL};
+    char **files = args[first] != NULL ? args + first : stdin_only;
+    int status = 0;
+    for(size_t i = 0; files[i] != NULL; ++i) {
+        int fd = STDIN_FILENO;
+        if(strcmp(files[i], "-") != 0) {
+            fd = open(files[i], O_RDONLY | O_CLOEXEC);
+            if(fd == -1) {
+                fprintf(stderr, "cat: %s: %s\n", files[i], strerror(errno));
+                status = 1;
+                continue;
+            }
+        }
+        int err = fdcopy(fd, STDOUT_FILENO);
+        if(err == -1) fprintf(stderr, "cat: %s: %s\n", files[i], strerror(errno));
+        if(fd != STDIN_FILENO) close(fd);
+        if(err == -2) {
+            if(errno != EPIPE) fprintf(stderr, "cat: write error: %s\n", strerror(errno));
+            return 1;
+        }
+        if(err) status = 1;
+    }
+    return status;
+}
+
+int builtin_tee(char *args[], struct line *li) {
+    (void) li;
+    size_t first = 1;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if(args[first] != NULL && strcmp(args[first], "-a") == 0) {
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        ++first;
+    }
+    fflush(stdout);
+
+    size_t n_files = 0;
+    while(args[first + n_files] != NULL) ++n_files;
+    int *outs = malloc((n_files + 1) * sizeof(int));
+    if(outs == NULL) { perror("tee"); return 1; }
+
+    int status = 0;
+    size_t n_outs = 0;
+    outs[n_outs++] = STDOUT_FILENO;
+    for(size_t i = 0; i < n_files; ++i) {
+        int fd = open(args[first + i], flags, 0644);
+        if(fd == -1) {
+            fprintf(stderr, "tee: %s: %s\n", args[first + i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        outs[n_outs++] = fd;
+    }
+
+    int err = fdtee(STDIN_FILENO, outs, n_outs);
+    if(err == -1) fprintf(stderr, "tee: read error: %s\n", strerror(errno));
+    if(err == -2 && errno != EPIPE) fprintf(stderr, "tee: write error: %s\n", strerror(errno));
+    if(err) status = 1;
+
+    for(size_t i = 1; i < n_outs; ++i) close(outs[i]);
+    free(outs);
+    return status;
+}
@@ -0,0 +1,64 @@
+/*!
+ * \file fdcopy.h
+ * \brief Header file for the in-kernel copies between file descriptors, and the internal commands cat and tee.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The data is moved with splice(2), tee(2) and sendfile(2), so it is never copied in the memory of the
+ * process: a "cat big.log | grep x" stage costs a fork() instead of a fork() + execv() of /bin/cat,
+ * and no read()/write() of every byte. When the kernel refuses the file descriptors (a terminal,
+ * a file opened with O_APPEND...), the copy falls back to read() and write().
+ */
+#ifndef FISH_FDCOPY_H
+#define FISH_FDCOPY_H
+
+#include <stddef.h>
+
+#include "cmdline.h"
+
+/*!
+ * \fn int fdcopy(int in, int out)
+ * \brief Copy everything from in to out, until the end of in.
+ *
+ * splice() is used when one of the descriptors is a pipe, sendfile() when in is a regular file.
+ *
+ * \param in The descriptor to read.
+ * \param out The descriptor to write.
+ * \return 0 on success, -1 on a read error, -2 on a write error (errno is set).
+ */
+int fdcopy(int in, int out);
+
+/*!
+ * \fn int fdtee(int in, const int outs[], size_t n_outs)
+ * \brief Copy everything from in to every descriptor of outs, until the end of in.
+ *
+ * The data is spliced from in into a pipe of the shell, duplicated with tee() into a second pipe for
+ * every output but the last one, and spliced from there to the outputs. If tee() duplicates only a
+ * part of a chunk, the rest of the copy is done with read() and write().
+ *
+ * \param in The descriptor to read.
+ * \param outs The descriptors to write.
+ * \param n_outs The number of descriptors in outs.
+ * \return 0 on success, -1 on a read error, -2 on a write error (errno is set).
+ */
+int fdtee(int in, const int outs[], size_t n_outs);
+
+/*!
+ * \fn int builtin_cat(char *args[], struct line *li)
+ * \brief cat [-u] [file...]: copy the files (or the standard input, also named "-") to the standard output.
+ *
+ * \return 0 on success, 1 if a file cannot be read or the output cannot be written.
+ */
+int builtin_cat(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_tee(char *args[], struct line *li)
+ * \brief tee [-a] [file...]: copy the standard input to the standard output and to the files.
+ *
+ * The files are truncated, unless -a is given.
+ *
+ * \return 0 on success, 1 if a file cannot be opened or written.
+ */
+int builtin_tee(char *args[], struct line *li);
+
+#endif //FISH_FDCOPY_H
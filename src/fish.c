@@ -37,11 +37,28 @@
 #include <errno.h>
 #include <pwd.h>
 #include <limits.h>
+#include <fcntl.h>
 
 
 #include "fish.h"
 #include "cmdline.h"
 #include "utils.h"
+#include "launcher.h"
+#include "cmdhash.h"
+#include "reader.h"
+#include "prompt.h"
+#include "event.h"
+#include "jobctl.h"
+#include "builtins.h"
+#include "pipeopt.h"
+#include "timing.h"
+#include "trace.h"
+#include "zygote.h"
+#include "editor.h"
+#include "complete.h"
+#include "history.h"
+#include "glob.h"
+#include "vars.h"
 
 /*!
  * \var bool debug
@@ -50,39 +67,103 @@
 volatile bool debug = false;
 
 /**
- * \var volatile struct bg_data background_data
- * \brief Global instance of background_data.
- * This variable is used to store the background processes data.
+ * \var struct job_table jobs
+ * \brief Table of the processes started by the shell, in foreground and in background.
+ * The SIGCHLD handler reaps the processes and records their status in this table.
  */
-volatile struct bg_data background_data;
+struct job_table jobs;
+
+
+/*!
+ * \var bool interactive
+ * \brief true when the shell reads commands typed by the user on a terminal.
+ * A non-interactive shell (fish -c, fish script, or stdin not being a TTY) prints no banner, no prompt
+ * and no report of the commands exit statuses.
+ */
+bool interactive = false;
+
+/*!
+ * \var bool exit_on_error
+ * \brief Flag set by the option -e: exit as soon as a line cannot be parsed or a command fails.
+ */
+bool exit_on_error = false;
+
+
+/*!
+ * \fn static void usage(const char *progname)
+ * \brief Print the usage of the shell on stderr.
+ */
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [-e] [-c command | script]\n", progname);
+    fprintf(stderr, "  -c command  execute the command (one or more lines) and exit\n");
+    fprintf(stderr, "  -e          exit as soon as a line is invalid or a command fails\n");
+    fprintf(stderr, "  script      execute the lines of the file script and exit\n");
+}
 
 
 /**
  * \brief Main function of the FiSH shell.
  * This function is the main loop of the shell. It reads the command line entered by the user,
- * parses it, and executes the commands.
- * The shell supports the following internal commands:
+ * parses it, and executes the commands. The lines are read with a buffered reader (see reader.h),
+ * so their length is not limited, and the shell exits at the end of its input.
+ * The shell supports internal commands (see builtins.h), such as:
  * - exit: exit the shell
  * - cd: change the current working directory
+ * - echo, printf, test, true, false, pwd: run without fork()
  * The shell also supports the following redirections:
  * - input redirection (<)
  * - output redirection (>)
  * - output redirection in append mode (>>)
  *
- * \return  0 if the program ends correctly, <br>
- *          1 otherwise
+ * The lines are read from the string given with -c, from the file given as argument, or from stdin.
+ * The shell is interactive only when it reads stdin and stdin is a TTY.
+ *
+ * \param argc The number of arguments.
+ * \param argv The arguments (see usage).
+ * \return  the status of the last command at the end of the input (see shell_exit_status), <br>
+ *          1 if an error occurs, 2 if the arguments are invalid
  */
-int main() {
-    char current_dir[PATH_MAX];
-    char *exit_color = RESET;
-
-    init_background_data(background_data);
+int main(int argc, char *argv[]) {
+    char *command = NULL;
+
+    int opt;
+    while((opt = getopt(argc, argv, "+c:eh")) != -1) {
+        switch(opt) {
+            case 'c':
+                command = optarg;
+                break;
+            case 'e':
+                exit_on_error = true;
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                usage(argv[0]);
+                exit(2);
+        }
+    }
+    if(command != NULL && optind < argc) { usage(argv[0]); exit(2); }
+
+    struct reader input;
+    if(command != NULL) {
+        if(reader_init_string(&input, command) == -1) { perror("reader_init_string"); exit(EXIT_FAILURE); }
+    } else if(optind < argc) {
+        int fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if(fd == -1) { perror(argv[optind]); exit(127); }
+        reader_init(&input, fd);
+    } else {
+        reader_init(&input, STDIN_FILENO);
+        interactive = isatty(STDIN_FILENO);
+    }
 
+    job_table_init(&jobs);
 
-    printf(YELLOW BOLD "\n       _______ _________ _______          \n      (  ____ \\\\__   __/(  ____ \\|\\     /|\n      | (    \\/   ) (   | (    \\/| )   ( |\n      | (__       | |   | (_____ | (___) |\n      |  __)      | |   (_____  )|  ___  |\n      | (         | |         ) || (   ) |\n      | )      ___) (___/\\____) || )   ( |\n      |/       \\_______/\\_______)|/     \\|\n\n\n" RESET);
+    if(interactive) {
+        printf(YELLOW BOLD "\n       _______ _________ _______          \n      (  ____ \\\\__   __/(  ____ \\|\\     /|\n      | (    \\/   ) (   | (    \\/| )   ( |\n      | (__       | |   | (_____ | (___) |\n      |  __)      | |   (_____  )|  ___  |\n      | (         | |         ) || (   ) |\n      | )      ___) (___/\\____) || )   ( |\n      |/       \\_______/\\_______)|/     \\|\n\n\n" RESET);
+    }
 
     struct line li;
-    char buf[BUFLEN];
     line_init(&li);
 
 
@@ -91,6 +172,7 @@ int main() {
     struct standard_signals sigs = manage_sigaction();
 
     struct sigaction sa_standard_SIGINT = sigs.sigint;
+    jobctl_init();
     // sa_standard_SIGCHLD is no longer used.
     // struct sigaction sa_standard_SIGCHLD = sigs.sigchld;
 
@@ -99,94 +181,219 @@ int main() {
     if (home == NULL) /* -> */ home = user_data->pw_dir;
 
     char *username = user_data->pw_name;
+    prompt_init(username, home);
+
+    char *launcher = getenv("FISH_LAUNCHER");
+    if(launcher != NULL && !launch_backend_parse(launcher, &launch_backend)) {
+        fprintf(stderr, "FISH_LAUNCHER: unknown backend '%s', using %s\n", launcher, launch_backend_name(launch_backend));
+    }
+    if(launch_backend == LAUNCH_ZYGOTE && zygote_start() == -1) {
+        perror("FISH_LAUNCHER: fork server");
+        launch_backend = LAUNCH_FORK;
+    }
+
+    char *trace_file = getenv("FISH_TRACE");
+    if(trace_file != NULL && trace_file[0] != '\0' && trace_start(trace_file) == -1) {
+        fprintf(stderr, "FISH_TRACE: %s: %s\n", trace_file, strerror(errno));
+    }
+
+    // The lines typed on a terminal are read by the line editor, and recorded in the history
+    struct editor editor;
+    editor_init(&editor, input.fd);
+    errno = 0;
+    if(interactive && history_open_default() == -1 && errno != 0) perror("history");
 
     for (;;) {
-        if(getcwd(current_dir, sizeof(current_dir)) == NULL) {
-            perror("getcwd (current_dir)");
-            exit(EXIT_FAILURE);
+        if(interactive) editor_start(&editor, last_status_code);
+
+        // Wait for a line while reporting the background jobs as soon as they finish
+        uint64_t trace_read = TRACE_NOW();
+        while(interactive ? !editor_has_line(&editor) : !reader_has_line(&input)) {
+            int events = wait_events(input.fd);
+            if(events & EVENT_CHILD && interactive && jobs.finished_head != JOB_NONE) {
+                fprintf(stderr, "\n"); // The prompt is interrupted
+                print_backgrounds_processes();
+                editor_redraw(&editor);
+            } else if(events & EVENT_CHILD) {
+                print_backgrounds_processes();
+            }
+            if(events & EVENT_INPUT && interactive) editor_read(&editor);
+            else if(events & EVENT_INPUT) break;
         }
-        substitute_home(current_dir, home);
 
-        switch(last_status_code) {
-            case 0:
-            case -3:
-                exit_color = GREEN;
-                break;
-            case -1:
-                exit_color = GRAY;
-                break;
-            case 127:
-            case -2:
-            default:
-                exit_color = RED;
-                break;
+        char *buf;
+        ssize_t len = interactive ? editor_next_line(&editor, &buf) : reader_next_line(&input, &buf);
+        if(len < 0) {
+            if(len == -2) perror("read");
+            jobctl_hangup();
+            line_reset(&li);
+            line_cache_clear();
+            editor_destroy(&editor);
+            history_close();
+            reader_destroy(&input);
+            exit(shell_exit_status(last_status_code));
         }
 
-        if(last_status_code > 256) {
-            asprintf(&exit_color, RED "(" YELLOW "%d" RED ") ", last_status_code - 256);
-        }
+        TRACE_COMPLETE("read line", trace_read, NULL, len);
 
-        printf(YELLOW "FiSH " GRAY "➔" GREEN ITALIC " %s " RESET GRAY "➔" BLUE " %s" RESET "\n\t%s■ " RESET "➔ ", username, current_dir, exit_color);
-        fgets(buf, BUFLEN, stdin);
+        struct timespec accepted = {0, 0}, started = {0, 0}; // Only recorded in the history of an interactive shell
+        if(interactive) {
+            clock_gettime(CLOCK_REALTIME, &accepted);
+            clock_gettime(CLOCK_MONOTONIC, &started);
+        }
 
-        int err = line_parse(&li, buf);
+        uint64_t trace_parse = TRACE_NOW();
+        int err = line_parse_cached(&li, buf);
+        TRACE_COMPLETE("parse", trace_parse, buf, err);
         if (err) {
             //the command line entered by the user isn't valid
+            last_status_code = 2;
+        } else {
+            if(debug) {
+                for(struct line *pipeline = &li; pipeline != NULL; pipeline = pipeline->next) print_debug_line(pipeline);
+                line_cache_print(stderr);
+            }
+            run_list(&li, &sa_standard_SIGINT, &last_status_code);
+        }
+        line_clear(&li);
+
+        if(interactive) {
+            struct timespec finished;
+            clock_gettime(CLOCK_MONOTONIC, &finished);
+            history_add(buf, (int64_t) accepted.tv_sec * 1000000 + accepted.tv_nsec / 1000,
+                        (int64_t) (finished.tv_sec - started.tv_sec) * 1000000 + (finished.tv_nsec - started.tv_nsec) / 1000,
+                        last_status_code);
+        }
+
+        if(exit_on_error && shell_exit_status(last_status_code) != 0) {
+            jobctl_hangup();
             line_reset(&li);
-            continue;
+            line_cache_clear();
+            editor_destroy(&editor);
+            history_close();
+            reader_destroy(&input);
+            exit(shell_exit_status(last_status_code));
         }
+    }
+}
 
-        if(debug) print_debug_line(&li);
 
-        size_t number_of_cmds = li.n_cmds;
-        struct pipe_control pc;
-        init_pipe_control(&pc);
+/*!
+ * \fn void run_list(struct line *li, struct sigaction *standardSigintAction, int *last_status_code)
+ * \brief Execute the pipelines of a parsed command list.
+ *
+ * A pipeline joined by "&&" is skipped if the status of the last executed pipeline is not 0, and one joined
+ * by "||" is skipped if it is 0. A skipped pipeline keeps the status, so "false && a && b || c" runs c.
+ * The rest of the list is abandoned when a foreground pipeline is killed by SIGINT.
+ *
+ * \param li The first pipeline of the list.
+ * \param standardSigintAction The action to execute when the SIGINT signal is received.
+ * \param last_status_code The status of the last command, updated (see execute_command_with_args).
+ */
+void run_list(struct line *li, struct sigaction *standardSigintAction, int *last_status_code) {
+    for(struct line *pipeline = li; pipeline != NULL; pipeline = pipeline->next) {
+        int status = shell_exit_status(*last_status_code);
+        if(pipeline->connector == LINE_AND && status != 0) continue;
+        if(pipeline->connector == LINE_OR && status == 0) continue;
+        run_line(pipeline, standardSigintAction, last_status_code);
+        if(*last_status_code == 256 + SIGINT) break;
+    }
+}
 
-        pid_t child_pids_foregrounds[MAX_CMDS];
-        size_t num_child_pids = 0;
 
-        for (size_t i = 0; i < number_of_cmds; i++) {
-            if (li.cmds[i].n_args > 0) {
-                pid_t child_pid = execute_command_with_args(li.cmds[i].args[0], li.cmds[i].args, &sa_standard_SIGINT,
-                                                            &li, &pc, i, &last_status_code);
-                if (child_pid > 0 || child_pid == -2) {
-                    child_pids_foregrounds[num_child_pids++] = child_pid;
-                }
-            }
-        }
-        for(size_t i = 0; i < num_child_pids; i++) {
-            pid_t child_pid = child_pids_foregrounds[i];
-            if(child_pid == -2) continue; // Internal command.
-            int status;
-            if(debug) printf("Waiting for %d\n", child_pid);
-            if (waitpid(child_pid, &status, 0) == -1) perror("Waitpid");
-            else {
-                if (WIFEXITED(status)) {
-                    int exit_status = WEXITSTATUS(status);
-                    fprintf(stderr, " FG: Command `%d` exited with status %d\n", child_pid, exit_status);
-                    last_status_code = exit_status;
-                } else if (WIFSIGNALED(status)) {
-                    int term_sig = WTERMSIG(status);
-                    fprintf(stderr, " FG: Command `%d` killed by signal %d\n", child_pid, term_sig);
-                    last_status_code = 256 + term_sig;
-                }
-            }
-            print_backgrounds_processes();
+/*!
+ * \fn void run_line(struct line *li, struct sigaction *standardSigintAction, int *last_status_code)
+ * \brief Execute the commands of a parsed line and wait for the foreground ones.
+ *
+ * \param li The parsed line.
+ * \param standardSigintAction The action to execute when the SIGINT signal is received.
+ * \param last_status_code The status of the last command, updated (see execute_command_with_args).
+ */
+void run_line(struct line *li, struct sigaction *standardSigintAction, int *last_status_code) {
+    vars_expand_line(li, shell_exit_status(*last_status_code));
+    struct pipe_control pc;
+    init_pipe_control(&pc);
+    pc.options = pipe_defaults;
+    bool timed = li->n_cmds > 0 && time_prefix(&li->cmds[0]);
+    if(li->n_cmds > 0 && pipe_options_prefix(&li->cmds[0], &pc.options) == -1) {
+        vars_restore_line();
+        *last_status_code = 2;
+        return;
+    }
+
+    char *text = line_to_text(li);
+    if(text == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    // The patterns are expanded after the text of the job is made, so "jobs" shows them as typed
+    struct glob_state globs;
+    glob_init(&globs);
+    uint64_t glob_start = TRACE_NOW();
+    if(glob_line(&globs, li) > 0) {
+        TRACE_COMPLETE("glob", glob_start, NULL, (long) (globs.argv_len - globs.n_saved));
+        if(debug) glob_print_stats(&globs, stderr);
+    }
+    size_t group = job_group_new(&jobs, text, li->background);
+    if(group == JOB_NONE) { perror("realloc"); exit(EXIT_FAILURE); }
+    jobs.groups[group].timed = (timed || time_always) && !li->background;
+    struct rusage self_usage; // An internal command run by the shell itself is timed with its CPU time
+    if(jobs.groups[group].timed && getrusage(RUSAGE_SELF, &self_usage) == -1) jobs.groups[group].timed = false;
+    uint64_t trace_start = TRACE_NOW();
+    char *trace_text = trace_enabled ? strdup(text) : NULL; // text is freed with the job
+
+    for (size_t i = 0; i < li->n_cmds; i++) {
+        struct cmd *cmd = &li->cmds[i];
+        size_t assignments = vars_assignments(li, i);
+        if (cmd->n_args > 0 && assignments == cmd->n_args && li->n_cmds == 1 && !li->background) {
+            vars_assign(cmd->args, assignments); // "NAME=value" alone sets a shell variable
+            *last_status_code = 0;
+        } else if (cmd->n_args > 0) {
+            // In a pipeline or in background, the assignments alone only affect a "true"
+            static char *true_args[] = {"true", NULL};
+            char **args = assignments < cmd->n_args ? cmd->args + assignments : true_args;
+            char **envp = assignments > 0 ? vars_envp_with(cmd->args, assignments) : vars_envp();
+            execute_command_with_args(args[0], args, standardSigintAction, li, &pc, i, group, last_status_code, envp);
+            if(assignments > 0) free(envp);
         }
+    }
+    close_pipe(pc.pipe_prev);
+
+    if(jobs.groups[group].procs == 0) { // Only internal commands, or no command could be started
+        if(jobs.groups[group].timed) time_report(group, &self_usage);
+        job_group_release(&jobs, group);
+    } else if(!li->background) {
+        if(debug) printf("Waiting for job %d (pgid %d)\n", jobs.groups[group].id, jobs.groups[group].pgid);
+        jobctl_wait_foreground(group, last_status_code);
+    }
+    TRACE_COMPLETE("pipeline", trace_start, trace_text, *last_status_code);
+    free(trace_text);
+    glob_release(&globs, li);
+    vars_restore_line();
+    print_backgrounds_processes();
+}
 
-        close_pipe(pc.pipe_prev);
 
-        line_reset(&li);
-    }
+/*!
+ * \fn int shell_exit_status(int last_status_code)
+ * \brief Convert the status of the last command into the exit status of the shell.
+ *
+ * \param last_status_code The status of the last command, as set by execute_command_with_args.
+ * \return The exit status of a command which exited, 128 + the signal number of a killed command,
+ *         0 for an internal or a background command.
+ */
+int shell_exit_status(int last_status_code) {
+    if(last_status_code > 256) return 128 + last_status_code - 256;
+    if(last_status_code < 0) return 0;
+    return last_status_code;
 }
 
 
 /*!
- * \fn pid_t execute_command_with_args(char *cmd, char *args[], struct sigaction *standardSigintAction, struct line *line, struct pipe_control *pipeControl, size_t cmd_index, int *exit_code)
+ * \fn pid_t execute_command_with_args(char *cmd, char *args[], struct sigaction *standardSigintAction, struct line *line, struct pipe_control *pipeControl, size_t cmd_index, size_t group, int *exit_code, char **envp)
  * \brief Execute a command with its arguments.
  *
  * This function executes the command given in argument with its arguments.
- * It also handles the input and output redirections, the background execution, and the internal commands.
+ * It also handles the input and output redirections, the background execution, and the internal commands
+ * (see builtins.h): a foreground line made of one internal command runs it in the shell, a pipeline
+ * or a background line forks it.
  *
  *
  * \param cmd The command to execute.
@@ -195,15 +402,22 @@ int main() {
  * \param line The line structure of the command executed.
  * \param pipeControl The pipe control structure.
  * \param cmd_index The index of the command in the line structure.
+ * \param group The job group of the line (see job_group_new). With job control, the first command creates
+ *              the process group of the job and the following ones join it.
  *
  * \param exit_code The exit code of the command.<br>
- *                  If the command is an internal command, the exit code is set to -3.<br>
+ *                  If the command is an internal command run by the shell, the exit code is its status.<br>
  *                  If the command is not found, the exit code is set to 127.<br>
  *                  If the command is killed, the exit code is set to 256 + the signal number.<br>
  *                  Otherwise, the exit code is set to the status of the command. (0 if the command is successful, another value otherwise)<br>
  *                  The exit code is stored in the variable pointed by this parameter.<br>
  *                  If the command is executed in background, the exit code is set to -1<br>
  *                  By default, if any of theses cases does not occur, the exit code is set to -2.
+ * \param envp The environment of the command (see vars_envp), ignored by the internal commands run in the shell.
+ *
+ * The command is resolved through the PATH cache (see cmdhash.h) and started on its absolute path,
+ * with the backend selected by the internal command "launcher" (see launcher.h).
+ * Both backends apply the input redirection to the first command and the output redirection to the last one.
  *
  *  \return The PID of the child process if the command is executed in foreground,
  *          0 if executed in background,
@@ -217,159 +431,285 @@ pid_t execute_command_with_args(
             struct line *line,
             struct pipe_control *pipeControl,
             size_t cmd_index,
-            int *exit_code
+            size_t group,
+            int *exit_code,
+            char **envp
         ) {
 
-    if (manage_intern_cmd(cmd, args, line)){
-        *exit_code = -3;
+    // An internal command runs in the shell, unless it has to run at the same time as the other commands
+    // of a pipeline or as the shell itself (in background)
+    const struct builtin *builtin = builtin_find(cmd);
+    if (builtin != NULL && line->n_cmds == 1 && !line->background && !builtin->forked) {
+        *exit_code = builtin_run(builtin, args, line);
         return -2;
     }
 
     bool not_the_last_one = (cmd_index < line->n_cmds - 1); // true if the command is not the last one
-    if (not_the_last_one && pipe(pipeControl->pipe_next) == -1) { perror("pipe"); exit(EXIT_FAILURE); }
+    if (not_the_last_one && pipe_open(pipeControl->pipe_next, &pipeControl->options) == -1) { perror("pipe"); exit(EXIT_FAILURE); }
+    if (not_the_last_one) TRACE_INSTANT("pipe", NULL, pipeControl->pipe_next[PWRITE]);
+    if (not_the_last_one && debug) {
+        fprintf(stderr, "\tpipe %zu -> %zu: %d bytes%s\n", cmd_index, cmd_index + 1,
+                fcntl(pipeControl->pipe_next[PWRITE], F_GETPIPE_SZ), pipeControl->options.packet ? ", packet mode" : "");
+    }
 
     bool background = line->background;
 
-    if(!background) { // If the command is not executed in background, the SIGINT signal is 'un-ignored'. The previous action was ignore and its action is saved in ign_sa
-        if(sigaction(SIGINT, standardSigintAction, NULL) == -1) {
-            perror("sigaction background");
-            exit(EXIT_FAILURE);
-        }
-    }
-    pid_t pid = fork();
-    if(pid == -1) { perror("fork"); exit(EXIT_FAILURE); }
+    // With job control, the first command creates the process group of the job (0), the others join it
+    pid_t pgid = job_control ? jobs.groups[group].pgid : -1;
+
+    pid_t pid = -1;
+    int err = ENOTSUP; // Stays ENOTSUP when the fork backend has to start the command
+    uint64_t trace_launch = TRACE_NOW();
+    struct timespec launched; // The fork server may reap the command before the shell adds it to the table
+    if(launch_backend == LAUNCH_ZYGOTE) clock_gettime(CLOCK_MONOTONIC, &launched);
+    const char *path = builtin != NULL ? NULL : cmdhash_lookup(cmd);
+    if(builtin == NULL && path == NULL) {
+        fprintf(stderr, "%s: Command not found\n", cmd);
+    } else if(builtin == NULL && launch_backend != LAUNCH_FORK
+              && (err = launch_backend == LAUNCH_SPAWN
+                        ? spawn_command(&pid, path, args, line, pipeControl, cmd_index, background, pgid, envp)
+                        : zygote_command(&pid, path, args, line, pipeControl, cmd_index, background, pgid, envp)) != 0
+              && err != ENOTSUP) {
+        report_spawn_error(cmd, line, err);
+        pid = -1;
+    } else if(err == ENOTSUP) {
+        fflush(stdout); // The child must not write again what the shell printed
+        pid = fork();
+        if(pid == -1) { perror("fork"); exit(EXIT_FAILURE); }
+        if(pid > 0) TRACE_COMPLETE("fork", trace_launch, cmd, pid);
+
+        if (pid == 0) { // Child process
+            // The shell ignores SIGINT: a foreground command gets its standard action back
+            if(!background && sigaction(SIGINT, standardSigintAction, NULL) == -1) { perror("sigaction"); exit(EXIT_FAILURE); }
+            if(pgid != -1) {
+                // Done by the parent too: the process group must exist before any of them relies on it
+                if(setpgid(0, pgid) == -1) { perror("setpgid"); exit(EXIT_FAILURE); }
+                if(pgid == 0 && !background && tcsetpgrp(STDIN_FILENO, getpid()) == -1) { perror("tcsetpgrp"); exit(EXIT_FAILURE); }
+                struct sigaction sa_default;
+                sigemptyset(&sa_default.sa_mask);
+                sa_default.sa_flags = 0;
+                sa_default.sa_handler = SIG_DFL;
+                sigaction(SIGTSTP, &sa_default, NULL);
+                sigaction(SIGTTIN, &sa_default, NULL);
+                sigaction(SIGTTOU, &sa_default, NULL);
+            }
 
-    if(debug && pid != 0) fprintf(stderr, "\tpid created %d\n", pid);
+            char *file_input = (cmd_index == 0) ? line->file_input : NULL;
 
-    if (pid == 0) { // Child process
-        char *file_input = line->file_input;
+            if(background && cmd_index == 0 && file_input == NULL) {
+                file_input = "/dev/null";
+            }
 
-        if(background && file_input == NULL) {
-            file_input = "/dev/null";
-        }
+            if (pipeControl->pipe_prev[PREAD] != -1) { // it isn't -1 when the command isn't the first one
+                dup2(pipeControl->pipe_prev[PREAD], STDIN_FILENO);
+                close(pipeControl->pipe_prev[PREAD]);  // Close duplicated descriptors
+            }
 
-        if (pipeControl->pipe_prev[PREAD] != -1) { // it isn't -1 when the command isn't the first one
-            dup2(pipeControl->pipe_prev[PREAD], STDIN_FILENO);
-            close(pipeControl->pipe_prev[PREAD]);  // Close duplicated descriptors
-        }
+            // Setup output to next command if not the last command
+            if (not_the_last_one) {
+                dup2(pipeControl->pipe_next[PWRITE], STDOUT_FILENO);
+                close(pipeControl->pipe_next[PWRITE]);  // Close duplicated descriptors
+                close(pipeControl->pipe_next[PREAD]);  // Close unused read end
+            }
 
-        // Setup output to next command if not the last command
-        if (not_the_last_one) {
-            dup2(pipeControl->pipe_next[PWRITE], STDOUT_FILENO);
-            close(pipeControl->pipe_next[PWRITE]);  // Close duplicated descriptors
-            close(pipeControl->pipe_next[PREAD]);  // Close unused read end
-        }
 
+            manage_file_input(file_input);
+            manage_file_output(not_the_last_one ? NULL : line->file_output, line->file_output_append);
 
-        manage_file_input(file_input);
-        manage_file_output(line->file_output, line->file_output_append);
+            if(builtin != NULL) {
+                event_init();
+                exit(shell_exit_status(builtin->fn(args, line)));
+            }
 
-        // Execute the command with its arguments
-        if (execvp(cmd, args) == -1) {
+            // Execute the command with its arguments
+            execve(path, args, envp);
             if(errno == ENOENT) {
                 fprintf(stderr, "%s: Command not found\n", cmd);
             } else {
                 char *msg;
-                asprintf(&msg, "execvp of command '%s'", cmd);
+                asprintf(&msg, "execve of command '%s'", cmd);
                 perror(msg);
                 free(msg);
             }
             exit(102);
         }
-    } else { // Parent process
-        apply_ignore(SIGINT, NULL);
+    }
 
-        if (pipeControl->pipe_prev[PREAD] != -1) {
-            close(pipeControl->pipe_prev[PREAD]); // Always close previous read end in parent
-        }
+    // Parent process
+    if(pid > 0 && err == 0) TRACE_COMPLETE(launch_backend == LAUNCH_SPAWN ? "spawn" : "zygote", trace_launch, cmd, pid);
+    if(pid > 0 && pgid != -1) {
+        if(pgid == 0) jobs.groups[group].pgid = pid;
+        setpgid(pid, jobs.groups[group].pgid); // Fails harmlessly if the child already called execve(), or is not ours
+        if(pgid == 0 && !background) jobctl_foreground(group);
+    }
+    if(debug && pid > 0) {
+        fprintf(stderr, "\tpid created %d (%s, pgid %d)\n", pid, err == ENOTSUP ? "fork" : launch_backend_name(launch_backend),
+                jobs.groups[group].pgid);
+    }
 
-        if (not_the_last_one) {
-            close(pipeControl->pipe_next[PWRITE]); // Close next write end in parent after forking
-        }
+    if (pipeControl->pipe_prev[PREAD] != -1) {
+        close(pipeControl->pipe_prev[PREAD]); // Always close previous read end in parent
+    }
 
+    if (not_the_last_one) {
+        close(pipeControl->pipe_next[PWRITE]); // Close next write end in parent after forking
+    }
 
-        // Move pipe_next to pipe_prev for the next command
-        pipeControl->pipe_prev[PREAD] = pipeControl->pipe_next[PREAD];
-        pipeControl->pipe_prev[PWRITE] = pipeControl->pipe_next[PWRITE];
-        pipeControl->pipe_next[PREAD] = -1;
-        pipeControl->pipe_next[PWRITE] = -1;
 
-        if (background) {
-            printf(" BG: Command `%d` running in background\n", pid);
-            *exit_code = -1;
-            background_data.bg_array[background_data.bg_array_size++] = pid;
-            return 0;
-        } else {
-            return pid;
-        }
+    // Move pipe_next to pipe_prev for the next command
+    pipeControl->pipe_prev[PREAD] = pipeControl->pipe_next[PREAD];
+    pipeControl->pipe_prev[PWRITE] = pipeControl->pipe_next[PWRITE];
+    pipeControl->pipe_next[PREAD] = -1;
+    pipeControl->pipe_next[PWRITE] = -1;
+
+    if (pid == -1) {
+        *exit_code = 127;
+        return -1;
+    }
+
+    size_t slot = job_add(&jobs, pid, background, group);
+    if (slot == JOB_NONE) {
+        fprintf(stderr, "Memory allocation failure: `%d` is not tracked\n", pid);
+    } else {
+        jobs.slots[slot].stage = cmd_index;
+        if(err == 0 && launch_backend == LAUNCH_ZYGOTE) jobs.slots[slot].started = launched;
+    }
+
+    if (background) {
+        if(interactive) printf(" BG: Command `%d` running in background\n", pid);
+        *exit_code = -1;
+        return 0;
     }
-    *exit_code = -2;
-    return -1;
+    return pid;
 }
 
 
 /*!
- * \fn bool manage_intern_cmd(char *cmd, char *args[], struct line *li)
- * \brief Manage the internal commands of the shell.
+ * \fn int builtin_exit(char *args[], struct line *li)
+ * \brief exit [n]: exit the shell with the status n (0 by default).
  *
- * The internals commands are the following:
- * - exit: exit the shell
- * - cd: change the current working directory
- *
- * \param cmd the command to manage
  * \param args the arguments of the command
- * \param li the line structure of the command executed (used to line_reset (free) the structure if the command is exit)
- * \return bool true if the command is an internal command, false otherwise
+ * \param li the line structure of the command executed (line_reset (free) before exiting)
+ * \return 1 if there are too many arguments (the shell does not exit)
  */
-bool manage_intern_cmd(char *cmd, char *args[], struct line *li) {
-    if(strcmp(cmd, "exit") == 0) {
-        int exit_n = 0;
-        if(args[1] != NULL) {
-            exit_n = atoi(args[1]);
-            if(args[2] != NULL) {
-                fprintf(stderr, "exit: too many arguments\n");
-                return true;
-            }
+int builtin_exit(char *args[], struct line *li) {
+    int exit_n = 0;
+    if(args[1] != NULL) {
+        exit_n = atoi(args[1]);
+        if(args[2] != NULL) {
+            fprintf(stderr, "exit: too many arguments\n");
+            return 1;
         }
-        line_reset(li);
-        exit(exit_n);
     }
+    jobctl_hangup();
+    line_reset(li);
+    exit(exit_n);
+}
 
-    if(strcmp(cmd, "cd") == 0) {
-        if(args[2] != NULL) {
-            fprintf(stderr, "cd: too many arguments\n");
-            return true;
-        }
-        cd(args[1]);
-        return true;
+/*!
+ * \fn int builtin_cd(char *args[], struct line *li)
+ * \brief cd [path]: change the current working directory (see cd).
+ */
+int builtin_cd(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "cd: too many arguments\n");
+        return 1;
     }
+    return cd(args[1]);
+}
 
-    if(strcmp(cmd, "debug") == 0) {
-        if(args[2] != NULL) {
-            fprintf(stderr, "debug: too many arguments\n");
-            return true;
+/*!
+ * \fn int builtin_debug(char *args[], struct line *li)
+ * \brief debug: toggle the debug mode.
+ */
+int builtin_debug(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL) {
+        fprintf(stderr, "debug: too many arguments\n");
+        return 1;
+    }
+    debug = !debug;
+    fprintf(stderr, "Debug mode %s\n", YES_NO(debug));
+    return 0;
+}
+
+/*!
+ * \fn int builtin_launcher(char *args[], struct line *li)
+ * \brief launcher [fork|spawn|zygote]: print or select the backend used to start the commands.
+ *
+ * Selecting zygote starts the fork server if it is not running (see zygote.h).
+ */
+int builtin_launcher(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "launcher: too many arguments\n");
+        return 1;
+    }
+    enum launch_backend backend = launch_backend;
+    if(args[1] != NULL && !launch_backend_parse(args[1], &backend)) {
+        fprintf(stderr, "launcher: unknown backend '%s' (fork, spawn or zygote)\n", args[1]);
+        return 1;
+    }
+    if(backend == LAUNCH_ZYGOTE && zygote_start() == -1) {
+        fprintf(stderr, "launcher: fork server: %s\n", strerror(errno));
+        return 1;
+    }
+    launch_backend = backend;
+    if(launch_backend == LAUNCH_ZYGOTE && zygote_pid() != -1) {
+        fprintf(stderr, "Launcher: %s (pid %d)\n", launch_backend_name(launch_backend), zygote_pid());
+    } else {
+        fprintf(stderr, "Launcher: %s\n", launch_backend_name(launch_backend));
+    }
+    return 0;
+}
+
+/*!
+ * \fn int builtin_hash(char *args[], struct line *li)
+ * \brief hash [-r | name...]: list the cached command paths, the hit/miss counters and the size of the completion
+ * index, clear the cache or add commands to it.
+ */
+int builtin_hash(char *args[], struct line *li) {
+    (void) li;
+    int status = 0;
+    if(args[1] == NULL) {
+        cmdhash_print(stdout);
+        complete_print_stats(stdout);
+        vars_print_stats(stdout);
+    } else if(strcmp(args[1], "-r") == 0) {
+        cmdhash_clear();
+    } else {
+        for(size_t i = 1; args[i] != NULL; i++) {
+            if(cmdhash_lookup(args[i]) == NULL) {
+                fprintf(stderr, "hash: %s: not found\n", args[i]);
+                status = 1;
+            }
         }
-        debug = !debug;
-        fprintf(stderr, "Debug mode %s\n", YES_NO(debug));
-        return true;
     }
-    return false;
+    return status;
 }
 
 /*!
- * \fn void cd(char *path)
+ * \fn int cd(char *path)
  * \brief Change the current working directory.
  * Can handle '~' as a shortcut for the HOME directory.
  *
  * \param path The new working directory. If NULL, the HOME directory is used.<br>
  *             Can handle the ~ or the ~username shortcuts.
+ * \return 0 on success, 1 if an error occurs (HOME not set when needed, or chdir() failed).
  */
-void cd(char *path) {
+int cd(char *path) {
     char *resolvedPath = NULL;
     char *homePath = getenv("HOME");
 
     bool malloced = false;
 
+    // "unset HOME" is allowed: "cd", "cd ~" and "cd ~/dir" need it
+    if ((path == NULL || (path[0] == '~' && (path[1] == '\0' || path[1] == '/'))) && homePath == NULL) {
+        fprintf(stderr, "cd: HOME not set\n");
+        return 1;
+    }
+
     if (path == NULL) {
         path = homePath;
     } else
@@ -380,7 +720,7 @@ void cd(char *path) {
         else if (path[1] == '/') {
             resolvedPath = malloc(strlen(homePath) + strlen(path));
             malloced = true;
-            if (resolvedPath == NULL) { perror("malloc"); return; }
+            if (resolvedPath == NULL) { perror("malloc"); return 1; }
             sprintf(resolvedPath, "%s%s", homePath, path + 1);
             path = resolvedPath;
         } else {
@@ -392,12 +732,12 @@ void cd(char *path) {
                 if (user_data != NULL) {
                     resolvedPath = malloc(strlen(user_data->pw_dir) + strlen(end));
                     malloced = true;
-                    if (resolvedPath == NULL) { perror("malloc"); return; }
+                    if (resolvedPath == NULL) { perror("malloc"); return 1; }
                     sprintf(resolvedPath, "%s%s", user_data->pw_dir, end);
                     path = resolvedPath;
                 } else {
                     fprintf(stderr, "cd: no such user: %s\n", username);
-                    return;
+                    return 1;
                 }
             } else {
                 struct passwd *user_data = getpwnam(username);
@@ -405,16 +745,21 @@ void cd(char *path) {
                     path = user_data->pw_dir;
                 } else {
                     fprintf(stderr, "cd: no such user: %s\n", username);
-                    return;
+                    return 1;
                 }
             }
         }
     }
 
+    int status = 0;
     if (chdir(path) == -1) {
         perror("chdir");
+        status = 1;
+    } else {
+        prompt_invalidate();
     }
     if(malloced) free(resolvedPath);
+    return status;
 }
 
 /*!
@@ -422,7 +767,9 @@ void cd(char *path) {
  * \brief Handler for the SIGCHLD signal.
  * This handler is called when a child process terminates.
  *
- * It prints a message to the standard error output indicating the termination of the child process.
+ * It only wakes up the event loop of the main thread (see event.h), which reaps every terminated child
+ * with job_reap() and records its status in the job table. The background ones are reported by
+ * print_backgrounds_processes() as soon as they are reaped.
  *
  * Example:<br>
  *  <ul>
@@ -433,50 +780,55 @@ void cd(char *path) {
  * \param signum The signal number. (Not used)
  */
 void sigchld_handler(int signum) {
-    int status;
-    pid_t pid;
-
-    for(size_t i = 0; i < background_data.bg_array_size; i++) {
-        pid = background_data.bg_array[i];
-        if (pid != -1 && waitpid(pid, &status, WNOHANG) > 0) {
-            volatile struct background_exit_status bg_exit_status;
-            init_exit_status(&bg_exit_status);
-
-            bg_exit_status.pid = pid;
+    (void) signum;
+    event_notify();
+}
 
-            if (WIFEXITED(status)) {
-                bg_exit_status.signaled = 0;
-                bg_exit_status.status_data = WEXITSTATUS(status);
-            }
-            else if (WIFSIGNALED(status)) {
-                bg_exit_status.signaled = 1;
-                bg_exit_status.status_data = WTERMSIG(status);
-            }
-            background_data.bg_array[i] = -1;
-            background_data.exit_statuses[background_data.exit_statuses_size++] = bg_exit_status;
-        }
-    }
+/*!
+ * \fn int wait_events(int fd)
+ * \brief Wait for the next events (see event_wait) and reap the children if SIGCHLD was received.
+ *
+ * \param fd The input file descriptor to watch, -1 to only wait for children.
+ * \return The events received (combination of EVENT_INPUT and EVENT_CHILD).
+ */
+int wait_events(int fd) {
+    int events = event_wait(fd);
+    if(events & EVENT_CHILD) job_reap(&jobs);
+    return events;
 }
 
 /*!
- * \fn void print_backgrounds_processes()
+ * \fn bool print_backgrounds_processes()
  * \brief Print the exit statuses of the background processes.
- * This function prints the exit statuses of the background processes.
+ * This function prints the exit statuses of the background processes reaped since the last call,
+ * in the order they finished, and releases their slots. Nothing is printed by a non-interactive shell.
+ *
+ * \return true if something was printed.
  */
-void print_backgrounds_processes() {
-    volatile struct background_exit_status *statuses = background_data.exit_statuses;
-    for(size_t i = 0; i < background_data.exit_statuses_size; i++) {
-        volatile struct background_exit_status actual = statuses[i];
-        if(actual.pid != -1) {
-            if(actual.signaled) {
-                fprintf(stderr, " BG: Command `%d` killed by signal %d\n", actual.pid, actual.status_data);
-            } else {
-                fprintf(stderr, " BG: Command `%d` exited with status %d\n", actual.pid, actual.status_data);
-            }
-            init_exit_status(&statuses[i]);
+bool print_backgrounds_processes() {
+    bool printed = false;
+    size_t reversed = JOB_NONE;
+    size_t slot;
+    while((slot = job_pop_finished(&jobs)) != JOB_NONE) {
+        jobs.slots[slot].next = reversed;
+        reversed = slot;
+    }
+    while(reversed != JOB_NONE) {
+        struct job *job = &jobs.slots[reversed];
+        size_t next = job->next;
+        if(!interactive) {
+            // Only release the slot
+        } else if(job->signaled == 1) {
+            fprintf(stderr, " BG: Command `%d` killed by signal %d\n", job->pid, job->status_data);
+            printed = true;
+        } else {
+            fprintf(stderr, " BG: Command `%d` exited with status %d\n", job->pid, job->status_data);
+            printed = true;
         }
+        job_release(&jobs, reversed);
+        reversed = next;
     }
-    background_data.exit_statuses_size = 0;
+    return printed;
 }
 
 /*!
@@ -484,7 +836,7 @@ void print_backgrounds_processes() {
  * \brief Manage the signal actions.
  *
  * This function manages the signal actions for the shell.
- * It ignores the SIGINT signal and sets the handler for the SIGCHLD signal.
+ * It ignores the SIGINT signal, creates the self-pipe of the event loop and sets the handler for the SIGCHLD signal.
  *
  * \return The previous action for the SIGINT signal.
  */
@@ -492,6 +844,8 @@ struct standard_signals manage_sigaction() {
     struct sigaction sa_standard_SIGINT;
     apply_ignore(SIGINT, &sa_standard_SIGINT);
 
+    event_init();
+
     struct sigaction sa_SIGCHILD;
     sigemptyset(&sa_SIGCHILD.sa_mask);
     sa_SIGCHILD.sa_flags = SA_RESTART;
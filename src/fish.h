@@ -17,13 +17,6 @@
 
 #include <stdbool.h>
 
-/*!
- * \def BUFLEN
- * \brief Maximum length of the command line.
- * This constant defines the maximum length of the command line that can be entered by the user.
- */
-#define BUFLEN 512
-
 /*!
  * \def RESET
  * \brief Escape code to reset the color of the prompt.
@@ -80,14 +73,25 @@
 
 /* All the docs are described in the file fish.c */
 
-pid_t execute_command_with_args(char *cmd, char *args[], struct sigaction *standardSigintAction, struct line *line, struct pipe_control *pipeControl, size_t cmd_index, int *exit_code);
-bool manage_intern_cmd(char *cmd, char *args[], struct line *li);
-void cd(char *path);
+extern struct job_table jobs;
+extern bool interactive;
+
+int shell_exit_status(int last_status_code);
+void run_list(struct line *li, struct sigaction *standardSigintAction, int *last_status_code);
+void run_line(struct line *li, struct sigaction *standardSigintAction, int *last_status_code);
+pid_t execute_command_with_args(char *cmd, char *args[], struct sigaction *standardSigintAction, struct line *line, struct pipe_control *pipeControl, size_t cmd_index, size_t group, int *exit_code, char **envp);
+int builtin_exit(char *args[], struct line *li);
+int builtin_cd(char *args[], struct line *li);
+int builtin_debug(char *args[], struct line *li);
+int builtin_launcher(char *args[], struct line *li);
+int builtin_hash(char *args[], struct line *li);
+int cd(char *path);
 void substitute_home(char *path, char *home);
 void sigchld_handler(int signum);
 struct standard_signals manage_sigaction();
 void apply_ignore(int signal, struct sigaction *old_sigaction);
-void print_backgrounds_processes();
+bool print_backgrounds_processes();
+int wait_events(int fd);
 
 /*!
  * \struct standard_signals
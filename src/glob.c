@@ -0,0 +1,613 @@
+/*!
+ * \file glob.c
+ * \brief Implementation of the expansion of the filename patterns of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "glob.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*!
+ * \def GLOB_BUFFER_SIZE
+ * \brief Size of the buffer of getdents64(2): about 8000 names of 16 bytes per call.
+ */
+#define GLOB_BUFFER_SIZE (256 * 1024)
+
+/*!
+ * \def GLOB_CHUNK_SIZE
+ * \brief Minimal size of a chunk of the paths matched.
+ */
+#define GLOB_CHUNK_SIZE (64 * 1024)
+
+/*!
+ * \struct glob_dirent64
+ * \brief A record returned by getdents64(2) (struct linux_dirent64, not declared by every libc).
+ */
+struct glob_dirent64 {
+    /*! \brief The inode number. */
+    uint64_t d_ino;
+    /*! \brief The offset of the next record. */
+    int64_t d_off;
+    /*! \brief The size of this record. */
+    unsigned short d_reclen;
+    /*! \brief The type of the file (DT_DIR, DT_REG... or DT_UNKNOWN). */
+    unsigned char d_type;
+    /*! \brief The name, '\0' terminated. */
+    char d_name[];
+};
+
+/*!
+ * \struct glob_entry
+ * \brief A name of a directory.
+ */
+struct glob_entry {
+    /*! \brief The offset of the name in the field "names" of the directory. */
+    size_t name;
+    /*! \brief The type of the file, as given by getdents64(2). */
+    unsigned char type;
+};
+
+/*!
+ * \struct glob_dir
+ * \brief A directory read, with its names ("." and ".." excepted).
+ */
+struct glob_dir {
+    /*! \brief The path, as written in the pattern ("" for the working directory). */
+    char *path;
+    /*! \brief The length of the path. */
+    size_t path_len;
+    /*! \brief The hash of the path. */
+    uint64_t hash;
+    /*! \brief The names, each '\0' terminated. */
+    char *names;
+    /*! \brief The entries, in the order of the directory. */
+    struct glob_entry *entries;
+    /*! \brief The number of entries (0 if the directory could not be read). */
+    size_t count;
+};
+
+/*!
+ * \struct glob_chunk
+ * \brief A block of memory holding paths matched.
+ */
+struct glob_chunk {
+    /*! \brief The previous chunk. */
+    struct glob_chunk *next;
+    /*! \brief The number of bytes used. */
+    size_t used;
+    /*! \brief The number of bytes of data. */
+    size_t size;
+    /*! \brief The paths. */
+    char data[];
+};
+
+/*!
+ * \enum glob_kind
+ * \brief The kind of a component of a pattern (the text between two '/').
+ */
+enum glob_kind {
+    GLOB_LITERAL,  /*!< a name without '*', '?' or set: no need to read the directory to go through it */
+    GLOB_MATCH,    /*!< a name matched by its ops */
+    GLOB_GLOBSTAR, /*!< "**": any number of directories */
+};
+
+/*!
+ * \struct glob_op
+ * \brief A step of the matching of a name: '*', or a character of a set.
+ */
+struct glob_op {
+    /*! \brief The characters matched (one bit per byte value), for a set, '?' or a plain character. */
+    uint64_t set[4];
+    /*! \brief true for a '*'. */
+    bool star;
+};
+
+/*!
+ * \struct glob_component
+ * \brief A compiled component of a pattern.
+ */
+struct glob_component {
+    /*! \brief The kind of the component. */
+    enum glob_kind kind;
+    /*! \brief The text of the component in the pattern (not '\0' terminated). */
+    const char *text;
+    /*! \brief The length of the text. */
+    size_t len;
+    /*! \brief The index of the first op of the component in the field "ops" of the state. */
+    size_t first_op;
+    /*! \brief The number of ops. */
+    size_t n_ops;
+    /*! \brief true if the component starts with a '.': it matches hidden files. */
+    bool dot;
+};
+
+/*!
+ * \struct glob_saved
+ * \brief The arguments of a command before the expansion, and where the expanded ones are.
+ */
+struct glob_saved {
+    /*! \brief The arguments given by the parser. */
+    char **args;
+    /*! \brief Their number. */
+    size_t n_args;
+    /*! \brief The index of the first expanded argument in the field "argv" of the state. */
+    size_t offset;
+    /*! \brief The number of expanded arguments. */
+    size_t count;
+};
+
+
+void glob_init(struct glob_state *gs) {
+    memset(gs, 0, sizeof(struct glob_state));
+}
+
+/*!
+ * \fn static void glob_grow(void **array, size_t *size, size_t needed, size_t elem_size)
+ * \brief Make sure the dynamic array "array" can hold "needed" elements, doubling its capacity. Exits on failure.
+ */
+static void glob_grow(void **array, size_t *size, size_t needed, size_t elem_size) {
+    if(needed <= *size) return;
+    size_t new_size = *size ? *size : 16;
+    while(new_size < needed) new_size *= 2;
+    void *grown = realloc(*array, new_size * elem_size);
+    if(grown == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+    *array = grown;
+    *size = new_size;
+}
+
+/*!
+ * \fn static void glob_push(struct glob_state *gs, char *arg)
+ * \brief Append an argument to the expanded ones.
+ */
+static void glob_push(struct glob_state *gs, char *arg) {
+    glob_grow((void **) &gs->argv, &gs->argv_size, gs->argv_len + 1, sizeof(char *));
+    gs->argv[gs->argv_len++] = arg;
+}
+
+/*!
+ * \fn static size_t glob_path_set(struct glob_state *gs, size_t len, const char *name, size_t name_len, bool slash)
+ * \brief Write a name, and a '/' if "slash" is true, after the first "len" bytes of gs->path.
+ *
+ * \return The new length of the path, which is '\0' terminated.
+ */
+static size_t glob_path_set(struct glob_state *gs, size_t len, const char *name, size_t name_len, bool slash) {
+    glob_grow((void **) &gs->path, &gs->path_size, len + name_len + 2, 1);
+    memcpy(gs->path + len, name, name_len);
+    len += name_len;
+    if(slash) gs->path[len++] = '/';
+    gs->path[len] = '\0';
+    return len;
+}
+
+/*!
+ * \fn static void glob_emit(struct glob_state *gs, size_t len)
+ * \brief Copy the first "len" bytes of gs->path in a chunk, and append the copy to the expanded arguments.
+ */
+static void glob_emit(struct glob_state *gs, size_t len) {
+    struct glob_chunk *chunk = gs->strings;
+    if(chunk == NULL || chunk->size - chunk->used < len + 1) {
+        size_t size = len + 1 > GLOB_CHUNK_SIZE ? len + 1 : GLOB_CHUNK_SIZE;
+        chunk = malloc(sizeof(struct glob_chunk) + size);
+        if(chunk == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+        chunk->next = gs->strings;
+        chunk->used = 0;
+        chunk->size = size;
+        gs->strings = chunk;
+    }
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, gs->path, len);
+    copy[len] = '\0';
+    chunk->used += len + 1;
+    glob_push(gs, copy);
+}
+
+/*!
+ * \fn static uint64_t glob_hash(const char *path, size_t len)
+ * \brief FNV-1a hash of a path.
+ */
+static uint64_t glob_hash(const char *path, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*!
+ * \fn static void glob_index(struct glob_state *gs, size_t dir)
+ * \brief Add the directory number "dir" to the hash index, which is doubled when half full.
+ */
+static void glob_index(struct glob_state *gs, size_t dir) {
+    if(2 * gs->n_dirs > gs->n_buckets) {
+        size_t n_buckets = gs->n_buckets ? 2 * gs->n_buckets : 64;
+        size_t *buckets = calloc(n_buckets, sizeof(size_t));
+        if(buckets == NULL) { perror("calloc"); exit(EXIT_FAILURE); }
+        free(gs->buckets);
+        gs->buckets = buckets;
+        gs->n_buckets = n_buckets;
+        for(size_t i = 0; i < gs->n_dirs; ++i) {
+            if(i != dir) glob_index(gs, i);
+        }
+    }
+    size_t b = gs->dirs[dir].hash & (gs->n_buckets - 1);
+    while(gs->buckets[b] != 0) b = (b + 1) & (gs->n_buckets - 1);
+    gs->buckets[b] = dir + 1;
+}
+
+/*!
+ * \fn static struct glob_dir *glob_read(struct glob_state *gs, size_t len)
+ * \brief Get the names of the directory whose path is the first "len" bytes of gs->path, reading it
+ * with getdents64(2) the first time. A directory which cannot be read has no names.
+ *
+ * \return The directory, valid until the next call.
+ */
+static struct glob_dir *glob_read(struct glob_state *gs, size_t len) {
+    uint64_t hash = glob_hash(gs->path, len);
+    for(size_t b = gs->n_buckets ? hash & (gs->n_buckets - 1) : 0; gs->n_buckets && gs->buckets[b] != 0;
+        b = (b + 1) & (gs->n_buckets - 1)) {
+        struct glob_dir *dir = &gs->dirs[gs->buckets[b] - 1];
+        if(dir->hash == hash && dir->path_len == len && memcmp(dir->path, gs->path, len) == 0) return dir;
+    }
+
+    glob_grow((void **) &gs->dirs, &gs->dirs_size, gs->n_dirs + 1, sizeof(struct glob_dir));
+    struct glob_dir *dir = &gs->dirs[gs->n_dirs];
+    memset(dir, 0, sizeof(struct glob_dir));
+    dir->path = strndup(gs->path, len);
+    if(dir->path == NULL) { perror("strndup"); exit(EXIT_FAILURE); }
+    dir->path_len = len;
+    dir->hash = hash;
+    glob_index(gs, gs->n_dirs++);
+
+    if(gs->buffer == NULL && (gs->buffer = malloc(GLOB_BUFFER_SIZE)) == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    int fd = open(len > 0 ? dir->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1) return dir; // Not a directory, or not readable: no match, as in the other shells
+
+    size_t names_len = 0, names_size = 0, entries_size = 0;
+    for(;;) {
+        long n = syscall(SYS_getdents64, fd, gs->buffer, GLOB_BUFFER_SIZE);
+        ++gs->reads;
+        if(n <= 0) break;
+        for(long offset = 0; offset < n;) {
+            struct glob_dirent64 *de = (struct glob_dirent64 *) (gs->buffer + offset);
+            offset += de->d_reclen;
+            const char *name = de->d_name;
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            size_t name_len = strlen(name) + 1;
+            glob_grow((void **) &dir->names, &names_size, names_len + name_len, 1);
+            glob_grow((void **) &dir->entries, &entries_size, dir->count + 1, sizeof(struct glob_entry));
+            memcpy(dir->names + names_len, name, name_len);
+            dir->entries[dir->count].name = names_len;
+            dir->entries[dir->count].type = de->d_type;
+            ++dir->count;
+            names_len += name_len;
+        }
+    }
+    close(fd);
+    gs->names += dir->count;
+    return dir;
+}
+
+/*!
+ * \fn static bool glob_is_dir(struct glob_state *gs, size_t len, const char *name, unsigned char type, bool follow)
+ * \brief Tell if the name of the directory gs->path[0..len) is a directory, calling stat(2) only when
+ * getdents64(2) did not tell it (or lstat(2) if "follow" is false: a symbolic link is then never a directory).
+ */
+static bool glob_is_dir(struct glob_state *gs, size_t len, const char *name, unsigned char type, bool follow) {
+    if(type == DT_DIR) return true;
+    if(type != DT_UNKNOWN && (type != DT_LNK || !follow)) return false;
+    glob_path_set(gs, len, name, strlen(name), false);
+    struct stat st;
+    return (follow ? stat(gs->path, &st) : lstat(gs->path, &st)) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*!
+ * \fn static bool glob_match(const struct glob_op *ops, size_t n_ops, const char *name)
+ * \brief Match a name against the ops of a component.
+ *
+ * A '*' records where it started: on a mismatch, the ops after the last '*' are tried again one character
+ * further, so a name is matched in O(length of the name x number of ops) at worst, without recursion.
+ */
+static bool glob_match(const struct glob_op *ops, size_t n_ops, const char *name) {
+    const char *s = name;
+    size_t op = 0;
+    size_t star_op = SIZE_MAX;
+    const char *star_s = NULL;
+    while(*s != '\0') {
+        unsigned char c = (unsigned char) *s;
+        if(op < n_ops && ops[op].star) {
+            star_op = ++op;
+            star_s = s;
+        } else if(op < n_ops && (ops[op].set[c >> 6] >> (c & 63) & 1)) {
+            ++op;
+            ++s;
+        } else if(star_op != SIZE_MAX) {
+            op = star_op;
+            s = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while(op < n_ops && ops[op].star) ++op;
+    return op == n_ops;
+}
+
+/*!
+ * \fn static void glob_walk(struct glob_state *gs, size_t c, size_t n, size_t len, bool dirs_only)
+ * \brief Emit the paths matching the components c to n - 1 of the pattern in the directory gs->path[0..len).
+ *
+ * \param gs The expansion.
+ * \param c The component matched in this directory.
+ * \param n The number of components.
+ * \param len The length of the directory in gs->path: "" or a path ending with a '/'.
+ * \param dirs_only true if the pattern ends with a '/': only directories match, and keep their '/'.
+ */
+static void glob_walk(struct glob_state *gs, size_t c, size_t n, size_t len, bool dirs_only) {
+    const struct glob_component *comp = &gs->components[c];
+    bool last = c + 1 == n;
+
+    if(comp->kind == GLOB_LITERAL && !last) {
+        glob_walk(gs, c + 1, n, glob_path_set(gs, len, comp->text, comp->len, true), dirs_only);
+        return;
+    }
+
+    struct glob_dir *dir = glob_read(gs, len);
+    const char *names = dir->names;       // dir moves when other directories are read,
+    const struct glob_entry *entries = dir->entries; // not its names
+    size_t count = dir->count;
+
+    if(comp->kind == GLOB_GLOBSTAR && !last) {
+        glob_walk(gs, c + 1, n, len, dirs_only); // no directory
+    }
+    for(size_t i = 0; i < count; ++i) {
+        const char *name = names + entries[i].name;
+        unsigned char type = entries[i].type;
+        size_t name_len = strlen(name);
+
+        if(comp->kind == GLOB_LITERAL) {
+            if(name_len == comp->len && memcmp(name, comp->text, name_len) == 0
+               && (!dirs_only || glob_is_dir(gs, len, name, type, true))) {
+                glob_emit(gs, glob_path_set(gs, len, name, name_len, dirs_only));
+            }
+            continue;
+        }
+        if(name[0] == '.' && !comp->dot) continue;
+
+        if(comp->kind == GLOB_GLOBSTAR) {
+            bool is_dir = glob_is_dir(gs, len, name, type, false);
+            if(last && (is_dir || !dirs_only)) glob_emit(gs, glob_path_set(gs, len, name, name_len, dirs_only));
+            if(is_dir) glob_walk(gs, c, n, glob_path_set(gs, len, name, name_len, true), dirs_only);
+            continue;
+        }
+
+        if(!glob_match(gs->ops + comp->first_op, comp->n_ops, name)) continue;
+        if(last) {
+            if(!dirs_only || glob_is_dir(gs, len, name, type, true)) {
+                glob_emit(gs, glob_path_set(gs, len, name, name_len, dirs_only));
+            }
+        } else if(type == DT_DIR || type == DT_LNK || type == DT_UNKNOWN) { // the others cannot be read
+            glob_walk(gs, c + 1, n, glob_path_set(gs, len, name, name_len, true), dirs_only);
+        }
+    }
+}
+
+/*!
+ * \fn static struct glob_op *glob_new_op(struct glob_state *gs, struct glob_component *comp)
+ * \brief Append an empty op to a component being compiled.
+ */
+static struct glob_op *glob_new_op(struct glob_state *gs, struct glob_component *comp) {
+    size_t index = comp->first_op + comp->n_ops++;
+    glob_grow((void **) &gs->ops, &gs->ops_size, index + 1, sizeof(struct glob_op));
+    memset(&gs->ops[index], 0, sizeof(struct glob_op));
+    return &gs->ops[index];
+}
+
+/*!
+ * \fn static size_t glob_set_end(const char *text, size_t i, size_t len)
+ * \brief Find the ']' closing the set opened by the '[' at text[i]. A ']' right after the '[' (or "[!", "[^") is a member.
+ *
+ * \return The index of the ']', 0 if the set is not closed (the '[' is then a plain character).
+ */
+static size_t glob_set_end(const char *text, size_t i, size_t len) {
+    size_t j = i + 1;
+    if(j < len && (text[j] == '!' || text[j] == '^')) ++j;
+    if(j < len && text[j] == ']') ++j;
+    while(j < len && text[j] != ']') ++j;
+    return j < len ? j : 0;
+}
+
+/*!
+ * \fn static void glob_compile_component(struct glob_state *gs, struct glob_component *comp)
+ * \brief Compile the text of a component into its kind and its ops.
+ */
+static void glob_compile_component(struct glob_state *gs, struct glob_component *comp) {
+    const char *text = comp->text;
+    size_t len = comp->len;
+    comp->dot = text[0] == '.';
+    if(len == 2 && text[0] == '*' && text[1] == '*') {
+        comp->kind = GLOB_GLOBSTAR;
+        return;
+    }
+
+    bool literal = true;
+    for(size_t i = 0; i < len;) {
+        unsigned char ch = (unsigned char) text[i];
+        size_t end;
+        if(ch == '*') {
+            literal = false;
+            if(comp->n_ops == 0 || !gs->ops[comp->first_op + comp->n_ops - 1].star) { // "**x" is "*x"
+                glob_new_op(gs, comp)->star = true;
+            }
+            ++i;
+        } else if(ch == '?') {
+            literal = false;
+            struct glob_op *op = glob_new_op(gs, comp);
+            memset(op->set, 0xff, sizeof(op->set));
+            ++i;
+        } else if(ch == '[' && (end = glob_set_end(text, i, len)) != 0) {
+            literal = false;
+            struct glob_op *op = glob_new_op(gs, comp);
+            size_t j = i + 1;
+            bool negate = text[j] == '!' || text[j] == '^';
+            if(negate) ++j;
+            for(size_t k = j; k < end; ++k) {
+                unsigned char lo = (unsigned char) text[k], hi = lo;
+                if(k + 2 < end && text[k + 1] == '-') { // a range, "a-" and "-a" are plain characters
+                    hi = (unsigned char) text[k + 2];
+                    k += 2;
+                }
+                for(unsigned b = lo; b <= hi; ++b) op->set[b >> 6] |= 1ULL << (b & 63);
+            }
+            if(negate) {
+                for(int w = 0; w < 4; ++w) op->set[w] = ~op->set[w];
+            }
+            i = end + 1;
+        } else {
+            glob_new_op(gs, comp)->set[ch >> 6] = 1ULL << (ch & 63);
+            ++i;
+        }
+    }
+    comp->kind = literal ? GLOB_LITERAL : GLOB_MATCH;
+}
+
+/*!
+ * \fn static size_t glob_compile(struct glob_state *gs, const char *pattern, bool *dirs_only)
+ * \brief Split a pattern into its components (empty ones are dropped) and compile them.
+ *
+ * \param gs The expansion, whose fields "components" and "ops" receive the compiled pattern.
+ * \param pattern The pattern.
+ * \param dirs_only Set to true if the pattern ends with a '/'.
+ * \return The number of components.
+ */
+static size_t glob_compile(struct glob_state *gs, const char *pattern, bool *dirs_only) {
+    size_t n = 0, n_ops = 0;
+    const char *p = pattern;
+    *dirs_only = false;
+    while(*p != '\0') {
+        const char *slash = strchrnul(p, '/');
+        if(slash > p) {
+            glob_grow((void **) &gs->components, &gs->components_size, n + 1, sizeof(struct glob_component));
+            struct glob_component *comp = &gs->components[n++];
+            memset(comp, 0, sizeof(struct glob_component));
+            comp->text = p;
+            comp->len = (size_t) (slash - p);
+            comp->first_op = n_ops;
+            glob_compile_component(gs, comp);
+            n_ops += comp->n_ops;
+        }
+        *dirs_only = *slash == '/';
+        p = *slash == '/' ? slash + 1 : slash;
+    }
+    return n;
+}
+
+/*!
+ * \fn static int glob_compare(const void *a, const void *b)
+ * \brief Compare two paths for qsort(3), byte by byte.
+ */
+static int glob_compare(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*!
+ * \fn static void glob_expand(struct glob_state *gs, char *pattern)
+ * \brief Append the sorted paths matching a pattern to the expanded arguments, or the pattern if none matches.
+ */
+static void glob_expand(struct glob_state *gs, char *pattern) {
+    bool dirs_only;
+    size_t n = glob_compile(gs, pattern, &dirs_only);
+    size_t start = gs->argv_len;
+    size_t len = glob_path_set(gs, 0, "/", pattern[0] == '/', false); // "/" or ""
+    if(n > 0) glob_walk(gs, 0, n, len, dirs_only);
+    ++gs->patterns;
+
+    if(gs->argv_len == start) {
+        glob_push(gs, pattern);
+        return;
+    }
+    qsort(gs->argv + start, gs->argv_len - start, sizeof(char *), glob_compare);
+    size_t kept = start + 1; // "**/**" may reach a path twice
+    for(size_t i = start + 1; i < gs->argv_len; ++i) {
+        if(strcmp(gs->argv[i], gs->argv[kept - 1]) != 0) gs->argv[kept++] = gs->argv[i];
+    }
+    gs->argv_len = kept;
+}
+
+size_t glob_line(struct glob_state *gs, struct line *pl) {
+    if(pl->n_globs == 0) return 0;
+
+    size_t patterns = gs->patterns;
+    glob_grow((void **) &gs->saved, &gs->saved_size, pl->n_cmds, sizeof(struct glob_saved));
+    gs->argv_len = 0;
+    for(size_t i = 0; i < pl->n_cmds; ++i) {
+        struct cmd *cmd = &pl->cmds[i];
+        struct glob_saved *saved = &gs->saved[i];
+        saved->args = cmd->args;
+        saved->n_args = cmd->n_args;
+        saved->offset = gs->argv_len;
+        for(size_t j = 0; j < cmd->n_args; ++j) {
+            if(pl->arg_flags[cmd->first_arg + j] & LINE_ARG_GLOB) {
+                glob_expand(gs, cmd->args[j]);
+            } else {
+                glob_push(gs, cmd->args[j]);
+            }
+        }
+        saved->count = gs->argv_len - saved->offset;
+        glob_push(gs, NULL);
+    }
+    gs->n_saved = pl->n_cmds;
+
+    // The arguments point into gs->argv once it does not move anymore
+    for(size_t i = 0; i < pl->n_cmds; ++i) {
+        pl->cmds[i].args = gs->argv + gs->saved[i].offset;
+        pl->cmds[i].n_args = gs->saved[i].count;
+    }
+    return gs->patterns - patterns;
+}
+
+void glob_release(struct glob_state *gs, struct line *pl) {
+    for(size_t i = 0; i < gs->n_saved && i < pl->n_cmds; ++i) {
+        pl->cmds[i].args = gs->saved[i].args;
+        pl->cmds[i].n_args = gs->saved[i].n_args;
+    }
+    for(size_t i = 0; i < gs->n_dirs; ++i) {
+        free(gs->dirs[i].path);
+        free(gs->dirs[i].names);
+        free(gs->dirs[i].entries);
+    }
+    while(gs->strings != NULL) {
+        struct glob_chunk *chunk = gs->strings;
+        gs->strings = chunk->next;
+        free(chunk);
+    }
+    free(gs->dirs);
+    free(gs->buckets);
+    free(gs->buffer);
+    free(gs->argv);
+    free(gs->saved);
+    free(gs->components);
+    free(gs->ops);
+    free(gs->path);
+    glob_init(gs);
+}
+
+void glob_print_stats(const struct glob_state *gs, FILE *out) {
+    fprintf(out, "glob: %zu patterns, %zu directories read with %zu getdents64, %zu names, %zu arguments\n",
+            gs->patterns, gs->n_dirs, gs->reads, gs->names, gs->argv_len - gs->n_saved);
+}
@@ -0,0 +1,188 @@
+/*!
+ * \file glob.h
+ * \brief Header file for the expansion of the filename patterns of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * An unquoted argument containing '*', '?' or '[' (flagged LINE_ARG_GLOB by the parser) is a pattern,
+ * replaced by the sorted paths it matches before the commands are executed: '*' matches any string,
+ * '?' any character, "[abc]", "[a-z]" and "[!a-z]" (or "[^a-z]") a character of a set, and a "**"
+ * component any number of directories, hidden ones and symbolic links excepted. '*', '?' and sets
+ * never match the '.' starting a hidden file, and a pattern matching nothing is kept as it is.
+ *
+ * Each pattern is compiled once into a list of components, then matched against the names of the
+ * directories. A directory is read with getdents64(2) into a large buffer, and its names are kept
+ * until the end of the pipeline, so "a/x? b/x? a/y?" reads "a" once. The expanded arguments are
+ * stored in an array which grows as needed: a pattern can expand to any number of names.
+ */
+#ifndef FISH_GLOB_H
+#define FISH_GLOB_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cmdline.h"
+
+struct glob_dir;
+struct glob_chunk;
+struct glob_component;
+struct glob_op;
+struct glob_saved;
+
+/*!
+ * \struct glob_state
+ * \brief The expansion of a pipeline: the directories read, the expanded arguments and the compiled pattern.
+ */
+struct glob_state {
+    /*!
+     * \var dirs
+     * \brief The directories read, in the order they were read.
+     */
+    struct glob_dir *dirs;
+    /*!
+     * \var n_dirs
+     * \brief The number of directories read.
+     */
+    size_t n_dirs;
+    /*!
+     * \var dirs_size
+     * \brief The allocated number of directories.
+     */
+    size_t dirs_size;
+    /*!
+     * \var buckets
+     * \brief The hash index of the directories by path: the index of a directory plus one, 0 if empty.
+     */
+    size_t *buckets;
+    /*!
+     * \var n_buckets
+     * \brief The number of buckets (a power of two).
+     */
+    size_t n_buckets;
+    /*!
+     * \var buffer
+     * \brief The buffer of getdents64(2).
+     */
+    char *buffer;
+    /*!
+     * \var strings
+     * \brief The paths matched, allocated in chunks freed all together.
+     */
+    struct glob_chunk *strings;
+    /*!
+     * \var argv
+     * \brief The expanded arguments of all the commands, each command being followed by a NULL.
+     */
+    char **argv;
+    /*!
+     * \var argv_len
+     * \brief The number of elements used in argv.
+     */
+    size_t argv_len;
+    /*!
+     * \var argv_size
+     * \brief The allocated number of elements of argv.
+     */
+    size_t argv_size;
+    /*!
+     * \var saved
+     * \brief The arguments of the commands before the expansion, restored by glob_release().
+     */
+    struct glob_saved *saved;
+    /*!
+     * \var saved_size
+     * \brief The allocated number of elements of saved.
+     */
+    size_t saved_size;
+    /*!
+     * \var n_saved
+     * \brief The number of commands whose arguments were replaced.
+     */
+    size_t n_saved;
+    /*!
+     * \var components
+     * \brief The compiled components of the pattern being expanded.
+     */
+    struct glob_component *components;
+    /*!
+     * \var components_size
+     * \brief The allocated number of components.
+     */
+    size_t components_size;
+    /*!
+     * \var ops
+     * \brief The characters and sets of the components of the pattern being expanded.
+     */
+    struct glob_op *ops;
+    /*!
+     * \var ops_size
+     * \brief The allocated number of ops.
+     */
+    size_t ops_size;
+    /*!
+     * \var path
+     * \brief The directory being walked, followed by the name being matched.
+     */
+    char *path;
+    /*!
+     * \var path_size
+     * \brief The allocated size of path.
+     */
+    size_t path_size;
+    /*!
+     * \var patterns
+     * \brief The number of patterns expanded.
+     */
+    size_t patterns;
+    /*!
+     * \var reads
+     * \brief The number of calls of getdents64(2).
+     */
+    size_t reads;
+    /*!
+     * \var names
+     * \brief The number of names read.
+     */
+    size_t names;
+};
+
+/*!
+ * \fn void glob_init(struct glob_state *gs)
+ * \brief Initialize an expansion. Nothing is allocated before the first pattern.
+ *
+ * \param gs The expansion.
+ */
+void glob_init(struct glob_state *gs);
+
+/*!
+ * \fn size_t glob_line(struct glob_state *gs, struct line *pl)
+ * \brief Replace the patterns of the commands of a pipeline by the paths they match.
+ *
+ * The arguments of the commands (see the field "args" of struct cmd) point into the expansion
+ * until glob_release() is called. The function exits the shell if a memory allocation fails.
+ *
+ * \param gs The expansion, initialized by glob_init().
+ * \param pl The pipeline.
+ * \return The number of patterns expanded.
+ */
+size_t glob_line(struct glob_state *gs, struct line *pl);
+
+/*!
+ * \fn void glob_release(struct glob_state *gs, struct line *pl)
+ * \brief Give the commands of the pipeline their arguments back, and free the expansion.
+ *
+ * \param gs The expansion.
+ * \param pl The pipeline given to glob_line().
+ */
+void glob_release(struct glob_state *gs, struct line *pl);
+
+/*!
+ * \fn void glob_print_stats(const struct glob_state *gs, FILE *out)
+ * \brief Print the number of patterns, directories read, calls of getdents64(2), names and arguments of an expansion.
+ *
+ * \param gs The expansion.
+ * \param out The stream.
+ */
+void glob_print_stats(const struct glob_state *gs, FILE *out);
+
+#endif //FISH_GLOB_H
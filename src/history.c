@@ -0,0 +1,422 @@
+/*!
+ * \file history.c
+ * \brief Implementation of the persistent history of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ *
+ * Used for the functions memmem and mremap.
+ */
+#define _GNU_SOURCE
+
+#include "history.h"
+
+#include "fish.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*!
+ * \def HISTORY_MAGIC
+ * \brief The number starting and ending each record (its bytes are not text, so a line does not look like a record).
+ */
+#define HISTORY_MAGIC 0xf15a4e57u
+
+/*!
+ * \def HISTORY_BUCKETS
+ * \brief Number of lists of the trigram index (a power of 2).
+ */
+#define HISTORY_BUCKETS 65536
+
+/*!
+ * \def HISTORY_MAX_SKIP
+ * \brief Maximal number of bytes skipped to find a valid record after a damaged one.
+ */
+#define HISTORY_MAX_SKIP (1 << 20)
+
+/*!
+ * \def HISTORY_LIST_DEFAULT
+ * \brief Number of entries printed by the internal command history by default.
+ */
+#define HISTORY_LIST_DEFAULT 16
+
+/*!
+ * \struct record_header
+ * \brief The start of a record, followed by the directory, the line, padding up to a multiple of 8 bytes, and the footer.
+ */
+struct record_header {
+    /*! \brief HISTORY_MAGIC. */
+    uint32_t magic;
+    /*! \brief The size of the whole record. */
+    uint32_t size;
+    /*! \brief The time the line was accepted, in microseconds since the Epoch. */
+    int64_t time_us;
+    /*! \brief The time taken to execute the line, in microseconds. */
+    int64_t duration_us;
+    /*! \brief The status of the line. */
+    int32_t status;
+    /*! \brief The length of the directory. */
+    uint32_t cwd_len;
+    /*! \brief The length of the line. */
+    uint32_t line_len;
+    /*! \brief Reserved, 0. */
+    uint32_t reserved;
+};
+
+/*!
+ * \struct record_footer
+ * \brief The end of a record, to walk the file backwards.
+ */
+struct record_footer {
+    /*! \brief The size of the whole record. */
+    uint32_t size;
+    /*! \brief HISTORY_MAGIC. */
+    uint32_t magic;
+};
+
+/*!
+ * \struct posting
+ * \brief The entries holding a trigram (or another trigram with the same hash), in file order.
+ */
+struct posting {
+    /*! \brief The numbers of the entries (indexes in history.starts). */
+    uint32_t *ids;
+    /*! \brief The number of entries. */
+    uint32_t count;
+    /*! \brief The allocated number of entries. */
+    uint32_t size;
+};
+
+/*!
+ * \struct history
+ * \brief The history file, its mapping and its index.
+ */
+static struct history {
+    /*! \brief The file, opened with O_APPEND, -1 if the history is not opened. */
+    int fd;
+    /*! \brief The mapping of the file, NULL if it is empty. */
+    char *map;
+    /*! \brief The size of the mapping. */
+    size_t len;
+    /*! \brief The positions of the entries indexed, in file order. */
+    uint64_t *starts;
+    /*! \brief The number of entries indexed. */
+    size_t count;
+    /*! \brief The allocated number of positions. */
+    size_t size;
+    /*! \brief The position where the indexing stopped. */
+    size_t indexed;
+    /*! \brief The lists of the trigram index (HISTORY_BUCKETS), NULL before the first search. */
+    struct posting *buckets;
+} hist = {.fd = -1};
+
+/*!
+ * \fn static bool record_at(size_t start, struct history_entry *e, size_t *size)
+ * \brief Check that a whole valid record starts at a position of the mapping, and read it.
+ *
+ * \param e Where to store the entry (may be NULL).
+ * \param size Where to store the size of the record (may be NULL).
+ */
+static bool record_at(size_t start, struct history_entry *e, size_t *size) {
+    struct record_header h;
+    struct record_footer f;
+    if(start > hist.len || hist.len - start < sizeof(h) + sizeof(f)) return false;
+    memcpy(&h, hist.map + start, sizeof(h)); // The records of a damaged file may be misaligned
+    if(h.magic != HISTORY_MAGIC || h.size > hist.len - start) return false;
+    if((uint64_t) sizeof(h) + h.cwd_len + h.line_len + sizeof(f) > h.size) return false;
+    memcpy(&f, hist.map + start + h.size - sizeof(f), sizeof(f));
+    if(f.magic != HISTORY_MAGIC || f.size != h.size) return false;
+
+    if(e != NULL) {
+        e->time_us = h.time_us;
+        e->duration_us = h.duration_us;
+        e->status = h.status;
+        e->cwd = hist.map + start + sizeof(h);
+        e->cwd_len = h.cwd_len;
+        e->line = e->cwd + h.cwd_len;
+        e->line_len = h.line_len;
+    }
+    if(size != NULL) *size = h.size;
+    return true;
+}
+
+/*!
+ * \fn static bool record_before(size_t *pos)
+ * \brief Find the last valid record ending before a position (skipping the bytes of a damaged record).
+ *
+ * \param pos The position, replaced by the start of the record found.
+ */
+static bool record_before(size_t *pos) {
+    size_t end = *pos < hist.len ? *pos : hist.len;
+    for(size_t skipped = 0; end >= sizeof(struct record_header) + sizeof(struct record_footer) && skipped < HISTORY_MAX_SKIP;
+        --end, ++skipped) {
+        struct record_footer f;
+        memcpy(&f, hist.map + end - sizeof(f), sizeof(f));
+        if(f.magic != HISTORY_MAGIC || f.size > end) continue;
+        size_t size;
+        if(record_at(end - f.size, NULL, &size) && size == f.size) {
+            *pos = end - f.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * \fn static bool record_from(size_t *pos)
+ * \brief Find the first valid record starting at or after a position (skipping the bytes of a damaged record).
+ *
+ * \param pos The position, replaced by the start of the record found.
+ */
+static bool record_from(size_t *pos) {
+    static const uint32_t magic = HISTORY_MAGIC;
+    size_t start = *pos;
+    while(start < hist.len && start - *pos < HISTORY_MAX_SKIP) {
+        if(record_at(start, NULL, NULL)) {
+            *pos = start;
+            return true;
+        }
+        const char *next = memmem(hist.map + start + 1, hist.len - start - 1, &magic, sizeof(magic));
+        if(next == NULL) return false;
+        start = (size_t) (next - hist.map);
+    }
+    return false;
+}
+
+/*!
+ * \fn static void index_clear()
+ * \brief Free the trigram index.
+ */
+static void index_clear() {
+    if(hist.buckets != NULL) {
+        for(size_t b = 0; b < HISTORY_BUCKETS; ++b) free(hist.buckets[b].ids);
+    }
+    free(hist.buckets);
+    free(hist.starts);
+    hist.buckets = NULL;
+    hist.starts = NULL;
+    hist.count = hist.size = hist.indexed = 0;
+}
+
+/*!
+ * \fn static uint32_t trigram_bucket(const char *s)
+ * \brief The list of the index of the three bytes at s.
+ */
+static uint32_t trigram_bucket(const char *s) {
+    const unsigned char *u = (const unsigned char *) s;
+    uint32_t t = (uint32_t) u[0] | (uint32_t) u[1] << 8 | (uint32_t) u[2] << 16;
+    return (t * 2654435761u) >> 16 & (HISTORY_BUCKETS - 1);
+}
+
+/*!
+ * \fn static void index_update()
+ * \brief Add the entries appended since the last update to the trigram index.
+ */
+static void index_update() {
+    if(hist.buckets == NULL) {
+        hist.buckets = calloc(HISTORY_BUCKETS, sizeof(struct posting));
+        if(hist.buckets == NULL) { perror("calloc"); exit(EXIT_FAILURE); }
+    }
+    size_t pos = hist.indexed;
+    struct history_entry e;
+    size_t size;
+    while(record_from(&pos) && record_at(pos, &e, &size)) {
+        if(hist.count == hist.size) {
+            hist.size = hist.size == 0 ? 1024 : hist.size * 2;
+            hist.starts = realloc(hist.starts, hist.size * sizeof(uint64_t));
+            if(hist.starts == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        }
+        uint32_t id = (uint32_t) hist.count;
+        hist.starts[hist.count++] = pos;
+        for(size_t i = 0; i + 3 <= e.line_len; ++i) {
+            struct posting *p = &hist.buckets[trigram_bucket(e.line + i)];
+            if(p->count > 0 && p->ids[p->count - 1] == id) continue; // Already listed for this line
+            if(p->count == p->size) {
+                p->size = p->size == 0 ? 8 : p->size * 2;
+                p->ids = realloc(p->ids, p->size * sizeof(uint32_t));
+                if(p->ids == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+            }
+            p->ids[p->count++] = id;
+        }
+        pos += size;
+        hist.indexed = pos;
+    }
+}
+
+int history_open(const char *path) {
+    history_close();
+    hist.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if(hist.fd == -1) return -1;
+    history_end();
+    return 0;
+}
+
+size_t history_end() {
+    if(hist.fd == -1) return 0;
+    struct stat st;
+    if(fstat(hist.fd, &st) == -1 || (size_t) st.st_size == hist.len) return hist.len;
+
+    size_t len = (size_t) st.st_size;
+    if(len < hist.len) index_clear(); // Truncated by another process
+    void *map = NULL;
+    if(hist.map == NULL) map = mmap(NULL, len, PROT_READ, MAP_SHARED, hist.fd, 0);
+    else if(len > 0) map = mremap(hist.map, hist.len, len, MREMAP_MAYMOVE);
+    else munmap(hist.map, hist.len);
+    if(map == MAP_FAILED) return hist.len;
+    hist.map = map;
+    hist.len = len;
+    return len;
+}
+
+void history_add(const char *line, int64_t time_us, int64_t duration_us, int status) {
+    if(hist.fd == -1 || line[strspn(line, " \t")] == '\0') return;
+    char cwd[PATH_MAX];
+    if(getcwd(cwd, sizeof(cwd)) == NULL) cwd[0] = '\0';
+
+    struct record_header h = {HISTORY_MAGIC, 0, time_us, duration_us, status, (uint32_t) strlen(cwd), (uint32_t) strlen(line), 0};
+    size_t data = sizeof(h) + h.cwd_len + h.line_len;
+    size_t padded = (data + 7) & ~(size_t) 7;
+    h.size = (uint32_t) (padded + sizeof(struct record_footer));
+    struct record_footer f = {h.size, HISTORY_MAGIC};
+
+    char *record = calloc(1, h.size);
+    if(record == NULL) { perror("calloc"); exit(EXIT_FAILURE); }
+    memcpy(record, &h, sizeof(h));
+    memcpy(record + sizeof(h), cwd, h.cwd_len);
+    memcpy(record + sizeof(h) + h.cwd_len, line, h.line_len);
+    memcpy(record + padded, &f, sizeof(f));
+    // A single write(2) with O_APPEND: the records of concurrent shells are not interleaved
+    ssize_t n;
+    do n = write(hist.fd, record, h.size); while(n == -1 && errno == EINTR);
+    free(record);
+}
+
+bool history_prev(size_t *pos, struct history_entry *e) {
+    return hist.map != NULL && record_before(pos) && record_at(*pos, e, NULL);
+}
+
+bool history_next(size_t *pos, struct history_entry *e) {
+    size_t size, next;
+    if(hist.map == NULL || !record_at(*pos, NULL, &size)) return false;
+    next = *pos + size;
+    if(!record_from(&next) || !record_at(next, e, NULL)) return false;
+    *pos = next;
+    return true;
+}
+
+bool history_search(const char *text, size_t *pos, struct history_entry *e) {
+    size_t len = strlen(text);
+    history_end();
+    if(hist.map == NULL) return false;
+
+    if(len < 3) { // No trigram: check the entries one by one
+        size_t p = *pos;
+        while(history_prev(&p, e)) {
+            if(memmem(e->line, e->line_len, text, len) != NULL) {
+                *pos = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    index_update();
+    // Only the entries holding the rarest trigram of the text may contain it
+    const struct posting *rarest = NULL;
+    for(size_t i = 0; i + 3 <= len; ++i) {
+        const struct posting *p = &hist.buckets[trigram_bucket(text + i)];
+        if(rarest == NULL || p->count < rarest->count) rarest = p;
+    }
+    size_t lo = 0, hi = rarest->count;
+    while(lo < hi) { // The first entry at or after pos
+        size_t mid = lo + (hi - lo) / 2;
+        if(hist.starts[rarest->ids[mid]] < *pos) lo = mid + 1;
+        else hi = mid;
+    }
+    while(lo-- > 0) {
+        size_t start = hist.starts[rarest->ids[lo]];
+        if(record_at(start, e, NULL) && memmem(e->line, e->line_len, text, len) != NULL) {
+            *pos = start;
+            return true;
+        }
+    }
+    return false;
+}
+
+void history_close() {
+    index_clear();
+    if(hist.map != NULL) munmap(hist.map, hist.len);
+    if(hist.fd != -1) close(hist.fd);
+    hist.map = NULL;
+    hist.len = 0;
+    hist.fd = -1;
+}
+
+int history_open_default() {
+    const char *path = getenv("FISH_HISTORY");
+    if(path != NULL) return path[0] == '\0' ? -1 : history_open(path);
+    const char *home = getenv("HOME");
+    if(home == NULL) return -1;
+    char file[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/.fish_history", home);
+    return history_open(file);
+}
+
+int builtin_history(char *args[], struct line *li) {
+    (void) li;
+    const char *text = NULL;
+    size_t count = HISTORY_LIST_DEFAULT;
+    size_t i = 1;
+    if(args[i] != NULL && strcmp(args[i], "-s") == 0 && args[i + 1] != NULL) {
+        text = args[i + 1];
+        i += 2;
+    }
+    if(args[i] != NULL) {
+        char *end;
+        count = strtoul(args[i], &end, 10);
+        if(*end != '\0' || args[i][0] == '\0' || args[i + 1] != NULL) {
+            fprintf(stderr, "usage: history [-s text] [count]\n");
+            return 2;
+        }
+    }
+    if(hist.fd == -1 && history_open_default() == -1) {
+        fprintf(stderr, "history: no history file\n");
+        return 1;
+    }
+
+    // Collect the entries from the most recent one, then print them in order.
+    // The file cannot hold more entries than records of the minimal size: "count" may be huge
+    size_t pos = history_end();
+    size_t max_records = pos / (sizeof(struct record_header) + sizeof(struct record_footer));
+    if(count > max_records) count = max_records;
+    size_t *found = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    if(found == NULL) {
+        perror("history: malloc");
+        return 1;
+    }
+    size_t n = 0;
+    struct history_entry e;
+    while(n < count && (text != NULL ? history_search(text, &pos, &e) : history_prev(&pos, &e))) found[n++] = pos;
+    while(n-- > 0) {
+        record_at(found[n], &e, NULL);
+        time_t seconds = (time_t) (e.time_us / 1000000);
+        struct tm tm;
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &tm));
+        printf("%s  %9.3f s  %3d  %.*s  %.*s\n", date, (double) e.duration_us / 1e6, shell_exit_status(e.status),
+               (int) e.cwd_len, e.cwd, (int) e.line_len, e.line);
+    }
+    free(found);
+    return 0;
+}
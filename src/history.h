@@ -0,0 +1,153 @@
+/*!
+ * \file history.h
+ * \brief Header file for the persistent history of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * Each line accepted by the interactive shell is appended to a log file ($FISH_HISTORY, or
+ * ~/.fish_history) with its start time, its working directory, its duration and its status. A
+ * record is framed by a header and a footer (both holding its size and a magic number) and written
+ * with a single write(2) on a descriptor opened with O_APPEND, so the records of several shells
+ * appending to the same file are never interleaved, and a record cut by a crash is skipped.
+ *
+ * The file is mapped in memory with mmap(2) and nothing is read when it is opened: the entries are
+ * reached from the end, walking the footers backwards. The substring search builds, on its first
+ * call, an index of the trigrams of the lines (a list of entries per trigram hash); a search then
+ * checks only the entries holding the rarest trigram of the text searched, most recent first. The
+ * index is extended with the entries appended since (by this shell or another one) at each search.
+ */
+#ifndef FISH_HISTORY_H
+#define FISH_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cmdline.h"
+
+/*!
+ * \struct history_entry
+ * \brief An entry of the history. The strings point into the mapping of the file and are not '\0' terminated.
+ */
+struct history_entry {
+    /*!
+     * \var time_us
+     * \brief The time the line was accepted, in microseconds since the Epoch.
+     */
+    int64_t time_us;
+    /*!
+     * \var duration_us
+     * \brief The time taken to execute the line, in microseconds.
+     */
+    int64_t duration_us;
+    /*!
+     * \var status
+     * \brief The status of the line (see execute_command_with_args).
+     */
+    int status;
+    /*!
+     * \var cwd
+     * \brief The working directory of the shell when the line was accepted.
+     */
+    const char *cwd;
+    /*!
+     * \var cwd_len
+     * \brief The length of cwd.
+     */
+    size_t cwd_len;
+    /*!
+     * \var line
+     * \brief The line.
+     */
+    const char *line;
+    /*!
+     * \var line_len
+     * \brief The length of line.
+     */
+    size_t line_len;
+};
+
+/*!
+ * \fn int history_open(const char *path)
+ * \brief Open (or create) the history file and map it in memory.
+ *
+ * \param path The file.
+ * \return 0 on success, -1 if an error occurs (errno is set).
+ */
+int history_open(const char *path);
+
+/*!
+ * \fn int history_open_default()
+ * \brief Open the file of $FISH_HISTORY, or ~/.fish_history. An empty FISH_HISTORY disables the history.
+ *
+ * \return 0 on success, -1 if the history is disabled or an error occurs.
+ */
+int history_open_default();
+
+/*!
+ * \fn void history_add(const char *line, int64_t time_us, int64_t duration_us, int status)
+ * \brief Append a line to the history with a single write(2). Empty lines are ignored.
+ *
+ * \param line The line.
+ * \param time_us The time the line was accepted, in microseconds since the Epoch.
+ * \param duration_us The time taken to execute the line, in microseconds.
+ * \param status The status of the line.
+ */
+void history_add(const char *line, int64_t time_us, int64_t duration_us, int status);
+
+/*!
+ * \fn size_t history_end()
+ * \brief Map the records appended since the last call (by any shell) and get the position after the last entry.
+ *
+ * A position is the offset of the start of an entry in the file, or the size of the file.
+ *
+ * \return The size of the file, 0 if the history is empty or not opened.
+ */
+size_t history_end();
+
+/*!
+ * \fn bool history_prev(size_t *pos, struct history_entry *e)
+ * \brief Get the entry before a position.
+ *
+ * \param pos The position, replaced by the position of the entry found.
+ * \param e Where to store the entry, valid until the next call of history_end() or history_search().
+ * \return false if there is no entry before pos.
+ */
+bool history_prev(size_t *pos, struct history_entry *e);
+
+/*!
+ * \fn bool history_next(size_t *pos, struct history_entry *e)
+ * \brief Get the entry after the one at a position.
+ *
+ * \param pos The position of an entry, replaced by the position of the entry found.
+ * \param e Where to store the entry, valid until the next call of history_end() or history_search().
+ * \return false if the entry at pos is the last one.
+ */
+bool history_next(size_t *pos, struct history_entry *e);
+
+/*!
+ * \fn bool history_search(const char *text, size_t *pos, struct history_entry *e)
+ * \brief Find the most recent entry before a position whose line contains a text.
+ *
+ * \param text The text searched (an empty text matches every entry).
+ * \param pos The position, replaced by the position of the entry found.
+ * \param e Where to store the entry, valid until the next call of history_end() or history_search().
+ * \return false if no entry before pos matches.
+ */
+bool history_search(const char *text, size_t *pos, struct history_entry *e);
+
+/*!
+ * \fn void history_close()
+ * \brief Unmap and close the history file, and free the index.
+ */
+void history_close();
+
+/*!
+ * \fn int builtin_history(char *args[], struct line *li)
+ * \brief history [-s text] [count]: print the last entries (16 by default) with their time, duration, status and directory,
+ * only those containing text with -s.
+ */
+int builtin_history(char *args[], struct line *li);
+
+#endif //FISH_HISTORY_H
@@ -0,0 +1,399 @@
+/*!
+ * \file jobctl.c
+ * \brief Implementation of the job control of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "jobctl.h"
+
+#include "fish.h"
+#include "timing.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+bool job_control = false;
+
+/*!
+ * \var shell_pgid
+ * \brief The process group of the shell, given the terminal back after every foreground job.
+ */
+static pid_t shell_pgid = 0;
+
+/*!
+ * \var shell_tmodes
+ * \brief The terminal modes of the shell, restored after every foreground job.
+ */
+static struct termios shell_tmodes;
+
+/*!
+ * \struct signal_name
+ * \brief A signal accepted by name by the internal command kill.
+ */
+static const struct signal_name {
+    /*! \brief The name of the signal, without the SIG prefix. */
+    const char *name;
+    /*! \brief The signal number. */
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CHLD", SIGCHLD},
+    {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU},
+};
+
+void jobctl_init() {
+    if(!interactive) return;
+
+    // Wait to be put in foreground by the parent shell before taking the terminal
+    pid_t pgid;
+    while(tcgetpgrp(STDIN_FILENO) != (pgid = getpgrp())) kill(-pgid, SIGTTIN);
+
+    apply_ignore(SIGTSTP, NULL);
+    apply_ignore(SIGTTIN, NULL);
+    apply_ignore(SIGTTOU, NULL);
+
+    shell_pgid = getpid();
+    if(pgid != shell_pgid && setpgid(0, shell_pgid) == -1) { perror("setpgid"); return; }
+    if(tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) { perror("tcsetpgrp"); return; }
+    if(tcgetattr(STDIN_FILENO, &shell_tmodes) == -1) { perror("tcgetattr"); return; }
+    job_control = true;
+}
+
+void jobctl_foreground(size_t group) {
+    pid_t pgid = jobs.groups[group].pgid;
+    if(job_control && pgid > 0 && tcsetpgrp(STDIN_FILENO, pgid) == -1) perror("tcsetpgrp");
+}
+
+/*!
+ * \fn static void take_terminal()
+ * \brief Give the terminal back to the shell, with its own terminal modes.
+ */
+static void take_terminal() {
+    if(!job_control) return;
+    if(tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) perror("tcsetpgrp");
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+}
+
+/*!
+ * \fn static int signal_group(size_t group, int sig)
+ * \brief Send a signal to every process of a job: to its process group, or to each process without job control.
+ *
+ * \return 0 on success, -1 if an error occurs (errno is set).
+ */
+static int signal_group(size_t group, int sig) {
+    struct job_group *g = &jobs.groups[group];
+    if(g->pgid > 0) return killpg(g->pgid, sig);
+    for(size_t slot = g->first; slot != JOB_NONE; slot = jobs.slots[slot].group_next) {
+        if(!jobs.slots[slot].done && kill(jobs.slots[slot].pid, sig) == -1) return -1;
+    }
+    return 0;
+}
+
+/*!
+ * \fn static void continue_group(size_t group, bool background)
+ * \brief Resume a job with SIGCONT, in foreground or in background.
+ *
+ * The processes are marked running at once: the SIGCHLD reporting them continued may come later.
+ */
+static void continue_group(size_t group, bool background) {
+    struct job_group *g = &jobs.groups[group];
+    g->background = background;
+    for(size_t slot = g->first; slot != JOB_NONE; slot = jobs.slots[slot].group_next) {
+        struct job *job = &jobs.slots[slot];
+        if(job->done) continue; // Already in the list of finished jobs if it ran in background
+        job->background = background;
+        job->stopped = false;
+    }
+    g->stopped = 0;
+    if(signal_group(group, SIGCONT) == -1) perror("kill (SIGCONT)");
+}
+
+void jobctl_wait_foreground(size_t group, int *exit_code) {
+    uint64_t trace_wait = TRACE_NOW();
+    while(jobs.groups[group].alive > 0 && jobs.groups[group].stopped < jobs.groups[group].alive) {
+        wait_events(-1);
+    }
+    take_terminal();
+    TRACE_COMPLETE("wait", trace_wait, jobs.groups[group].text, jobs.groups[group].id);
+
+    struct job_group *g = &jobs.groups[group];
+    size_t slot = g->first;
+
+    if(g->alive > 0) { // Stopped: the job goes on in background once resumed
+        g->background = true;
+        while(slot != JOB_NONE) {
+            size_t next = jobs.slots[slot].group_next;
+            if(jobs.slots[slot].done && !jobs.slots[slot].background) job_release(&jobs, slot);
+            else jobs.slots[slot].background = true;
+            slot = next;
+        }
+        if(interactive) fprintf(stderr, "\n[%d]+ Stopped\t%s\n", g->id, g->text);
+        *exit_code = 256 + g->stop_signal;
+        return;
+    }
+
+    *exit_code = g->status;
+    if(g->timed) time_report(group, NULL);
+    while(slot != JOB_NONE) { // The group is freed with its last process
+        struct job *job = &jobs.slots[slot];
+        size_t next = job->group_next;
+        if(job->background) { // Finished in background before fg: reported by print_backgrounds_processes
+            slot = next;
+            continue;
+        }
+        if(job->signaled == 0) {
+            if(interactive) fprintf(stderr, " FG: Command `%d` exited with status %d\n", job->pid, job->status_data);
+        } else if(job->signaled == 1) {
+            if(interactive) fprintf(stderr, " FG: Command `%d` killed by signal %d\n", job->pid, job->status_data);
+        }
+        job_release(&jobs, slot);
+        slot = next;
+    }
+}
+
+void jobctl_hangup() {
+    for(size_t i = 0; i < jobs.groups_size; ++i) {
+        if(jobs.groups[i].id != 0 && jobs.groups[i].stopped > 0) {
+            signal_group(i, SIGHUP);
+            signal_group(i, SIGCONT);
+        }
+    }
+}
+
+/*!
+ * \fn static size_t current_job()
+ * \brief The current job (the most recent one), JOB_NONE if there is no job.
+ */
+static size_t current_job() {
+    // The highest number is usually the line being started (not a job yet), or the current job
+    for(int id = jobs.max_id; id > 0; --id) {
+        size_t group = job_group_find(&jobs, id);
+        if(group != JOB_NONE) return group;
+    }
+    return JOB_NONE;
+}
+
+/*!
+ * \fn static size_t parse_job(const char *cmd, const char *spec)
+ * \brief Find the job designated by %n, %+, %%, a PID, or the current job if spec is NULL.
+ *
+ * \return The index of the group, JOB_NONE (after printing an error) if there is no such job.
+ */
+static size_t parse_job(const char *cmd, const char *spec) {
+    size_t group = JOB_NONE;
+    char *end;
+    if(spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 || strcmp(spec, "%") == 0) {
+        group = current_job();
+        if(group == JOB_NONE) fprintf(stderr, "%s: no current job\n", cmd);
+        return group;
+    }
+    if(spec[0] == '%') {
+        long id = strtol(spec + 1, &end, 10);
+        if(*end == '\0' && end != spec + 1) group = job_group_find(&jobs, (int) id);
+    } else {
+        long pid = strtol(spec, &end, 10);
+        if(*end == '\0' && end != spec) {
+            size_t slot = job_find(&jobs, (pid_t) pid);
+            if(slot != JOB_NONE) group = jobs.slots[slot].group;
+        }
+    }
+    if(group == JOB_NONE) fprintf(stderr, "%s: %s: no such job\n", cmd, spec);
+    return group;
+}
+
+/*!
+ * \fn static const char *job_state(struct job_group *g)
+ * \brief The state of a job as shown by jobs.
+ */
+static const char *job_state(struct job_group *g) {
+    if(g->alive == 0) return "Done";
+    if(g->stopped == g->alive) return "Stopped";
+    return "Running";
+}
+
+/*!
+ * \fn int builtin_jobs(char *args[], struct line *li)
+ * \brief jobs [-l]: list the jobs in the order of their numbers, with the PIDs of their processes if -l is given.
+ */
+int builtin_jobs(char *args[], struct line *li) {
+    (void) li;
+    bool long_format = args[1] != NULL && strcmp(args[1], "-l") == 0;
+    if(args[1] != NULL && (!long_format || args[2] != NULL)) {
+        fprintf(stderr, "jobs: usage: jobs [-l]\n");
+        return 2;
+    }
+
+    size_t current = current_job();
+    int max_id = current == JOB_NONE ? 0 : jobs.groups[current].id;
+    for(int id = 1; id <= max_id; ++id) {
+        size_t group = job_group_find(&jobs, id);
+        if(group == JOB_NONE) continue;
+        struct job_group *g = &jobs.groups[group];
+        printf("[%d]%c %-8s %s%s\n", g->id, group == current ? '+' : ' ', job_state(g), g->text,
+               g->alive > g->stopped ? " &" : "");
+        if(long_format) {
+            for(size_t slot = g->first; slot != JOB_NONE; slot = jobs.slots[slot].group_next) {
+                printf("\t%d %s\n", jobs.slots[slot].pid,
+                       jobs.slots[slot].done ? "done" : jobs.slots[slot].stopped ? "stopped" : "running");
+            }
+        }
+    }
+    return 0;
+}
+
+/*!
+ * \fn int builtin_fg(char *args[], struct line *li)
+ * \brief fg [job]: resume a job in foreground and wait for it.
+ */
+int builtin_fg(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "fg: too many arguments\n");
+        return 2;
+    }
+    size_t group = parse_job("fg", args[1]);
+    if(group == JOB_NONE) return 1;
+
+    printf("%s\n", jobs.groups[group].text);
+    fflush(stdout);
+    jobctl_foreground(group);
+    continue_group(group, false);
+    int status;
+    jobctl_wait_foreground(group, &status);
+    return status;
+}
+
+/*!
+ * \fn int builtin_bg(char *args[], struct line *li)
+ * \brief bg [job...]: resume stopped jobs in background.
+ */
+int builtin_bg(char *args[], struct line *li) {
+    (void) li;
+    int status = 0;
+    size_t i = 1;
+    do {
+        size_t group = parse_job("bg", args[i]);
+        if(group == JOB_NONE) { status = 1; continue; }
+        struct job_group *g = &jobs.groups[group];
+        if(g->stopped == 0) {
+            fprintf(stderr, "bg: job %d already in background\n", g->id);
+            continue;
+        }
+        continue_group(group, true);
+        if(interactive) printf("[%d] %s &\n", g->id, g->text);
+    } while(args[i] != NULL && args[++i] != NULL);
+    return status;
+}
+
+/*!
+ * \fn int builtin_wait(char *args[], struct line *li)
+ * \brief wait [job...]: wait until the given jobs, or every background job, finish or stop.
+ * The status is the one of the last job given, 0 without argument.
+ */
+int builtin_wait(char *args[], struct line *li) {
+    (void) li;
+    int status = 0;
+    if(args[1] == NULL) {
+        for(size_t i = 0; i < jobs.groups_size; ++i) {
+            while(jobs.groups[i].id != 0 && jobs.groups[i].background
+                  && jobs.groups[i].alive > 0 && jobs.groups[i].stopped < jobs.groups[i].alive) {
+                wait_events(-1);
+            }
+        }
+        return 0;
+    }
+    for(size_t i = 1; args[i] != NULL; ++i) {
+        size_t group = parse_job("wait", args[i]);
+        if(group == JOB_NONE) { status = 127; continue; }
+        while(jobs.groups[group].alive > 0 && jobs.groups[group].stopped < jobs.groups[group].alive) wait_events(-1);
+        status = jobs.groups[group].alive > 0 ? 256 + jobs.groups[group].stop_signal : jobs.groups[group].status;
+    }
+    return status;
+}
+
+/*!
+ * \fn static int parse_signal(const char *str)
+ * \brief Convert a signal number or name (with or without the SIG prefix) into its number, -1 if unknown.
+ */
+static int parse_signal(const char *str) {
+    char *end;
+    long n = strtol(str, &end, 10);
+    if(*end == '\0' && end != str) return (n >= 0 && n < NSIG) ? (int) n : -1;
+    if(strncmp(str, "SIG", 3) == 0) str += 3;
+    for(size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); ++i) {
+        if(strcasecmp(str, signal_names[i].name) == 0) return signal_names[i].number;
+    }
+    return -1;
+}
+
+/*!
+ * \fn int builtin_kill(char *args[], struct line *li)
+ * \brief kill [-s sig | -sig] job|pid... or kill -l: send a signal (SIGTERM by default) to jobs or processes.
+ */
+int builtin_kill(char *args[], struct line *li) {
+    (void) li;
+    int sig = SIGTERM;
+    size_t i = 1;
+
+    if(args[1] != NULL && strcmp(args[1], "-l") == 0) {
+        for(size_t j = 0; j < sizeof(signal_names) / sizeof(signal_names[0]); ++j) {
+            printf("%2d) SIG%s\n", signal_names[j].number, signal_names[j].name);
+        }
+        return 0;
+    }
+    if(args[1] != NULL && args[1][0] == '-') {
+        const char *name = args[1] + 1;
+        if(strcmp(args[1], "-s") == 0) name = args[2];
+        if(name == NULL || (sig = parse_signal(name)) == -1) {
+            fprintf(stderr, "kill: %s: invalid signal specification\n", name == NULL ? "-s" : name);
+            return 1;
+        }
+        i = strcmp(args[1], "-s") == 0 ? 3 : 2;
+    }
+    if(args[i] == NULL) {
+        fprintf(stderr, "kill: usage: kill [-s sigspec | -sigspec] pid | %%job ... or kill -l\n");
+        return 2;
+    }
+
+    int status = 0;
+    for(; args[i] != NULL; ++i) {
+        int ret;
+        if(args[i][0] == '%') {
+            size_t group = parse_job("kill", args[i]);
+            if(group == JOB_NONE) { status = 1; continue; }
+            ret = signal_group(group, sig);
+            // A stopped job only handles the signal once continued
+            if(ret == 0 && jobs.groups[group].stopped > 0 && sig != SIGSTOP && sig != SIGTSTP && sig != SIGCONT) {
+                continue_group(group, jobs.groups[group].background);
+            }
+        } else {
+            char *end;
+            long pid = strtol(args[i], &end, 10);
+            if(*end != '\0' || end == args[i]) {
+                fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", args[i]);
+                status = 1;
+                continue;
+            }
+            ret = kill((pid_t) pid, sig);
+        }
+        if(ret == -1) {
+            fprintf(stderr, "kill: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
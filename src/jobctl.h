@@ -0,0 +1,95 @@
+/*!
+ * \file jobctl.h
+ * \brief Header file for the job control of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * Every pipeline is a job (see struct job_group) running in its own process group.
+ * When the shell is interactive, the terminal is given to the process group of the foreground job
+ * with tcsetpgrp(), so Ctrl-C and Ctrl-Z only reach the job. A stopped job can be resumed in
+ * foreground or in background with the internal commands fg and bg.
+ */
+#ifndef FISH_JOBCTL_H
+#define FISH_JOBCTL_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "cmdline.h"
+
+/*!
+ * \var job_control
+ * \brief true when the shell owns its terminal and starts every job in its own process group.
+ */
+extern bool job_control;
+
+/*!
+ * \fn void jobctl_init()
+ * \brief Enable the job control if the shell is interactive.
+ *
+ * Wait to be in foreground, put the shell in its own process group, take the terminal,
+ * and ignore SIGTSTP, SIGTTIN and SIGTTOU.
+ */
+void jobctl_init();
+
+/*!
+ * \fn void jobctl_foreground(size_t group)
+ * \brief Give the terminal to the process group of a job (no-op without job control).
+ *
+ * \param group The index of the group in the job table.
+ */
+void jobctl_foreground(size_t group);
+
+/*!
+ * \fn void jobctl_wait_foreground(size_t group, int *exit_code)
+ * \brief Wait until every process of a foreground job exited, or the job is stopped.
+ *
+ * A finished job is removed from the job table and its status is stored in exit_code.
+ * A stopped job is moved in background and exit_code is set to 256 + the stop signal.
+ * The shell takes the terminal back in both cases.
+ *
+ * \param group The index of the group in the job table.
+ * \param exit_code Where to store the status of the job (see execute_command_with_args).
+ */
+void jobctl_wait_foreground(size_t group, int *exit_code);
+
+/*!
+ * \fn void jobctl_hangup()
+ * \brief Send SIGHUP then SIGCONT to the stopped jobs, so they do not stay stopped after the shell exits.
+ */
+void jobctl_hangup();
+
+/*!
+ * \fn int builtin_jobs(char *args[], struct line *li)
+ * \brief jobs [-l]: list the jobs and their state (Running, Stopped, Done).
+ *
+ * In the job control internal commands, a job is designated by %n (its number), %+ or %%
+ * (the current job, the most recent one), or by a PID.
+ */
+int builtin_jobs(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_fg(char *args[], struct line *li)
+ * \brief fg [job]: resume a job in foreground and wait for it. The status is the one of the job.
+ */
+int builtin_fg(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_bg(char *args[], struct line *li)
+ * \brief bg [job...]: resume stopped jobs in background.
+ */
+int builtin_bg(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_wait(char *args[], struct line *li)
+ * \brief wait [job...]: wait for the given jobs, or for every background job.
+ */
+int builtin_wait(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_kill(char *args[], struct line *li)
+ * \brief kill [-s sig | -sig] job|pid... or kill -l: send a signal to jobs or processes.
+ */
+int builtin_kill(char *args[], struct line *li);
+
+#endif //FISH_JOBCTL_H
@@ -0,0 +1,156 @@
+/*!
+ * \file launcher.c
+ * \brief Implementation of the process launch backends.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "launcher.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*!
+ * \def HAVE_SPAWN_TCSETPGRP
+ * \brief Defined when posix_spawn can give the terminal to the new process group (glibc 2.35 and later).
+ */
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+#endif
+
+enum launch_backend launch_backend = LAUNCH_FORK;
+
+const char *launch_backend_name(enum launch_backend backend) {
+    switch(backend) {
+        case LAUNCH_SPAWN:
+            return "spawn";
+        case LAUNCH_ZYGOTE:
+            return "zygote";
+        case LAUNCH_FORK:
+        default:
+            return "fork";
+    }
+}
+
+bool launch_backend_parse(const char *name, enum launch_backend *backend) {
+    if(strcmp(name, "fork") == 0) {
+        *backend = LAUNCH_FORK;
+        return true;
+    }
+    if(strcmp(name, "spawn") == 0) {
+        *backend = LAUNCH_SPAWN;
+        return true;
+    }
+    if(strcmp(name, "zygote") == 0) {
+        *backend = LAUNCH_ZYGOTE;
+        return true;
+    }
+    return false;
+}
+
+int spawn_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl,
+                  size_t cmd_index, bool background, pid_t pgid, char **envp) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err;
+
+    bool not_the_last_one = (cmd_index < line->n_cmds - 1);
+    char *file_input = (cmd_index == 0) ? line->file_input : NULL;
+    char *file_output = not_the_last_one ? NULL : line->file_output;
+
+    if(background && cmd_index == 0 && file_input == NULL) {
+        file_input = "/dev/null";
+    }
+
+    // The first command of a foreground job takes the terminal, between setpgid() and execve()
+    bool take_terminal = pgid == 0 && !background;
+#ifndef HAVE_SPAWN_TCSETPGRP
+    if(take_terminal) return ENOTSUP;
+#endif
+
+    if((err = posix_spawn_file_actions_init(&actions)) != 0) return err;
+    if((err = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    if(pipeControl->pipe_prev[PREAD] != -1) {
+        if((err = posix_spawn_file_actions_adddup2(&actions, pipeControl->pipe_prev[PREAD], STDIN_FILENO)) != 0) goto end;
+        if((err = posix_spawn_file_actions_addclose(&actions, pipeControl->pipe_prev[PREAD])) != 0) goto end;
+    }
+
+    if(not_the_last_one) {
+        if((err = posix_spawn_file_actions_adddup2(&actions, pipeControl->pipe_next[PWRITE], STDOUT_FILENO)) != 0) goto end;
+        if((err = posix_spawn_file_actions_addclose(&actions, pipeControl->pipe_next[PWRITE])) != 0) goto end;
+        if((err = posix_spawn_file_actions_addclose(&actions, pipeControl->pipe_next[PREAD])) != 0) goto end;
+    }
+
+    if(file_input != NULL) {
+        if((err = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, file_input, O_RDONLY, 0)) != 0) goto end;
+    }
+    if(file_output != NULL) {
+        int flags = O_WRONLY | O_CREAT | (line->file_output_append ? O_APPEND : O_TRUNC);
+        if((err = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, file_output, flags, 0644)) != 0) goto end;
+    }
+
+#ifdef HAVE_SPAWN_TCSETPGRP
+    if(take_terminal) {
+        if((err = posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO)) != 0) goto end;
+    }
+#endif
+
+    // The shell ignores SIGINT and may block SIGCHLD: a foreground command gets the default action back,
+    // and every command starts with an empty signal mask, like after fork() + execv().
+    // With job control, the shell also ignores the stop signals sent by the terminal.
+    sigset_t sigdefault, sigmask;
+    sigemptyset(&sigdefault);
+    sigemptyset(&sigmask);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if(!background) sigaddset(&sigdefault, SIGINT);
+    if(pgid != -1) {
+        sigaddset(&sigdefault, SIGTSTP);
+        sigaddset(&sigdefault, SIGTTIN);
+        sigaddset(&sigdefault, SIGTTOU);
+        flags |= POSIX_SPAWN_SETPGROUP;
+        if((err = posix_spawnattr_setpgroup(&attr, pgid)) != 0) goto end;
+    }
+    if((err = posix_spawnattr_setsigdefault(&attr, &sigdefault)) != 0) goto end;
+    if((err = posix_spawnattr_setsigmask(&attr, &sigmask)) != 0) goto end;
+    if((err = posix_spawnattr_setflags(&attr, flags)) != 0) goto end;
+
+    err = posix_spawn(pid, path, &actions, &attr, args, envp);
+
+end:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+
+void report_spawn_error(const char *cmd, struct line *line, int err) {
+    // The fork server only fails to fork: the command reports its own errors
+    if(launch_backend == LAUNCH_ZYGOTE) {
+        fprintf(stderr, "fork of command '%s' by the fork server: %s\n", cmd, strerror(err));
+        return;
+    }
+    // posix_spawn() gives the same errno for a missing command and a missing input file.
+    if(line->file_input != NULL && access(line->file_input, R_OK) == -1) {
+        fprintf(stderr, "open input file '%s': %s\n", line->file_input, strerror(errno));
+    } else if(err == ENOENT) {
+        fprintf(stderr, "%s: Command not found\n", cmd);
+    } else {
+        fprintf(stderr, "posix_spawn of command '%s': %s\n", cmd, strerror(err));
+    }
+}
@@ -0,0 +1,97 @@
+/*!
+ * \file launcher.h
+ * \brief Header file for the process launch backends.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The shell can start external commands either with the classic fork() + execv() sequence,
+ * or with posix_spawn() which avoids copying the page tables of the shell for every command.
+ * The backend is selected at runtime with the internal command "launcher".
+ */
+#ifndef FISH_LAUNCHER_H
+#define FISH_LAUNCHER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "cmdline.h"
+#include "utils.h"
+
+/*!
+ * \enum launch_backend
+ * \brief The available backends used to start external commands.
+ */
+enum launch_backend {
+    /*! fork() the shell, do the redirections in the child, then execve(). */
+    LAUNCH_FORK,
+    /*! posix_spawn() with the redirections translated into file actions. */
+    LAUNCH_SPAWN,
+    /*! Ask the fork server to fork the command from its own small image (see zygote.h). */
+    LAUNCH_ZYGOTE
+};
+
+/*!
+ * \var launch_backend
+ * \brief The backend currently used by execute_command_with_args.
+ */
+extern enum launch_backend launch_backend;
+
+/*!
+ * \fn const char *launch_backend_name(enum launch_backend backend)
+ * \brief Get the name of a backend, as accepted by launch_backend_parse.
+ *
+ * \param backend The backend.
+ * \return A static string ("fork", "spawn" or "zygote").
+ */
+const char *launch_backend_name(enum launch_backend backend);
+
+/*!
+ * \fn bool launch_backend_parse(const char *name, enum launch_backend *backend)
+ * \brief Convert a backend name into its enum value.
+ *
+ * \param name The name of the backend ("fork", "spawn" or "zygote").
+ * \param backend Where to store the backend if the name is known.
+ * \return true if the name is known, false otherwise.
+ */
+bool launch_backend_parse(const char *name, enum launch_backend *backend);
+
+/*!
+ * \fn int spawn_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl, size_t cmd_index, bool background, pid_t pgid, char **envp)
+ * \brief Start a command of a pipeline with posix_spawn().
+ *
+ * The pipes of pipeControl and the redirections of line are turned into posix_spawn file actions,
+ * in the same order as the fork backend applies them: previous pipe, next pipe, input file (first command
+ * only), output file (last command only).
+ * A foreground command gets the default action for SIGINT back, a background one keeps ignoring it
+ * and reads from /dev/null if it has no input redirection.
+ *
+ * With job control (pgid != -1), the command is put in the process group of its job and gets the default
+ * action for the stop signals back. The first command of a foreground job also takes the terminal, which
+ * needs posix_spawn_file_actions_addtcsetpgrp_np() (glibc 2.35): without it, ENOTSUP is returned and the
+ * caller falls back to fork().
+ *
+ * \param pid Where to store the PID of the new process.
+ * \param path The path of the command to execute (see cmdhash_lookup).
+ * \param args The arguments of the command (NULL terminated).
+ * \param line The line structure of the command executed.
+ * \param pipeControl The pipe control structure.
+ * \param cmd_index The index of the command in the line structure.
+ * \param background true if the command is executed in background.
+ * \param pgid The process group to join, 0 to create a new one (first command of a job), -1 without job control.
+ * \param envp The environment of the command (see vars_envp).
+ * \return 0 on success, an errno value otherwise.
+ */
+int spawn_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl,
+                  size_t cmd_index, bool background, pid_t pgid, char **envp);
+
+/*!
+ * \fn void report_spawn_error(const char *cmd, struct line *line, int err)
+ * \brief Print the error returned by spawn_command or zygote_command with the same wording as the fork backend.
+ *
+ * \param cmd The command which could not be started.
+ * \param line The line structure of the command executed.
+ * \param err The errno value returned by spawn_command or zygote_command.
+ */
+void report_spawn_error(const char *cmd, struct line *line, int err);
+
+#endif //FISH_LAUNCHER_H
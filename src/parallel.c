@@ -0,0 +1,499 @@
+/*!
+ * \file parallel.c
+ * \brief Implementation of the internal command parallel.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "parallel.h"
+
+#include "builtins.h"
+#include "cmdhash.h"
+#include "event.h"
+#include "fish.h"
+#include "reader.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*!
+ * \var environ
+ * \brief The environment of the shell, given as is to the commands.
+ */
+extern char **environ;
+
+/*!
+ * \struct buffer
+ * \brief A growable byte buffer collecting an output of a command.
+ */
+struct buffer {
+    /*! \brief The bytes. */
+    char *data;
+    /*! \brief The number of bytes used. */
+    size_t len;
+    /*! \brief The allocated size. */
+    size_t size;
+};
+
+/*!
+ * \struct pjob
+ * \brief A command started by parallel.
+ */
+struct pjob {
+    /*! \brief The slot of the process in the job table, JOB_NONE if the pjob is free. */
+    size_t slot;
+    /*! \brief The read ends of the stdout and stderr pipes of the command, -1 once closed. */
+    int fds[2];
+    /*! \brief The collected stdout and stderr of the command. */
+    struct buffer out[2];
+    /*! \brief The start date, in nanoseconds on the monotonic clock. */
+    long long start;
+    /*! \brief The arguments of the command (allocated). */
+    char **argv;
+};
+
+/*!
+ * \struct parallel
+ * \brief The state of a run of parallel.
+ */
+struct parallel {
+    /*! \brief The argument template (NULL terminated). */
+    char **template;
+    /*! \brief The number of arguments of the template. */
+    size_t template_len;
+    /*! \brief true if an argument of the template contains {}. */
+    bool has_placeholder;
+    /*! \brief The commands in flight, max_jobs elements. */
+    struct pjob *pjobs;
+    /*! \brief The maximal number of commands in flight. */
+    size_t max_jobs;
+    /*! \brief The number of commands in flight. */
+    size_t running;
+    /*! \brief The latency of every finished command, in nanoseconds. */
+    long long *latencies;
+    /*! \brief The number of finished commands. */
+    size_t done;
+    /*! \brief Allocated number of elements of latencies. */
+    size_t latencies_size;
+    /*! \brief The number of commands which failed or could not be started. */
+    size_t failed;
+    /*! \brief The number of commands which could not be started. */
+    size_t not_started;
+    /*! \brief true once a command was interrupted by SIGINT. */
+    bool interrupted;
+};
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*!
+ * \fn static void buffer_append(struct buffer *buf, const char *data, size_t len)
+ * \brief Append bytes to a buffer.
+ */
+static void buffer_append(struct buffer *buf, const char *data, size_t len) {
+    if(buf->len + len > buf->size) {
+        size_t new_size = buf->size ? buf->size * 2 : 4096;
+        while(new_size < buf->len + len) new_size *= 2;
+        char *new_data = realloc(buf->data, new_size);
+        if(new_data == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        buf->data = new_data;
+        buf->size = new_size;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+/*!
+ * \fn static void write_all(int fd, const char *data, size_t len)
+ * \brief Write a whole buffer, in as few write(2) as possible.
+ */
+static void write_all(int fd, const char *data, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, data, len);
+        if(n == -1) {
+            if(errno == EINTR) continue;
+            return; // The reader is gone: the output of the command is lost, like with a pipe
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+/*!
+ * \fn static char *substitute(const char *arg, const char *line)
+ * \brief Copy an argument of the template with every {} replaced by the line.
+ */
+static char *substitute(const char *arg, const char *line) {
+    size_t line_len = strlen(line), len = 0;
+    for(const char *p = arg; *p; ++p) len += (p[0] == '{' && p[1] == '}') ? (p++, line_len) : 1;
+
+    char *result = malloc(len + 1);
+    if(result == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    char *out = result;
+    for(const char *p = arg; *p; ++p) {
+        if(p[0] == '{' && p[1] == '}') {
+            memcpy(out, line, line_len);
+            out += line_len;
+            p++;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+/*!
+ * \fn static char **build_argv(struct parallel *par, const char *line)
+ * \brief Build the arguments of the command of a line from the template.
+ */
+static char **build_argv(struct parallel *par, const char *line) {
+    char **argv = malloc((par->template_len + 2) * sizeof(char *));
+    if(argv == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t n = 0;
+    for(size_t i = 0; i < par->template_len; ++i) argv[n++] = substitute(par->template[i], line);
+    if(!par->has_placeholder) argv[n++] = substitute("{}", line);
+    argv[n] = NULL;
+    return argv;
+}
+
+static void free_argv(char **argv) {
+    for(size_t i = 0; argv[i] != NULL; ++i) free(argv[i]);
+    free(argv);
+}
+
+/*!
+ * \fn static int spawn_command(pid_t *pid, const char *path, char **argv, int out[2], int err[2])
+ * \brief Start an external command with posix_spawn(), its stdout and stderr in the given pipes and /dev/null as stdin.
+ * \return 0 on success, an error number otherwise.
+ */
+static int spawn_command(pid_t *pid, const char *path, char **argv, int out[2], int err[2]) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int ret;
+    if((ret = posix_spawn_file_actions_init(&actions)) != 0) return ret;
+    if((ret = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return ret;
+    }
+    if((ret = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0)) != 0) goto end;
+    if((ret = posix_spawn_file_actions_adddup2(&actions, out[PWRITE], STDOUT_FILENO)) != 0) goto end;
+    if((ret = posix_spawn_file_actions_adddup2(&actions, err[PWRITE], STDERR_FILENO)) != 0) goto end;
+
+    // Like the foreground commands: SIGINT gets its default action back, and the signal mask is emptied
+    sigset_t sigdefault, sigmask;
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigemptyset(&sigmask);
+    if((ret = posix_spawnattr_setsigdefault(&attr, &sigdefault)) != 0) goto end;
+    if((ret = posix_spawnattr_setsigmask(&attr, &sigmask)) != 0) goto end;
+    if((ret = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK)) != 0) goto end;
+
+    ret = posix_spawn(pid, path, &actions, &attr, argv, environ);
+
+end:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return ret;
+}
+
+/*!
+ * \fn static pid_t start_command(char **argv, int out[2], int err[2], struct line *li)
+ * \brief Start a command with its stdout and stderr in the given pipes and /dev/null as stdin.
+ *
+ * An internal command is forked, an external one is started with posix_spawn().
+ *
+ * \return The PID of the command, -1 if it could not be started (an error is printed).
+ */
+static pid_t start_command(char **argv, int out[2], int err[2], struct line *li) {
+    const struct builtin *builtin = builtin_find(argv[0]);
+    if(builtin != NULL) {
+        pid_t pid = fork();
+        if(pid == -1) { perror("fork"); return -1; }
+        if(pid == 0) {
+            int null_fd = open("/dev/null", O_RDONLY);
+            if(null_fd != -1) dup2(null_fd, STDIN_FILENO);
+            dup2(out[PWRITE], STDOUT_FILENO);
+            dup2(err[PWRITE], STDERR_FILENO);
+            struct sigaction sa_default;
+            sigemptyset(&sa_default.sa_mask);
+            sa_default.sa_flags = 0;
+            sa_default.sa_handler = SIG_DFL;
+            if(sigaction(SIGINT, &sa_default, NULL) == -1) { perror("sigaction"); exit(EXIT_FAILURE); }
+            event_init();
+            exit(shell_exit_status(builtin->fn(argv, li)));
+        }
+        return pid;
+    }
+
+    const char *path = cmdhash_lookup(argv[0]);
+    if(path == NULL) {
+        fprintf(stderr, "%s: Command not found\n", argv[0]);
+        return -1;
+    }
+
+    pid_t pid;
+    int ret = spawn_command(&pid, path, argv, out, err);
+    if(ret != 0) {
+        fprintf(stderr, "posix_spawn of command '%s': %s\n", argv[0], strerror(ret));
+        return -1;
+    }
+    return pid;
+}
+
+/*!
+ * \fn static bool start_job(struct parallel *par, struct pjob *pjob, const char *line, struct line *li)
+ * \brief Start the command of a line in a free pjob.
+ * \return true if the command is running, false if it could not be started (counted as failed).
+ */
+static bool start_job(struct parallel *par, struct pjob *pjob, const char *line, struct line *li) {
+    int out[2], err[2];
+    if(pipe2(out, O_CLOEXEC) == -1) { perror("pipe"); exit(EXIT_FAILURE); }
+    if(pipe2(err, O_CLOEXEC) == -1) { perror("pipe"); exit(EXIT_FAILURE); }
+
+    pjob->argv = build_argv(par, line);
+    pjob->start = now_ns();
+    pid_t pid = start_command(pjob->argv, out, err, li);
+    close(out[PWRITE]);
+    close(err[PWRITE]);
+    if(pid == -1) {
+        close(out[PREAD]);
+        close(err[PREAD]);
+        free_argv(pjob->argv);
+        par->failed++;
+        par->not_started++;
+        return false;
+    }
+
+    pjob->slot = job_add(&jobs, pid, false, JOB_NONE);
+    if(pjob->slot == JOB_NONE) { perror("realloc"); exit(EXIT_FAILURE); }
+    pjob->fds[0] = out[PREAD];
+    pjob->fds[1] = err[PREAD];
+    pjob->out[0].len = 0;
+    pjob->out[1].len = 0;
+    par->running++;
+    return true;
+}
+
+/*!
+ * \fn static void finish_job(struct parallel *par, struct pjob *pjob)
+ * \brief Print the output of a finished command, record its latency and status, and free its pjob.
+ */
+static void finish_job(struct parallel *par, struct pjob *pjob) {
+    long long latency = now_ns() - pjob->start;
+
+    fflush(stdout);
+    write_all(STDOUT_FILENO, pjob->out[0].data, pjob->out[0].len);
+    write_all(STDERR_FILENO, pjob->out[1].data, pjob->out[1].len);
+
+    struct job *job = &jobs.slots[pjob->slot];
+    if(job->signaled == 1 || job->status_data != 0) par->failed++;
+    if(job->signaled == 1 && job->status_data == SIGINT) par->interrupted = true;
+    job_release(&jobs, pjob->slot);
+    pjob->slot = JOB_NONE;
+    free_argv(pjob->argv);
+    par->running--;
+
+    if(par->done == par->latencies_size) {
+        size_t new_size = par->latencies_size ? par->latencies_size * 2 : 1024;
+        long long *latencies = realloc(par->latencies, new_size * sizeof(long long));
+        if(latencies == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        par->latencies = latencies;
+        par->latencies_size = new_size;
+    }
+    par->latencies[par->done++] = latency;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    long long x = *(const long long *) a, y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
+
+/*!
+ * \fn static double percentile_ms(struct parallel *par, double p)
+ * \brief The latency under which p percent of the commands finished (nearest rank), in milliseconds.
+ * The latencies must be sorted.
+ */
+static double percentile_ms(struct parallel *par, double p) {
+    size_t rank = (size_t) (p / 100.0 * par->done + 0.999999);
+    if(rank == 0) rank = 1;
+    if(rank > par->done) rank = par->done;
+    return par->latencies[rank - 1] / 1e6;
+}
+
+/*!
+ * \fn static void report(struct parallel *par, long long elapsed)
+ * \brief Print the throughput and the latency percentiles of the commands.
+ */
+static void report(struct parallel *par, long long elapsed) {
+    double seconds = elapsed / 1e9;
+    fprintf(stderr, "parallel: %zu jobs (%zu failed) in %.3f s, %.1f jobs/s", par->done + par->not_started,
+            par->failed, seconds, seconds > 0 ? par->done / seconds : 0.0);
+    if(par->done > 0) {
+        qsort(par->latencies, par->done, sizeof(long long), compare_latency);
+        fprintf(stderr, ", latency p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms",
+                percentile_ms(par, 50), percentile_ms(par, 95), percentile_ms(par, 99),
+                par->latencies[par->done - 1] / 1e6);
+    }
+    fprintf(stderr, "\n");
+}
+
+/*!
+ * \fn static void usage_parallel()
+ * \brief Print the usage of parallel on stderr.
+ */
+static void usage_parallel() {
+    fprintf(stderr, "parallel: usage: parallel [-j N] [-a file] [-q] command [arg...]\n");
+}
+
+int builtin_parallel(char *args[], struct line *li) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_jobs = n_cpus > 0 ? (size_t) n_cpus : 1;
+    const char *input_file = NULL;
+    bool quiet = false;
+
+    size_t i = 1;
+    for(; args[i] != NULL && args[i][0] == '-'; ++i) {
+        if(strcmp(args[i], "-q") == 0) {
+            quiet = true;
+        } else if(strcmp(args[i], "-j") == 0 && args[i + 1] != NULL) {
+            char *end;
+            long n = strtol(args[++i], &end, 10);
+            if(*end != '\0' || n <= 0) {
+                fprintf(stderr, "parallel: %s: invalid number of jobs\n", args[i]);
+                return 2;
+            }
+            max_jobs = (size_t) n;
+        } else if(strcmp(args[i], "-a") == 0 && args[i + 1] != NULL) {
+            input_file = args[++i];
+        } else {
+            usage_parallel();
+            return 2;
+        }
+    }
+    if(args[i] == NULL) {
+        usage_parallel();
+        return 2;
+    }
+
+    struct reader input;
+    if(input_file != NULL) {
+        int fd = open(input_file, O_RDONLY | O_CLOEXEC);
+        if(fd == -1) {
+            fprintf(stderr, "parallel: %s: %s\n", input_file, strerror(errno));
+            return 2;
+        }
+        reader_init(&input, fd);
+    } else {
+        reader_init(&input, STDIN_FILENO);
+    }
+
+    struct parallel par = {0};
+    par.template = args + i;
+    while(par.template[par.template_len] != NULL) {
+        if(strstr(par.template[par.template_len], "{}") != NULL) par.has_placeholder = true;
+        par.template_len++;
+    }
+    par.max_jobs = max_jobs;
+    par.pjobs = calloc(max_jobs, sizeof(struct pjob));
+    struct pollfd *fds = malloc((max_jobs * 2 + 1) * sizeof(struct pollfd));
+    if(par.pjobs == NULL || fds == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    for(size_t j = 0; j < max_jobs; ++j) par.pjobs[j].slot = JOB_NONE;
+
+    // Forked like an external command, parallel must survive the SIGINT of its commands to report them
+    struct sigaction sa_ignore, sa_saved;
+    sigemptyset(&sa_ignore.sa_mask);
+    sa_ignore.sa_flags = 0;
+    sa_ignore.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &sa_ignore, &sa_saved);
+
+    long long begin = now_ns();
+    bool input_done = false, input_ready = false;
+    for(;;) {
+        // Fill the free pjobs with the lines already buffered (or read them if nothing else is running)
+        for(size_t j = 0; j < max_jobs && !input_done && !par.interrupted; ++j) {
+            if(par.pjobs[j].slot != JOB_NONE) continue;
+            // Do not block on the input while commands are running, unless poll(2) said it is readable
+            if(par.running > 0 && !input_ready && !reader_has_line(&input)) break;
+            input_ready = false;
+            char *line;
+            ssize_t len;
+            do {
+                len = reader_next_line(&input, &line);
+            } while(len == 0);
+            if(len < 0) {
+                if(len == -2) perror("parallel: read");
+                input_done = true;
+                break;
+            }
+            start_job(&par, &par.pjobs[j], line, li);
+        }
+        if(par.running == 0 && (input_done || par.interrupted)) break;
+
+        // Wait for the outputs, the end of the commands, and the input if a pjob is free
+        size_t nfds = 0;
+        for(size_t j = 0; j < max_jobs; ++j) {
+            for(int k = 0; k < 2; ++k) {
+                fds[nfds].fd = par.pjobs[j].slot != JOB_NONE ? par.pjobs[j].fds[k] : -1;
+                fds[nfds++].events = POLLIN;
+            }
+        }
+        bool wait_input = !input_done && !par.interrupted && par.running < max_jobs;
+        fds[nfds].fd = wait_input ? input.fd : -1;
+        fds[nfds++].events = POLLIN;
+
+        int events = event_wait_fds(fds, nfds);
+        if(events & EVENT_CHILD) job_reap(&jobs);
+        input_ready = fds[nfds - 1].revents != 0;
+
+        for(size_t j = 0; j < max_jobs; ++j) {
+            struct pjob *pjob = &par.pjobs[j];
+            if(pjob->slot == JOB_NONE) continue;
+            for(int k = 0; k < 2; ++k) {
+                if(pjob->fds[k] == -1 || !(fds[j * 2 + k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                char buf[65536];
+                ssize_t n = read(pjob->fds[k], buf, sizeof(buf));
+                if(n > 0) {
+                    buffer_append(&pjob->out[k], buf, n);
+                } else if(n == 0 || errno != EINTR) {
+                    close(pjob->fds[k]);
+                    pjob->fds[k] = -1;
+                }
+            }
+            // The command is finished once reaped and once its outputs are closed (by it and its children)
+            if(pjob->fds[0] == -1 && pjob->fds[1] == -1 && jobs.slots[pjob->slot].done) finish_job(&par, pjob);
+        }
+    }
+    long long elapsed = now_ns() - begin;
+    sigaction(SIGINT, &sa_saved, NULL);
+
+    if(!quiet) report(&par, elapsed);
+
+    for(size_t j = 0; j < max_jobs; ++j) {
+        free(par.pjobs[j].out[0].data);
+        free(par.pjobs[j].out[1].data);
+    }
+    free(par.pjobs);
+    free(par.latencies);
+    free(fds);
+    reader_destroy(&input);
+
+    return par.failed > PARALLEL_MAX_FAILURES_STATUS ? PARALLEL_MAX_FAILURES_STATUS : (int) par.failed;
+}
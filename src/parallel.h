@@ -0,0 +1,41 @@
+/*!
+ * \file parallel.h
+ * \brief Header file for the internal command parallel.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * parallel runs a command once per input line, with a bounded number of children at the same time.
+ * The children are reaped through the event loop of the shell (see event.h): a new command is started
+ * as soon as one finishes. The output of every command is collected and printed in one piece when it
+ * finishes, so the lines of different commands never interleave.
+ */
+#ifndef FISH_PARALLEL_H
+#define FISH_PARALLEL_H
+
+#include "cmdline.h"
+
+/*!
+ * \def PARALLEL_MAX_FAILURES_STATUS
+ * \brief The status of parallel is the number of failed commands, up to this value.
+ */
+#define PARALLEL_MAX_FAILURES_STATUS 101
+
+/*!
+ * \fn int builtin_parallel(char *args[], struct line *li)
+ * \brief parallel [-j N] [-a file] [-q] command [arg...]: run the command for every line of the input.
+ *
+ * The lines are read from file, or from the standard input. In the arguments, {} is replaced by the line;
+ * if no argument contains {}, the line is added as the last argument. Empty lines are skipped.
+ * At most N commands run at the same time (the number of online CPUs by default).
+ * At the end, the number of commands, the throughput and the latency percentiles are printed on stderr,
+ * unless -q is given. No new command is started once a command is interrupted by SIGINT.
+ * The command is always forked (see builtins.h), so Ctrl-Z suspends it with its commands.
+ *
+ * \param args The arguments of the command.
+ * \param li The line being executed.
+ * \return 0 if every command succeeded, the number of failed commands otherwise
+ *         (at most PARALLEL_MAX_FAILURES_STATUS), 2 if the arguments are invalid.
+ */
+int builtin_parallel(char *args[], struct line *li);
+
+#endif //FISH_PARALLEL_H
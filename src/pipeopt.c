@@ -0,0 +1,136 @@
+/*!
+ * \file pipeopt.c
+ * \brief Implementation of the tuning of the pipes between the commands of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "pipeopt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!
+ * \def PIPE_MAX_SIZE_FILE
+ * \brief The limit of the capacity of a pipe for an unprivileged process.
+ */
+#define PIPE_MAX_SIZE_FILE "/proc/sys/fs/pipe-max-size"
+
+/*!
+ * \def PIPE_MAX_SIZE_DEFAULT
+ * \brief The default value of pipe-max-size, used if the file cannot be read.
+ */
+#define PIPE_MAX_SIZE_DEFAULT (1024 * 1024)
+
+struct pipe_options pipe_defaults = {0, false};
+
+/*!
+ * \fn static size_t pipe_max_size()
+ * \brief Return the content of /proc/sys/fs/pipe-max-size, read on the first call.
+ */
+static size_t pipe_max_size() {
+    static size_t max_size = 0;
+    if(max_size == 0) {
+        FILE *f = fopen(PIPE_MAX_SIZE_FILE, "re");
+        if(f == NULL || fscanf(f, "%zu", &max_size) != 1 || max_size == 0) max_size = PIPE_MAX_SIZE_DEFAULT;
+        if(f != NULL) fclose(f);
+    }
+    return max_size;
+}
+
+int pipe_open(int fds[2], const struct pipe_options *options) {
+    if(pipe2(fds, options->packet ? O_DIRECT : 0) == -1) return -1;
+    if(options->size != 0) {
+        size_t size = options->size < pipe_max_size() ? options->size : pipe_max_size();
+        fcntl(fds[1], F_SETPIPE_SZ, (int) size); // EPERM or EBUSY: the default capacity is kept
+    }
+    return 0;
+}
+
+/*!
+ * \fn static bool parse_size(const char *str, size_t *size)
+ * \brief Parse a number of bytes, with an optional k or m suffix.
+ */
+static bool parse_size(const char *str, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(str, &end, 10);
+    if(errno != 0 || end == str || str[0] == '-') return false;
+    if(*end == 'k' || *end == 'K') { n *= 1024; ++end; }
+    else if(*end == 'm' || *end == 'M') { n *= 1024 * 1024; ++end; }
+    if(*end != '\0' || n > (unsigned long long) INT32_MAX) return false;
+    *size = (size_t) n;
+    return true;
+}
+
+/*!
+ * \fn static int parse_options(char *args[], struct pipe_options *options)
+ * \brief Parse the options of pipeopt.
+ *
+ * \return The index of the first argument which is not an option, -1 if an option is invalid (an error is printed).
+ */
+static int parse_options(char *args[], struct pipe_options *options) {
+    int i = 1;
+    for(; args[i] != NULL && args[i][0] == '-'; ++i) {
+        if(strcmp(args[i], "-p") == 0) {
+            options->packet = true;
+        } else if(strcmp(args[i], "-P") == 0) {
+            options->packet = false;
+        } else if(strcmp(args[i], "-s") == 0 && args[i + 1] != NULL) {
+            if(!parse_size(args[++i], &options->size)) {
+                fprintf(stderr, "pipeopt: invalid size '%s'\n", args[i]);
+                return -1;
+            }
+        } else if(strcmp(args[i], "--") == 0) {
+            return i + 1;
+        } else {
+            fprintf(stderr, "pipeopt: invalid option '%s'\n", args[i]);
+            fprintf(stderr, "usage: pipeopt [-s size[k|m]] [-p | -P] [command...]\n");
+            return -1;
+        }
+    }
+    return i;
+}
+
+int pipe_options_prefix(struct cmd *cmd, struct pipe_options *options) {
+    if(cmd->n_args == 0 || strcmp(cmd->args[0], "pipeopt") != 0) return 0;
+    struct pipe_options parsed = *options;
+    int first = parse_options(cmd->args, &parsed);
+    if(first == -1) return -1;
+    if(cmd->args[first] == NULL) return 0; // The global options: executed as a command
+    *options = parsed;
+    cmd->args += first;
+    cmd->n_args -= (size_t) first;
+    cmd->first_arg += (size_t) first;
+    return 1;
+}
+
+int builtin_pipeopt(char *args[], struct line *li) {
+    (void) li;
+    struct pipe_options parsed = pipe_defaults;
+    int first = parse_options(args, &parsed);
+    if(first == -1) return 2;
+    if(args[first] != NULL) {
+        fprintf(stderr, "pipeopt: a command is only allowed at the start of a pipeline\n");
+        return 2;
+    }
+    pipe_defaults = parsed;
+    if(pipe_defaults.size == 0) {
+        fprintf(stderr, "Pipes: default size (max %zu), packet mode %s\n", pipe_max_size(), YES_NO(pipe_defaults.packet));
+    } else {
+        fprintf(stderr, "Pipes: size %zu (max %zu), packet mode %s\n", pipe_defaults.size, pipe_max_size(),
+                YES_NO(pipe_defaults.packet));
+    }
+    return 0;
+}
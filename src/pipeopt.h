@@ -0,0 +1,61 @@
+/*!
+ * \file pipeopt.h
+ * \brief Header file for the tuning of the pipes between the commands of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The kernel gives 64 KB to every pipe, so the producer of a throughput-bound pipeline blocks often.
+ * The internal command pipeopt sets the capacity of the pipes (F_SETPIPE_SZ, up to
+ * /proc/sys/fs/pipe-max-size) and the packet mode (O_DIRECT), for every pipeline, or for one pipeline
+ * when it is written in front of it: "pipeopt -s 1m zcat f | sort | uniq -c".
+ */
+#ifndef FISH_PIPEOPT_H
+#define FISH_PIPEOPT_H
+
+#include "cmdline.h"
+#include "utils.h"
+
+/*!
+ * \var pipe_defaults
+ * \brief The tuning of the pipes of the pipelines which do not start with pipeopt.
+ */
+extern struct pipe_options pipe_defaults;
+
+/*!
+ * \fn int pipe_open(int fds[2], const struct pipe_options *options)
+ * \brief Create a pipe tuned with options.
+ *
+ * The capacity is limited to /proc/sys/fs/pipe-max-size. A capacity refused by the kernel
+ * (the pipe buffers of the user are exhausted) keeps the default one.
+ *
+ * \param fds Where to store the read and write ends of the pipe.
+ * \param options The tuning of the pipe.
+ * \return 0 on success, -1 if the pipe cannot be created (errno is set).
+ */
+int pipe_open(int fds[2], const struct pipe_options *options);
+
+/*!
+ * \fn int pipe_options_prefix(struct cmd *cmd, struct pipe_options *options)
+ * \brief Apply the pipeopt written in front of a pipeline.
+ *
+ * If the first command of a pipeline is "pipeopt [options] command...", the options are stored in options
+ * and the command is shifted to start at "command".
+ *
+ * \param cmd The first command of the pipeline.
+ * \param options The tuning of the pipes of the pipeline, updated.
+ * \return 1 if cmd was a pipeopt prefix, 0 if it was not, -1 if its options are invalid (an error is printed).
+ */
+int pipe_options_prefix(struct cmd *cmd, struct pipe_options *options);
+
+/*!
+ * \fn int builtin_pipeopt(char *args[], struct line *li)
+ * \brief pipeopt [-s size[k|m]] [-p | -P]: print or set the tuning of the pipes of the next pipelines.
+ *
+ * -s sets the capacity of the pipes (0 for the default of the kernel), -p enables the packet mode and -P
+ * disables it. In front of a pipeline, the options only apply to it.
+ *
+ * \return 0 on success, 2 if an option is invalid.
+ */
+int builtin_pipeopt(char *args[], struct line *li);
+
+#endif //FISH_PIPEOPT_H
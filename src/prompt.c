@@ -0,0 +1,116 @@
+/*!
+ * \file prompt.c
+ * \brief Implementation of the prompt of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ *
+ * Used for the function asprintf.
+ */
+#define _GNU_SOURCE
+
+#include "prompt.h"
+#include "fish.h"
+#include "utils.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!
+ * \struct prompt_cache
+ * \brief The rendered prompt and what it was rendered with.
+ */
+static struct prompt_cache {
+    /*! \brief The name of the user. */
+    const char *username;
+    /*! \brief The home directory, replaced by '~'. */
+    const char *home;
+    /*! \brief The current directory, with the home substituted. */
+    char current_dir[PATH_MAX];
+    /*! \brief false when current_dir must be computed again. */
+    bool dir_valid;
+    /*! \brief The rendered prompt, NULL before the first rendering. */
+    char *text;
+    /*! \brief The length of text. */
+    size_t len;
+    /*! \brief The status the prompt was rendered with. */
+    int status;
+    /*! \brief false when text must be rendered again. */
+    bool valid;
+} cache;
+
+void prompt_init(const char *username, const char *home) {
+    cache.username = username;
+    cache.home = home;
+    prompt_invalidate();
+}
+
+void prompt_invalidate() {
+    cache.dir_valid = false;
+    cache.valid = false;
+}
+
+/*!
+ * \fn static void prompt_render(int last_status_code)
+ * \brief Render the prompt in the cache.
+ */
+static void prompt_render(int last_status_code) {
+    if(!cache.dir_valid) {
+        if(getcwd(cache.current_dir, sizeof(cache.current_dir)) == NULL) {
+            perror("getcwd (current_dir)");
+            exit(EXIT_FAILURE);
+        }
+        substitute_home(cache.current_dir, (char *) cache.home);
+        cache.dir_valid = true;
+    }
+
+    char *exit_color;
+    char signal_color[64];
+    switch(last_status_code) {
+        case 0:
+        case -3:
+            exit_color = GREEN;
+            break;
+        case -1:
+            exit_color = GRAY;
+            break;
+        case 127:
+        case -2:
+        default:
+            exit_color = RED;
+            break;
+    }
+
+    if(last_status_code > 256) {
+        snprintf(signal_color, sizeof(signal_color), RED "(" YELLOW "%d" RED ") ", last_status_code - 256);
+        exit_color = signal_color;
+    }
+
+    free(cache.text);
+    int len = asprintf(&cache.text, YELLOW "FiSH " GRAY "➔" GREEN ITALIC " %s " RESET GRAY "➔" BLUE " %s" RESET "\n\t%s■ " RESET "➔ ",
+                       cache.username, cache.current_dir, exit_color);
+    if(len == -1) {
+        cache.text = NULL;
+        return;
+    }
+    cache.len = len;
+    cache.status = last_status_code;
+    cache.valid = true;
+}
+
+const char *prompt_text(int last_status_code, size_t *len) {
+    if(!cache.valid || cache.status != last_status_code) {
+        prompt_render(last_status_code);
+        if(!cache.valid) return NULL;
+    }
+    *len = cache.len;
+    return cache.text;
+}
@@ -0,0 +1,41 @@
+/*!
+ * \file prompt.h
+ * \brief Header file for the prompt of the interactive shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The prompt is rendered once and cached. The directory part is only recomputed after the
+ * internal command cd changed the directory, and the status part only when the status changes.
+ */
+#ifndef FISH_PROMPT_H
+#define FISH_PROMPT_H
+
+#include <stddef.h>
+
+/*!
+ * \fn void prompt_init(const char *username, const char *home)
+ * \brief Set the user shown by the prompt and the home directory replaced by '~'.
+ *
+ * \param username The name of the user.
+ * \param home The home directory of the user.
+ */
+void prompt_init(const char *username, const char *home);
+
+/*!
+ * \fn void prompt_invalidate()
+ * \brief Force the prompt to be rendered again, because the current directory changed.
+ */
+void prompt_invalidate();
+
+/*!
+ * \fn const char *prompt_text(int last_status_code, size_t *len)
+ * \brief Get the prompt, rendering it first if the cache is not valid (used by the line editor).
+ *
+ * \param last_status_code The status of the last command (see execute_command_with_args), giving the
+ *                         color of the prompt symbol, and the signal number of a killed command.
+ * \param len Where to store the length of the prompt.
+ * \return The prompt, valid until the next rendering, NULL if a memory allocation failure occurs.
+ */
+const char *prompt_text(int last_status_code, size_t *len);
+
+#endif //FISH_PROMPT_H
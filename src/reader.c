@@ -0,0 +1,107 @@
+/*!
+ * \file reader.c
+ * \brief Implementation of the buffered line reader.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+#include "reader.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void reader_init(struct reader *r, int fd) {
+    r->fd = fd;
+    r->buf = NULL;
+    r->size = 0;
+    r->start = 0;
+    r->end = 0;
+    r->eof = false;
+}
+
+int reader_init_string(struct reader *r, const char *str) {
+    size_t len = strlen(str);
+    reader_init(r, -1);
+    r->buf = malloc(len + 1); // one more byte for the '\0' of the last line
+    if (r->buf == NULL) return -1;
+    memcpy(r->buf, str, len);
+    r->size = len + 1;
+    r->end = len;
+    r->eof = true;
+    return 0;
+}
+
+/*!
+ * \fn static int reader_fill(struct reader *r)
+ * \brief Read more data after the bytes not returned yet.
+ *
+ * The bytes not returned yet are moved to the beginning of the buffer, which is doubled
+ * if less than READER_CHUNK bytes are left free (one byte is always kept for the final '\0').
+ *
+ * \return 0 on success (r->eof is set at the end of the input), -1 if an error occurs.
+ */
+static int reader_fill(struct reader *r) {
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+
+    if (r->size - r->end < READER_CHUNK + 1) {
+        size_t new_size = r->size ? r->size * 2 : READER_CHUNK + 1;
+        char *new_buf = realloc(r->buf, new_size);
+        if (new_buf == NULL) return -1;
+        r->buf = new_buf;
+        r->size = new_size;
+    }
+
+    ssize_t n;
+    do {
+        n = read(r->fd, r->buf + r->end, r->size - r->end - 1);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1) return -1;
+    if (n == 0) r->eof = true;
+    r->end += n;
+    return 0;
+}
+
+ssize_t reader_next_line(struct reader *r, char **line) {
+    size_t scanned = r->start; // bytes before this index contain no '\n'
+    for (;;) {
+        char *newline = memchr(r->buf + scanned, '\n', r->end - scanned);
+        if (newline != NULL) {
+            *newline = '\0';
+            *line = r->buf + r->start;
+            ssize_t len = newline - *line;
+            r->start += len + 1;
+            return len;
+        }
+
+        if (r->eof) {
+            if (r->start == r->end) return -1;
+            // Last line without '\n': there is always room for the '\0'
+            r->buf[r->end] = '\0';
+            *line = r->buf + r->start;
+            ssize_t len = r->end - r->start;
+            r->start = r->end;
+            return len;
+        }
+
+        size_t offset = r->end - r->start;
+        if (reader_fill(r) == -1) return -2;
+        scanned = r->start + offset;
+    }
+}
+
+bool reader_has_line(struct reader *r) {
+    return r->eof || (r->start < r->end && memchr(r->buf + r->start, '\n', r->end - r->start) != NULL);
+}
+
+void reader_destroy(struct reader *r) {
+    free(r->buf);
+    if (r->fd > STDIN_FILENO) close(r->fd);
+    reader_init(r, -1);
+}
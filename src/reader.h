@@ -0,0 +1,115 @@
+/*!
+ * \file reader.h
+ * \brief Header file for the buffered line reader.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The reader reads a file descriptor with large read(2) calls and cuts the data in lines.
+ * The lines are returned in place, inside the buffer of the reader, and have no length limit.
+ */
+#ifndef FISH_READER_H
+#define FISH_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*!
+ * \def READER_CHUNK
+ * \brief Initial size of the buffer of a reader, and minimal size of a read(2).
+ */
+#define READER_CHUNK 65536
+
+/*!
+ * \struct reader
+ * \brief Structure holding the state of a buffered line reader.
+ *
+ * The bytes in [start, end[ of the buffer have been read but not returned yet.
+ */
+struct reader {
+    /*!
+     * \var fd
+     * \brief The file descriptor read.
+     */
+    int fd;
+    /*!
+     * \var buf
+     * \brief The buffer, grown when a line does not fit in it.
+     */
+    char *buf;
+    /*!
+     * \var size
+     * \brief Allocated size of the buffer.
+     */
+    size_t size;
+    /*!
+     * \var start
+     * \brief Index of the first byte not returned yet.
+     */
+    size_t start;
+    /*!
+     * \var end
+     * \brief Index following the last byte read.
+     */
+    size_t end;
+    /*!
+     * \var eof
+     * \brief true once read(2) returned 0.
+     */
+    bool eof;
+};
+
+/*!
+ * \fn void reader_init(struct reader *r, int fd)
+ * \brief Initialize a reader on a file descriptor. No memory is allocated before the first read.
+ *
+ * \param r The reader to initialize.
+ * \param fd The file descriptor to read.
+ */
+void reader_init(struct reader *r, int fd);
+
+/*!
+ * \fn int reader_init_string(struct reader *r, const char *str)
+ * \brief Initialize a reader returning the lines of a string (used by "fish -c").
+ *
+ * The string is copied in the buffer of the reader, no file descriptor is read.
+ *
+ * \param r The reader to initialize.
+ * \param str The string to cut in lines.
+ * \return 0 on success, -1 if a memory allocation failure occurs.
+ */
+int reader_init_string(struct reader *r, const char *str);
+
+/*!
+ * \fn ssize_t reader_next_line(struct reader *r, char **line)
+ * \brief Get the next line.
+ *
+ * The '\n' ending the line is replaced by a '\0'. The last line of the input may have no '\n'.
+ * The line points into the buffer of the reader and stays valid until the next call.
+ *
+ * \param r The reader.
+ * \param line Where to store the address of the line.
+ * \return The length of the line (without its '\n'), <br>
+ *         -1 at the end of the input, <br>
+ *         -2 if an error occurs (errno is set).
+ */
+ssize_t reader_next_line(struct reader *r, char **line);
+
+/*!
+ * \fn bool reader_has_line(struct reader *r)
+ * \brief Check whether reader_next_line() can return without reading the file descriptor.
+ *
+ * \param r The reader.
+ * \return true if a whole line is buffered or the end of the input was reached.
+ */
+bool reader_has_line(struct reader *r);
+
+/*!
+ * \fn void reader_destroy(struct reader *r)
+ * \brief Free the buffer of the reader. The file descriptor is closed, unless it is stdin.
+ *
+ * \param r The reader to destroy.
+ */
+void reader_destroy(struct reader *r);
+
+#endif //FISH_READER_H
@@ -0,0 +1,85 @@
+/*!
+ * \file timing.c
+ * \brief Implementation of the measure of the resources used by the commands of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+#include "timing.h"
+
+#include "fish.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+bool time_always = false;
+
+/*!
+ * \fn static double seconds(struct timespec from, struct timespec to)
+ * \brief The number of seconds between two instants.
+ */
+static double seconds(struct timespec from, struct timespec to) {
+    return (double) (to.tv_sec - from.tv_sec) + (double) (to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+/*!
+ * \fn static double cpu_seconds(struct timeval tv)
+ * \brief Convert a CPU time of struct rusage into seconds.
+ */
+static double cpu_seconds(struct timeval tv) {
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+bool time_prefix(struct cmd *cmd) {
+    if(cmd->n_args < 2 || strcmp(cmd->args[0], "time") != 0 || cmd->args[1][0] == '-') return false;
+    cmd->args++;
+    cmd->n_args--;
+    cmd->first_arg++;
+    return true;
+}
+
+void time_report(size_t group, const struct rusage *self) {
+    struct job_group *g = &jobs.groups[group];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double user = 0, sys = 0;
+    struct rusage self_now;
+    if(self != NULL && getrusage(RUSAGE_SELF, &self_now) == 0) {
+        user += cpu_seconds(self_now.ru_utime) - cpu_seconds(self->ru_utime);
+        sys += cpu_seconds(self_now.ru_stime) - cpu_seconds(self->ru_stime);
+    }
+    for(size_t slot = g->first; slot != JOB_NONE; slot = jobs.slots[slot].group_next) {
+        user += cpu_seconds(jobs.slots[slot].usage.ru_utime);
+        sys += cpu_seconds(jobs.slots[slot].usage.ru_stime);
+    }
+    fprintf(stderr, "time: real %.3f s, user %.3f s, sys %.3f s\t%s\n", seconds(g->started, now), user, sys, g->text);
+
+    for(size_t slot = g->first; slot != JOB_NONE; slot = jobs.slots[slot].group_next) {
+        const struct job *job = &jobs.slots[slot];
+        const struct rusage *ru = &job->usage;
+        double real = seconds(job->started, job->ended);
+        double cpu = cpu_seconds(ru->ru_utime) + cpu_seconds(ru->ru_stime);
+        fprintf(stderr, "  #%zu pid %d: real %.3f s, user %.3f s, sys %.3f s, cpu %.0f%%, max rss %ld KB, "
+                        "csw %ld vol / %ld invol, faults %ld minor / %ld major\n",
+                job->stage, job->pid, real, cpu_seconds(ru->ru_utime), cpu_seconds(ru->ru_stime),
+                real > 0 ? 100 * cpu / real : 0.0, ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_minflt, ru->ru_majflt);
+    }
+}
+
+int builtin_time(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL && args[2] == NULL && strcmp(args[1], "-a") == 0) {
+        time_always = true;
+    } else if(args[1] != NULL && args[2] == NULL && strcmp(args[1], "-A") == 0) {
+        time_always = false;
+    } else if(args[1] != NULL) {
+        fprintf(stderr, "usage: time [-a | -A] or time pipeline\n");
+        return 2;
+    }
+    fprintf(stderr, "Time every pipeline: %s\n", YES_NO(time_always));
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*!
+ * \file timing.h
+ * \brief Header file for the measure of the resources used by the commands of a pipeline.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The children are reaped with wait4(), which gives the resources they used (see struct job).
+ * A pipeline written after the keyword "time" prints, when it finishes, its wall-clock time and
+ * one line per command: wall-clock time from its start to its end, user and system CPU time,
+ * CPU usage, maximum resident set size, context switches and page faults.
+ * The command at about 100% of CPU in a slow pipeline is its bottleneck. An internal command run by
+ * the shell itself is measured with getrusage(RUSAGE_SELF) around it.
+ */
+#ifndef FISH_TIMING_H
+#define FISH_TIMING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/resource.h>
+
+#include "cmdline.h"
+
+/*!
+ * \var time_always
+ * \brief true to print the resources used by every foreground pipeline, as if it started with "time".
+ */
+extern bool time_always;
+
+/*!
+ * \fn bool time_prefix(struct cmd *cmd)
+ * \brief Remove the keyword "time" written in front of a pipeline.
+ *
+ * \param cmd The first command of the pipeline, shifted to start after "time".
+ * \return true if cmd started with "time" followed by a command.
+ */
+bool time_prefix(struct cmd *cmd);
+
+/*!
+ * \fn void time_report(size_t group, const struct rusage *self)
+ * \brief Print on stderr the resources used by a finished job and by each of its processes.
+ *
+ * \param group The index of the group in the job table.
+ * \param self The resources of the shell (RUSAGE_SELF) before the job started, to add what the internal
+ *             commands run by the shell itself used since, NULL if the job only ran in child processes.
+ */
+void time_report(size_t group, const struct rusage *self);
+
+/*!
+ * \fn int builtin_time(char *args[], struct line *li)
+ * \brief time [-a | -A]: print whether every pipeline is timed, -a to enable it, -A to disable it.
+ *
+ * In front of a pipeline, "time" is a keyword timing the pipeline (see time_prefix).
+ *
+ * \return 0 on success, 2 if an option is invalid.
+ */
+int builtin_time(char *args[], struct line *li);
+
+#endif //FISH_TIMING_H
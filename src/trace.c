@@ -0,0 +1,220 @@
+/*!
+ * \file trace.c
+ * \brief Implementation of the execution trace of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The ring buffer has a single writer, the main thread of the shell: recording an event takes no lock
+ * and does not allocate. When the ring is full, its events are written to the file in one pass.
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*!
+ * \def TRACE_RING_SIZE
+ * \brief Number of events kept before they are written (a power of two).
+ */
+#define TRACE_RING_SIZE 4096
+
+/*!
+ * \def TRACE_DETAIL_LEN
+ * \brief Maximal length of the text of an event, including the '\0'.
+ */
+#define TRACE_DETAIL_LEN 80
+
+/*!
+ * \struct trace_event
+ * \brief An event of the ring buffer.
+ */
+struct trace_event {
+    /*! \brief When the event started, in nanoseconds (CLOCK_MONOTONIC). */
+    uint64_t start;
+    /*! \brief The duration of the event, in nanoseconds. */
+    uint64_t duration;
+    /*! \brief The name of the event (a string literal). */
+    const char *name;
+    /*! \brief The process of the event, 0 for the shell. */
+    pid_t pid;
+    /*! \brief A number shown with the event. */
+    long arg;
+    /*! \brief 'X' (with a duration) or 'i' (instantaneous). */
+    char phase;
+    /*! \brief A text shown with the event, "" if none. */
+    char detail[TRACE_DETAIL_LEN];
+};
+
+bool trace_enabled = false;
+
+/*!
+ * \struct trace
+ * \brief The state of the trace.
+ */
+static struct trace {
+    /*! \brief The events not written yet. */
+    struct trace_event ring[TRACE_RING_SIZE];
+    /*! \brief The number of events recorded since the trace started (the next slot is head % TRACE_RING_SIZE). */
+    atomic_size_t head;
+    /*! \brief The number of events written to the file. */
+    size_t tail;
+    /*! \brief The file, NULL when the trace is stopped. */
+    FILE *out;
+    /*! \brief The name of the file. */
+    char *path;
+    /*! \brief The PID of the shell. */
+    pid_t shell_pid;
+    /*! \brief When the trace started: the origin of the timestamps of the file. */
+    uint64_t origin;
+    /*! \brief true once the exit and fork handlers are installed. */
+    bool handlers;
+} trace;
+
+uint64_t trace_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/*!
+ * \fn static void write_json_string(FILE *out, const char *str)
+ * \brief Write a string as a JSON string literal.
+ */
+static void write_json_string(FILE *out, const char *str) {
+    putc('"', out);
+    for(; *str; ++str) {
+        unsigned char c = (unsigned char) *str;
+        if(c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if(c < 0x20) fprintf(out, "\\u%04x", c);
+        else putc(c, out);
+    }
+    putc('"', out);
+}
+
+/*!
+ * \fn static void trace_flush()
+ * \brief Write the events of the ring buffer to the file.
+ *
+ * The children get their own process in the trace, named after their job.
+ */
+static void trace_flush() {
+    size_t head = atomic_load_explicit(&trace.head, memory_order_acquire);
+    for(; trace.tail < head; ++trace.tail) {
+        const struct trace_event *e = &trace.ring[trace.tail & (TRACE_RING_SIZE - 1)];
+        pid_t pid = e->pid != 0 ? e->pid : trace.shell_pid;
+        double ts = e->start > trace.origin ? (double) (e->start - trace.origin) / 1000 : 0;
+        if(e->pid != 0) {
+            fprintf(trace.out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, pid);
+            write_json_string(trace.out, e->detail);
+            fprintf(trace.out, "}}");
+        }
+        fprintf(trace.out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,", e->name, e->phase, ts);
+        if(e->phase == 'X') fprintf(trace.out, "\"dur\":%.3f,", (double) e->duration / 1000);
+        else fprintf(trace.out, "\"s\":\"t\",");
+        fprintf(trace.out, "\"pid\":%d,\"tid\":%d,\"args\":{\"detail\":", pid, pid);
+        write_json_string(trace.out, e->detail);
+        fprintf(trace.out, ",\"arg\":%ld}}", e->arg);
+    }
+    fflush(trace.out); // Nothing stays buffered: exit() in a forked child would write it again
+}
+
+void trace_record(char phase, const char *name, uint64_t start, uint64_t duration, pid_t pid,
+                  const char *detail, long arg) {
+    size_t head = atomic_load_explicit(&trace.head, memory_order_relaxed);
+    if(head - trace.tail == TRACE_RING_SIZE) trace_flush();
+
+    struct trace_event *e = &trace.ring[head & (TRACE_RING_SIZE - 1)];
+    e->start = start;
+    e->duration = duration;
+    e->name = name;
+    e->pid = pid;
+    e->arg = arg;
+    e->phase = phase;
+    if(detail == NULL) detail = "";
+    size_t len = strnlen(detail, TRACE_DETAIL_LEN - 1);
+    if(detail[len] != '\0') {
+        while(len > 0 && ((unsigned char) detail[len] & 0xC0) == 0x80) --len; // Keep the UTF-8 valid
+    }
+    memcpy(e->detail, detail, len);
+    e->detail[len] = '\0';
+    atomic_store_explicit(&trace.head, head + 1, memory_order_release);
+}
+
+/*!
+ * \fn static void trace_forked()
+ * \brief Stop recording in a forked child, without writing anything: the file belongs to the shell.
+ */
+static void trace_forked() {
+    trace_enabled = false;
+    trace.out = NULL;
+}
+
+int trace_start(const char *path) {
+    trace_stop();
+    FILE *out = fopen(path, "we");
+    if(out == NULL) return -1;
+    char *copy = strdup(path);
+    if(copy == NULL) {
+        fclose(out);
+        errno = ENOMEM;
+        return -1;
+    }
+    if(!trace.handlers) {
+        atexit(trace_stop);
+        pthread_atfork(NULL, NULL, trace_forked);
+        trace.handlers = true;
+    }
+
+    trace.out = out;
+    trace.path = copy;
+    trace.shell_pid = getpid();
+    trace.origin = trace_now();
+    trace.tail = 0;
+    atomic_store(&trace.head, 0);
+    fprintf(out, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"fish\"}}",
+            trace.shell_pid, trace.shell_pid);
+    fflush(out); // Nothing stays buffered: exit() in a forked child would write it again
+    trace_enabled = true;
+    return 0;
+}
+
+void trace_stop() {
+    if(trace.out == NULL) return;
+    trace_enabled = false;
+    trace_flush();
+    fprintf(trace.out, "\n]\n");
+    fclose(trace.out);
+    trace.out = NULL;
+    free(trace.path);
+    trace.path = NULL;
+}
+
+int builtin_trace(char *args[], struct line *li) {
+    (void) li;
+    if(args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "usage: trace [file | off]\n");
+        return 2;
+    }
+    if(args[1] != NULL && strcmp(args[1], "off") == 0) {
+        trace_stop();
+    } else if(args[1] != NULL && trace_start(args[1]) == -1) {
+        fprintf(stderr, "trace: %s: %s\n", args[1], strerror(errno));
+        return 1;
+    }
+    if(trace.out == NULL) fprintf(stderr, "Trace: off\n");
+    else fprintf(stderr, "Trace: %s (%zu events)\n", trace.path, atomic_load(&trace.head));
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*!
+ * \file trace.h
+ * \brief Header file for the execution trace of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * When the trace is enabled (internal command "trace file", or the FISH_TRACE environment variable),
+ * the shell records timestamped events: reading and parsing a line, creating a pipe, opening a
+ * redirection, starting a command (fork or posix_spawn), running an internal command, waiting
+ * for a job, reaping a child, and the lifetime of every child on its own track.
+ * The events are stored in a ring buffer, written to the file in the Chrome trace_event JSON
+ * format when it is full or when the trace stops, so the file can be loaded in Perfetto
+ * (ui.perfetto.dev) or chrome://tracing.
+ *
+ * When the trace is disabled, every TRACE_ macro costs one test of a global flag.
+ */
+#ifndef FISH_TRACE_H
+#define FISH_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "cmdline.h"
+
+/*!
+ * \var trace_enabled
+ * \brief true while the events are recorded. Only read through the TRACE_ macros.
+ */
+extern bool trace_enabled;
+
+/*!
+ * \def TRACE_NOW()
+ * \brief The current time for a TRACE_COMPLETE() event, 0 when the trace is disabled.
+ */
+#define TRACE_NOW() (__builtin_expect(trace_enabled, 0) ? trace_now() : 0)
+
+/*!
+ * \def TRACE_COMPLETE(name, start, detail, arg)
+ * \brief Record an event of the shell lasting from start (see TRACE_NOW()) until now.
+ */
+#define TRACE_COMPLETE(name, start, detail, arg) do { \
+        if(__builtin_expect(trace_enabled, 0)) trace_record('X', name, start, trace_now() - (start), 0, detail, arg); \
+    } while(0)
+
+/*!
+ * \def TRACE_INSTANT(name, detail, arg)
+ * \brief Record an instantaneous event of the shell.
+ */
+#define TRACE_INSTANT(name, detail, arg) do { \
+        if(__builtin_expect(trace_enabled, 0)) trace_record('i', name, trace_now(), 0, 0, detail, arg); \
+    } while(0)
+
+/*!
+ * \fn uint64_t trace_now()
+ * \brief The current time in nanoseconds (CLOCK_MONOTONIC).
+ */
+uint64_t trace_now();
+
+/*!
+ * \fn void trace_record(char phase, const char *name, uint64_t start, uint64_t duration, pid_t pid, const char *detail, long arg)
+ * \brief Record an event. Use the TRACE_ macros, which test trace_enabled first.
+ *
+ * \param phase 'X' for an event with a duration, 'i' for an instantaneous event.
+ * \param name The name of the event, a string literal (it is not copied).
+ * \param start When the event started (see trace_now()).
+ * \param duration The duration of the event, in nanoseconds.
+ * \param pid The process the event belongs to, 0 for the shell.
+ * \param detail A text shown with the event (copied, truncated), or NULL.
+ * \param arg A number shown with the event (a PID, a status, a size...).
+ */
+void trace_record(char phase, const char *name, uint64_t start, uint64_t duration, pid_t pid,
+                  const char *detail, long arg);
+
+/*!
+ * \fn int trace_start(const char *path)
+ * \brief Start recording the events into a new file (the previous trace is stopped).
+ *
+ * The children forked by the shell stop recording automatically, and the trace is stopped when the shell exits.
+ *
+ * \param path The file to write.
+ * \return 0 on success, -1 if the file cannot be created (errno is set).
+ */
+int trace_start(const char *path);
+
+/*!
+ * \fn void trace_stop()
+ * \brief Write the recorded events, terminate the JSON document and close the file.
+ */
+void trace_stop();
+
+/*!
+ * \fn int builtin_trace(char *args[], struct line *li)
+ * \brief trace [file | off]: print the state of the trace, start recording into file, or stop.
+ */
+int builtin_trace(char *args[], struct line *li);
+
+#endif //FISH_TRACE_H
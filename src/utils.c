@@ -16,6 +16,8 @@
 #include "utils.h"
 
 #include "cmdline.h"
+#include "trace.h"
+#include "zygote.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -23,6 +25,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/wait.h>
 
 
 void init_pipe_control(struct pipe_control *pc) {
@@ -30,6 +33,8 @@ void init_pipe_control(struct pipe_control *pc) {
     pc->pipe_prev[PWRITE] = -1;
     pc->pipe_next[PREAD] = -1;
     pc->pipe_next[PWRITE] = -1;
+    pc->options.size = 0;
+    pc->options.packet = false;
 }
 
 void close_pipe(int pipe[2]) {
@@ -71,6 +76,9 @@ void manage_file_output(char *file_output, bool file_output_append) {
 
 void print_debug_line(struct line *li) {
     fprintf(stderr, "Command line:\n");
+    if (li->connector != LINE_NONE) {
+        fprintf(stderr, "\tAfter: %s\n", li->connector == LINE_AND ? "&&" : li->connector == LINE_OR ? "||" : ";");
+    }
     fprintf(stderr, "\tNumber of commands: %zu\n", li->n_cmds);
 
     for (size_t i = 0; i < li->n_cmds; ++i) {
@@ -118,20 +126,311 @@ void substitute_home(char *path, char *home) {
     }
 }
 
-void init_background_data(volatile struct bg_data background_data) {
-    for (size_t i = 0; i < BG_MAX_SIZE; ++i) {
-        background_data.bg_array[i] = -1;
+void job_table_init(struct job_table *jt) {
+    jt->slots = NULL;
+    jt->size = 0;
+    jt->free_head = JOB_NONE;
+    jt->index = NULL;
+    jt->finished_head = JOB_NONE;
+    jt->groups = NULL;
+    jt->groups_size = 0;
+    jt->groups_free = JOB_NONE;
+    jt->ids = NULL;
+    jt->ids_size = 0;
+    jt->max_id = 0;
+}
+
+size_t job_group_new(struct job_table *jt, char *text, bool background) {
+    if(jt->groups_free == JOB_NONE) {
+        size_t new_size = jt->groups_size ? jt->groups_size * 2 : 8;
+        struct job_group *groups = realloc(jt->groups, new_size * sizeof(struct job_group));
+        if(groups == NULL) { free(text); return JOB_NONE; }
+        // The new groups are chained in front of the free list
+        for(size_t i = new_size; i-- > jt->groups_size;) {
+            groups[i].id = 0;
+            groups[i].next = jt->groups_free;
+            jt->groups_free = i;
+        }
+        jt->groups = groups;
+        jt->groups_size = new_size;
+    }
+    int id = jt->max_id + 1;
+    if((size_t) id > jt->ids_size) {
+        size_t new_size = jt->ids_size ? jt->ids_size * 2 : 8;
+        size_t *ids = realloc(jt->ids, new_size * sizeof(size_t));
+        if(ids == NULL) { free(text); return JOB_NONE; }
+        jt->ids = ids;
+        jt->ids_size = new_size;
+    }
+
+    size_t group = jt->groups_free;
+    struct job_group *g = &jt->groups[group];
+    jt->groups_free = g->next;
+    jt->ids[id - 1] = group;
+    jt->max_id = id;
+    g->id = id;
+    g->pgid = 0;
+    g->text = text;
+    g->background = background;
+    g->first = JOB_NONE;
+    g->last = JOB_NONE;
+    g->last_pid = -1;
+    g->procs = 0;
+    g->alive = 0;
+    g->stopped = 0;
+    g->stop_signal = 0;
+    g->status = 0;
+    g->timed = false;
+    clock_gettime(CLOCK_MONOTONIC, &g->started);
+    return group;
+}
+
+size_t job_group_find(struct job_table *jt, int id) {
+    if(id <= 0 || id > jt->max_id) return JOB_NONE;
+    size_t group = jt->ids[id - 1];
+    if(group == JOB_NONE || jt->groups[group].procs == 0) return JOB_NONE;
+    return group;
+}
+
+void job_group_release(struct job_table *jt, size_t group) {
+    struct job_group *g = &jt->groups[group];
+    free(g->text);
+    g->text = NULL;
+    jt->ids[g->id - 1] = JOB_NONE;
+    // Each number given back here was taken once by job_group_new(): constant time on average
+    while(jt->max_id > 0 && jt->ids[jt->max_id - 1] == JOB_NONE) jt->max_id--;
+    g->id = 0;
+    g->next = jt->groups_free;
+    jt->groups_free = group;
+}
+
+/*!
+ * \fn static size_t pid_hash(pid_t pid, size_t mask)
+ * \brief Home position of a PID in the index (Fibonacci hashing).
+ */
+static size_t pid_hash(pid_t pid, size_t mask) {
+    return ((size_t) pid * 2654435761u) & mask;
+}
+
+/*!
+ * \fn static bool job_table_grow(struct job_table *jt)
+ * \brief Double the number of slots and rebuild the index.
+ */
+static bool job_table_grow(struct job_table *jt) {
+    size_t new_size = jt->size ? jt->size * 2 : JOB_TABLE_INITIAL_SIZE;
+    struct job *slots = realloc(jt->slots, new_size * sizeof(struct job));
+    if(slots == NULL) return false;
+    jt->slots = slots;
+
+    size_t *index = calloc(new_size * 2, sizeof(size_t));
+    if(index == NULL) return false;
+    free(jt->index);
+    jt->index = index;
+
+    size_t mask = new_size * 2 - 1;
+    for(size_t i = 0; i < jt->size; ++i) {
+        if(jt->slots[i].pid != -1) {
+            size_t h = pid_hash(jt->slots[i].pid, mask);
+            while(jt->index[h] != 0) h = (h + 1) & mask;
+            jt->index[h] = i + 1;
+        }
+    }
+
+    // The new slots are chained in front of the free list
+    for(size_t i = new_size; i-- > jt->size;) {
+        jt->slots[i].pid = -1;
+        jt->slots[i].next = jt->free_head;
+        jt->free_head = i;
+    }
+    jt->size = new_size;
+    return true;
+}
+
+size_t job_add(struct job_table *jt, pid_t pid, bool background, size_t group) {
+    if(jt->free_head == JOB_NONE && !job_table_grow(jt)) return JOB_NONE;
+
+    size_t slot = jt->free_head;
+    struct job *job = &jt->slots[slot];
+    jt->free_head = job->next;
+    job->pid = pid;
+    job->background = background;
+    job->done = false;
+    job->signaled = -1;
+    job->status_data = -1;
+    job->stopped = false;
+    job->group = group;
+    job->group_next = JOB_NONE;
+    job->group_prev = JOB_NONE;
+    job->next = JOB_NONE;
+    job->stage = 0;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+
+    if(group != JOB_NONE) {
+        struct job_group *g = &jt->groups[group];
+        job->group_prev = g->last;
+        if(g->last == JOB_NONE) g->first = slot;
+        else jt->slots[g->last].group_next = slot;
+        g->last = slot;
+        g->last_pid = pid;
+        g->procs++;
+        g->alive++;
     }
-    background_data.bg_array_size = 0;
 
-    for (size_t i = 0; i < BG_MAX_SIZE; ++i) {
-        init_exit_status(&background_data.exit_statuses[i]);
+    size_t mask = jt->size * 2 - 1;
+    size_t h = pid_hash(pid, mask);
+    while(jt->index[h] != 0) h = (h + 1) & mask;
+    jt->index[h] = slot + 1;
+    return slot;
+}
+
+/*!
+ * \fn static size_t job_index_find(struct job_table *jt, pid_t pid)
+ * \brief Position of a PID in the index, JOB_NONE if it is not there.
+ */
+static size_t job_index_find(struct job_table *jt, pid_t pid) {
+    if(jt->size == 0) return JOB_NONE;
+    size_t mask = jt->size * 2 - 1;
+    for(size_t h = pid_hash(pid, mask); jt->index[h] != 0; h = (h + 1) & mask) {
+        if(jt->slots[jt->index[h] - 1].pid == pid) return h;
     }
-    background_data.exit_statuses_size = 0;
+    return JOB_NONE;
 }
 
-void init_exit_status(volatile struct background_exit_status *exit_status) {
-    exit_status->pid = -1;
-    exit_status->status_data = -1;
-    exit_status->signaled = -1;
-}
\ No newline at end of file
+size_t job_find(struct job_table *jt, pid_t pid) {
+    size_t h = job_index_find(jt, pid);
+    return h == JOB_NONE ? JOB_NONE : jt->index[h] - 1;
+}
+
+void job_release(struct job_table *jt, size_t slot) {
+    size_t i = job_index_find(jt, jt->slots[slot].pid);
+    if(i != JOB_NONE) {
+        // Backward shift deletion: no tombstones, the probe sequences stay short
+        size_t mask = jt->size * 2 - 1;
+        jt->index[i] = 0;
+        for(size_t j = (i + 1) & mask; jt->index[j] != 0; j = (j + 1) & mask) {
+            size_t home = pid_hash(jt->slots[jt->index[j] - 1].pid, mask);
+            if((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+                jt->index[i] = jt->index[j];
+                jt->index[j] = 0;
+                i = j;
+            }
+        }
+    }
+
+    size_t group = jt->slots[slot].group;
+    if(group != JOB_NONE) {
+        struct job_group *g = &jt->groups[group];
+        struct job *job = &jt->slots[slot];
+        if(job->group_prev == JOB_NONE) g->first = job->group_next;
+        else jt->slots[job->group_prev].group_next = job->group_next;
+        if(job->group_next == JOB_NONE) g->last = job->group_prev;
+        else jt->slots[job->group_next].group_prev = job->group_prev;
+        if(!jt->slots[slot].done) g->alive--;
+        if(jt->slots[slot].stopped) g->stopped--;
+        if(--g->procs == 0) job_group_release(jt, group);
+    }
+
+    jt->slots[slot].pid = -1;
+    jt->slots[slot].next = jt->free_head;
+    jt->free_head = slot;
+}
+
+void job_update(struct job_table *jt, pid_t pid, int status, const struct rusage *usage, const struct timespec *ended) {
+    size_t slot = job_find(jt, pid);
+    if(slot == JOB_NONE) return; // Not started by the shell (or already forgotten)
+
+    struct job *job = &jt->slots[slot];
+    struct job_group *g = job->group != JOB_NONE ? &jt->groups[job->group] : NULL;
+    if(WIFSTOPPED(status)) {
+        if(!job->stopped && g != NULL) {
+            g->stopped++;
+            g->stop_signal = WSTOPSIG(status);
+        }
+        job->stopped = true;
+        return;
+    }
+    if(job->stopped && g != NULL) g->stopped--;
+    job->stopped = false;
+    if(WIFCONTINUED(status)) return;
+
+    if(WIFEXITED(status)) {
+        job->signaled = 0;
+        job->status_data = WEXITSTATUS(status);
+    } else if(WIFSIGNALED(status)) {
+        job->signaled = 1;
+        job->status_data = WTERMSIG(status);
+    }
+    job->done = true;
+    job->usage = *usage;
+    if(ended != NULL) job->ended = *ended;
+    else clock_gettime(CLOCK_MONOTONIC, &job->ended);
+    if(trace_enabled) {
+        uint64_t started = (uint64_t) job->started.tv_sec * 1000000000u + (uint64_t) job->started.tv_nsec;
+        uint64_t ended = (uint64_t) job->ended.tv_sec * 1000000000u + (uint64_t) job->ended.tv_nsec;
+        trace_record('X', "process", started, ended - started, pid, g != NULL ? g->text : NULL, status);
+        trace_record('i', "reap", ended, 0, 0, NULL, pid);
+    }
+    if(g != NULL) {
+        g->alive--;
+        if(pid == g->last_pid) g->status = job->signaled ? 256 + job->status_data : job->status_data;
+    }
+    if(job->background) {
+        job->next = jt->finished_head;
+        jt->finished_head = slot;
+    }
+}
+
+void job_reap(struct job_table *jt) {
+    int status;
+    pid_t pid;
+    struct rusage usage;
+    while((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) job_update(jt, pid, status, &usage, NULL);
+    zygote_reap(jt);
+}
+
+size_t job_pop_finished(struct job_table *jt) {
+    size_t slot = jt->finished_head;
+    if(slot != JOB_NONE) jt->finished_head = jt->slots[slot].next;
+    return slot;
+}
+
+/*!
+ * \fn static bool text_append(char **text, size_t *len, size_t *size, const char *str)
+ * \brief Append a string to a growing allocated string.
+ */
+static bool text_append(char **text, size_t *len, size_t *size, const char *str) {
+    size_t n = strlen(str);
+    if(*len + n + 1 > *size) {
+        size_t new_size = (*len + n + 1) * 2;
+        char *new_text = realloc(*text, new_size);
+        if(new_text == NULL) return false;
+        *text = new_text;
+        *size = new_size;
+    }
+    memcpy(*text + *len, str, n + 1);
+    *len += n;
+    return true;
+}
+
+char *line_to_text(struct line *li) {
+    char *text = NULL;
+    size_t len = 0, size = 0;
+    bool ok = text_append(&text, &len, &size, "");
+    for(size_t i = 0; ok && i < li->n_cmds; ++i) {
+        if(i > 0) ok = text_append(&text, &len, &size, " | ");
+        for(size_t j = 0; ok && j < li->cmds[i].n_args; ++j) {
+            if(j > 0) ok = text_append(&text, &len, &size, " ");
+            if(ok) ok = text_append(&text, &len, &size, li->cmds[i].args[j]);
+        }
+    }
+    if(ok && li->file_input) ok = text_append(&text, &len, &size, " < ") && text_append(&text, &len, &size, li->file_input);
+    if(ok && li->file_output) {
+        ok = text_append(&text, &len, &size, li->file_output_append ? " >> " : " > ")
+             && text_append(&text, &len, &size, li->file_output);
+    }
+    if(!ok) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
@@ -8,6 +8,8 @@
 #define FISH_UTILS_H
 
 #include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include "cmdline.h"
 
@@ -30,11 +32,34 @@
 #define YES_NO(i) ((i) ? "Y" : "N")
 
 /*!
- * \def BG_MAX_SIZE
- * \brief Size of the array containing the pids of the commands executed in background
+ * \def JOB_TABLE_INITIAL_SIZE
+ * \brief Initial number of slots of the job table. The table grows without limit.
  */
-#define BG_MAX_SIZE 1024
+#define JOB_TABLE_INITIAL_SIZE 64
 
+/*!
+ * \def JOB_NONE
+ * \brief Slot index meaning "no slot" (end of the free list or of the list of finished jobs).
+ */
+#define JOB_NONE ((size_t) -1)
+
+
+/*!
+ * \struct pipe_options
+ * \brief Tuning of the pipes between the commands of a pipeline (see pipeopt.h).
+ */
+struct pipe_options {
+    /*!
+     * \var size
+     * \brief Capacity requested with F_SETPIPE_SZ, 0 to keep the default of the kernel.
+     */
+    size_t size;
+    /*!
+     * \var packet
+     * \brief true to create the pipes with O_DIRECT: every write() is a packet, read by one read().
+     */
+    bool packet;
+};
 
 /*!
  * \struct pipe_control
@@ -51,59 +76,245 @@ struct pipe_control {
      * \brief File descriptors for the next pipe.
      */
     int pipe_next[2];
+    /*!
+     * \var options
+     * \brief Tuning of the pipes of the pipeline.
+     */
+    struct pipe_options options;
 };
 
 /*!
- * \struct background_exit_status
- * \brief Structure representing the exit status of a background process.
- * This structure holds the PID of the process, as well as the status of the process when it exited.
- * if signaled is 1, the process was killed by a signal. Otherwise it exited normally.
- * then status_data is the signal number if signaled is 1, or the exit status if signaled is 0.
+ * \struct job
+ * \brief A slot of the job table: a process started by the shell.
+ * When the process is reaped, done is set to true, then signaled is 1 if the process was killed by a signal,
+ * and status_data is the signal number if signaled is 1, or the exit status if signaled is 0.
  */
-struct background_exit_status {
+struct job {
     /*!
      * \var pid
-     * \brief The PID of the process.
+     * \brief The PID of the process, -1 if the slot is free.
+     */
+    pid_t pid;
+    /*!
+     * \var background
+     * \brief true if the process runs in background.
      */
-    volatile pid_t pid;
+    bool background;
+    /*!
+     * \var done
+     * \brief true once the process has been reaped.
+     */
+    bool done;
     /*!
      * \var signaled
      * \brief If signaled is 1, the process was killed by a signal. Otherwise it exited normally.
      */
-    volatile int signaled;
+    int signaled;
     /*!
      * \var status_data
      * \brief If signaled is 1, the process was killed, so status_data is the signal number. Otherwise it is the exit status.
      */
-    volatile int status_data;
+    int status_data;
+    /*!
+     * \var stopped
+     * \brief true while the process is stopped (SIGTSTP, SIGSTOP, ...).
+     */
+    bool stopped;
+    /*!
+     * \var group
+     * \brief The job group (pipeline) the process belongs to, see struct job_group.
+     */
+    size_t group;
+    /*!
+     * \var group_next
+     * \brief Next process of the same group, in the order of the pipeline.
+     */
+    size_t group_next;
+    /*!
+     * \var group_prev
+     * \brief Previous process of the same group, JOB_NONE for the first one.
+     */
+    size_t group_prev;
+    /*!
+     * \var next
+     * \brief Next slot of the free list when the slot is free, of the list of finished background jobs once done.
+     */
+    size_t next;
+    /*!
+     * \var stage
+     * \brief The index of the command in its pipeline.
+     */
+    size_t stage;
+    /*!
+     * \var started
+     * \brief When the process was added to the table, just after it was started (CLOCK_MONOTONIC).
+     */
+    struct timespec started;
+    /*!
+     * \var ended
+     * \brief When the process was reaped (CLOCK_MONOTONIC).
+     */
+    struct timespec ended;
+    /*!
+     * \var usage
+     * \brief The resources used by the process, filled by wait4() when it is reaped.
+     */
+    struct rusage usage;
 };
 
 /*!
- * \struct bg_data
- * \brief Structure holding the background processes.
+ * \struct job_group
+ * \brief A job as seen by the user: the processes of one pipeline, which share a process group.
+ * The group is freed when its last process is released from the job table.
  */
-struct bg_data {
+struct job_group {
+    /*!
+     * \var id
+     * \brief The job number shown by "jobs" and used as %id, 0 if the group is free.
+     */
+    int id;
+    /*!
+     * \var pgid
+     * \brief The process group of the pipeline (PID of its first process), 0 before it is started
+     * or when job control is disabled.
+     */
+    pid_t pgid;
+    /*!
+     * \var text
+     * \brief The command line of the job (allocated).
+     */
+    char *text;
+    /*!
+     * \var background
+     * \brief true if the job runs in background.
+     */
+    bool background;
+    /*!
+     * \var first
+     * \brief The first process of the group (see job.group_next), JOB_NONE if it has none.
+     */
+    size_t first;
+    /*!
+     * \var last
+     * \brief The last process of the group, JOB_NONE if it has none.
+     */
+    size_t last;
+    /*!
+     * \var next
+     * \brief The next free group, when the group is free.
+     */
+    size_t next;
+    /*!
+     * \var last_pid
+     * \brief The PID of the last process of the pipeline, which gives its status to the job.
+     */
+    pid_t last_pid;
+    /*!
+     * \var procs
+     * \brief The number of processes of the group still in the job table.
+     */
+    size_t procs;
+    /*!
+     * \var alive
+     * \brief The number of processes of the group not reaped yet.
+     */
+    size_t alive;
+    /*!
+     * \var stopped
+     * \brief The number of processes of the group currently stopped.
+     */
+    size_t stopped;
+    /*!
+     * \var stop_signal
+     * \brief The signal which stopped the last process stopped.
+     */
+    int stop_signal;
+    /*!
+     * \var status
+     * \brief The status of the job once its last process is reaped, with the encoding of execute_command_with_args
+     * (exit status, or 256 + the signal number).
+     */
+    int status;
     /*!
-     * \var bg_array
-     * \brief Array holding the PIDs of background processes.
+     * \var timed
+     * \brief true if the resources used by every process are printed when the job finishes (see timing.h).
      */
-    volatile pid_t bg_array[BG_MAX_SIZE];
+    bool timed;
     /*!
-     * \var bg_array_size
-     * \brief Size of the array of background processes.
+     * \var started
+     * \brief When the job was created (CLOCK_MONOTONIC).
      */
-    volatile size_t bg_array_size;
+    struct timespec started;
+};
 
+/*!
+ * \struct job_table
+ * \brief Table of the processes started by the shell.
+ *
+ * The slots are reused through a free list, and a hash table (open addressing, linear probing)
+ * maps a PID to its slot, so adding, finding and removing a process is done in constant time.
+ * The background processes reaped by job_reap() are chained in a list consumed by the main loop.
+ * The groups are reused through a free list too, and found by job number in an array indexed by it,
+ * so starting a pipeline does not depend on the number of jobs.
+ *
+ * The table is only used by the main thread: the SIGCHLD handler only wakes up the event loop (see event.h).
+ */
+struct job_table {
+    /*!
+     * \var slots
+     * \brief The slots.
+     */
+    struct job *slots;
+    /*!
+     * \var size
+     * \brief The number of slots.
+     */
+    size_t size;
+    /*!
+     * \var free_head
+     * \brief The first free slot.
+     */
+    size_t free_head;
+    /*!
+     * \var index
+     * \brief The hash table from a PID to its slot: slot index + 1, 0 for an empty entry. Twice as large as slots.
+     */
+    size_t *index;
+    /*!
+     * \var finished_head
+     * \brief The last background job reaped, head of the list of finished background jobs not reported yet.
+     */
+    size_t finished_head;
     /*!
-     * \var exit_statuses
-     * \brief Array holding the exit statuses of background processes.
+     * \var groups
+     * \brief The job groups. A free group has an id of 0.
      */
-    volatile struct background_exit_status exit_statuses[BG_MAX_SIZE];
+    struct job_group *groups;
     /*!
-     * \var exit_statuses_size
-     * \brief Size of the array of exit statuses for background processes.
+     * \var groups_size
+     * \brief The number of allocated groups.
      */
-    volatile size_t exit_statuses_size;
+    size_t groups_size;
+    /*!
+     * \var groups_free
+     * \brief The first free group, JOB_NONE if every group is used.
+     */
+    size_t groups_free;
+    /*!
+     * \var ids
+     * \brief The group of each job number up to max_id (ids[id - 1]), JOB_NONE for a number not in use.
+     */
+    size_t *ids;
+    /*!
+     * \var ids_size
+     * \brief The allocated number of elements of ids.
+     */
+    size_t ids_size;
+    /*!
+     * \var max_id
+     * \brief The highest job number in use, 0 if there is none.
+     */
+    int max_id;
 };
 
 /*!
@@ -165,22 +376,119 @@ void print_debug_line(struct line *li);
 void substitute_home(char *path, char *home);
 
 /*!
- * \fn void init_background_data(volatile struct bg_data background_data)
- * \brief Initialize the array of background processes.
- * \param background_data The background_data structure to initialize.
+ * \fn void job_table_init(struct job_table *jt)
+ * \brief Initialize an empty job table. The slots are allocated by the first job_add().
+ * \param jt The job table to initialize.
+ */
+void job_table_init(struct job_table *jt);
+
+/*!
+ * \fn size_t job_group_new(struct job_table *jt, char *text, bool background)
+ * \brief Create an empty job group, numbered after the highest job number in use.
+ *
+ * \param jt The job table.
+ * \param text The command line of the job, owned by the group from now on.
+ * \param background true if the job runs in background.
+ * \return The index of the group, JOB_NONE if a memory allocation failure occurs (text is freed).
+ */
+size_t job_group_new(struct job_table *jt, char *text, bool background);
+
+/*!
+ * \fn size_t job_group_find(struct job_table *jt, int id)
+ * \brief Find a group by its job number. A group without process (the line being started) is not a job yet.
+ *
+ * \param jt The job table.
+ * \param id The job number.
+ * \return The index of the group, JOB_NONE if there is no such job.
+ */
+size_t job_group_find(struct job_table *jt, int id);
+
+/*!
+ * \fn void job_group_release(struct job_table *jt, size_t group)
+ * \brief Free a group which has no process left (a pipeline of internal commands, or whose commands could not start).
+ *
+ * \param jt The job table.
+ * \param group The index of the group.
+ */
+void job_group_release(struct job_table *jt, size_t group);
+
+/*!
+ * \fn size_t job_add(struct job_table *jt, pid_t pid, bool background, size_t group)
+ * \brief Register a process started by the shell. It cannot be reaped before, since only the main thread reaps.
+ *
+ * \param jt The job table.
+ * \param pid The PID of the process.
+ * \param background true if the process runs in background.
+ * \param group The group of the process, appended at its end (JOB_NONE for none).
+ * \return The slot of the process, JOB_NONE if a memory allocation failure occurs.
+ */
+size_t job_add(struct job_table *jt, pid_t pid, bool background, size_t group);
+
+/*!
+ * \fn size_t job_find(struct job_table *jt, pid_t pid)
+ * \brief Find the slot of a process.
+ *
+ * \param jt The job table.
+ * \param pid The PID of the process.
+ * \return The slot of the process, JOB_NONE if the process is not in the table.
+ */
+size_t job_find(struct job_table *jt, pid_t pid);
+
+/*!
+ * \fn void job_release(struct job_table *jt, size_t slot)
+ * \brief Remove a process from the table and put its slot back in the free list.
+ * Its group is freed with its last process.
+ *
+ * \param jt The job table.
+ * \param slot The slot to release.
+ */
+void job_release(struct job_table *jt, size_t slot);
+
+/*!
+ * \fn void job_update(struct job_table *jt, pid_t pid, int status, const struct rusage *usage, const struct timespec *ended)
+ * \brief Record a change of state of a process, as reported by wait4().
+ *
+ * A terminated process gets its status, its resources and the time it was reaped (see struct job), and
+ * a background one is pushed in the list of finished jobs (see job_pop_finished). A stopped or continued
+ * process updates the counters of its group. A PID unknown to the table is ignored.
+ *
+ * \param jt The job table.
+ * \param pid The process.
+ * \param status The status, as returned by wait4().
+ * \param usage The resources used by the process, read if it terminated.
+ * \param ended When the process was reaped (CLOCK_MONOTONIC), NULL for now.
+ */
+void job_update(struct job_table *jt, pid_t pid, int status, const struct rusage *usage, const struct timespec *ended);
+
+/*!
+ * \fn void job_reap(struct job_table *jt)
+ * \brief Reap all the terminated children with wait4(-1, WNOHANG) and record their status in their slot.
+ *
+ * Called by the main thread when the event loop received SIGCHLD. The children stopped or continued
+ * are reported too (WUNTRACED | WCONTINUED), and so are the processes started by the fork server
+ * (see zygote.h). Each change is recorded by job_update().
+ *
+ * \param jt The job table.
+ */
+void job_reap(struct job_table *jt);
+
+/*!
+ * \fn size_t job_pop_finished(struct job_table *jt)
+ * \brief Take a finished background job not reported yet.
  *
- * This function sets all PIDs in the bg_array to -1 and initializes the size of the array and exit statuses
+ * \param jt The job table.
+ * \return The slot of the job (to be released by the caller), JOB_NONE if there is none.
  */
-void init_background_data(volatile struct bg_data background_data);
+size_t job_pop_finished(struct job_table *jt);
 
 /*!
- * \fn void init_exit_status(volatile struct background_exit_status *exit_status)
- * \brief Initialize the exit_status structure.
- * \param exit_status the background_exit_status struct to initialize.
+ * \fn char *line_to_text(struct line *li)
+ * \brief Rebuild the text of a parsed line, as shown by the internal command "jobs".
  *
- * This function sets the initial values for the PID, signaled flag, and status_data of a background_exit_status structure.
+ * \param li The parsed line.
+ * \return An allocated string, NULL if a memory allocation failure occurs.
  */
-void init_exit_status(volatile struct background_exit_status *exit_status);
+char *line_to_text(struct line *li);
 
 
 #endif //FISH_UTILS_H
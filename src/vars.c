@@ -0,0 +1,451 @@
+/*!
+ * \file vars.c
+ * \brief Implementation of the variables of the shell and their expansion.
+ * \author Romain GALLAND
+ * \version 1
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "vars.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!
+ * \var environ
+ * \brief The environment of the shell, replaced by the envp array of the exported variables.
+ */
+extern char **environ;
+
+/*!
+ * \struct var
+ * \brief A slot of the hash table.
+ */
+struct var {
+    /*! \brief The "NAME=value" string, NULL for an empty slot. */
+    char *entry;
+    /*! \brief The length of the name. */
+    size_t name_len;
+    /*! \brief The hash of the name. */
+    uint64_t hash;
+    /*! \brief true if the variable is given to the commands. */
+    bool exported;
+};
+
+/*!
+ * \struct table
+ * \brief The variables, in an open addressing hash table with linear probing, at most half full.
+ */
+static struct table {
+    /*! \brief The slots. */
+    struct var *slots;
+    /*! \brief The number of slots (a power of two), 0 before the environment is imported. */
+    size_t capacity;
+    /*! \brief The number of variables. */
+    size_t count;
+    /*! \brief The number of exported variables. */
+    size_t n_exported;
+    /*! \brief The entries of the exported variables, NULL terminated. */
+    char **envp;
+    /*! \brief The allocated number of elements of envp. */
+    size_t envp_size;
+    /*! \brief The number of envp arrays built (see vars_generation). */
+    size_t generation;
+    /*! \brief The number of builds of envp. */
+    size_t rebuilds;
+} table;
+
+/*!
+ * \struct vars_undo
+ * \brief A string of a pipeline replaced by its expansion.
+ */
+struct vars_undo {
+    /*! \brief Where the string is. */
+    char **slot;
+    /*! \brief The string given by the parser. */
+    char *original;
+};
+
+/*!
+ * \struct expansion
+ * \brief The strings replaced by vars_expand_line(), and a buffer to build the expansions.
+ */
+static struct expansion {
+    /*! \brief The strings replaced. */
+    struct vars_undo *undo;
+    /*! \brief The number of strings replaced. */
+    size_t n_undo;
+    /*! \brief The allocated number of elements of undo. */
+    size_t undo_size;
+    /*! \brief The expansion being built. */
+    char *buf;
+    /*! \brief The length of the expansion being built. */
+    size_t len;
+    /*! \brief The allocated size of buf. */
+    size_t size;
+} expansion;
+
+/*!
+ * \fn static uint64_t hash_name(const char *name, size_t len)
+ * \brief FNV-1a hash of a name.
+ */
+static uint64_t hash_name(const char *name, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*!
+ * \fn static size_t find(const char *name, size_t len, uint64_t hash)
+ * \brief Find the slot of a variable, or the empty slot where it would be inserted.
+ */
+static size_t find(const char *name, size_t len, uint64_t hash) {
+    size_t mask = table.capacity - 1;
+    size_t i = hash & mask;
+    while(table.slots[i].entry != NULL
+          && (table.slots[i].hash != hash || table.slots[i].name_len != len || memcmp(table.slots[i].entry, name, len) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/*!
+ * \fn static void rebuild_envp()
+ * \brief Gather the entries of the exported variables in envp, and install it as environ.
+ */
+static void rebuild_envp() {
+    if(table.envp_size < table.n_exported + 1) {
+        size_t size = table.envp_size ? table.envp_size : 64;
+        while(size < table.n_exported + 1) size *= 2;
+        char **envp = realloc(table.envp, size * sizeof(char *));
+        if(envp == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        table.envp = envp;
+        table.envp_size = size;
+    }
+    size_t n = 0;
+    for(size_t i = 0; i < table.capacity; ++i) {
+        if(table.slots[i].entry != NULL && table.slots[i].exported) table.envp[n++] = table.slots[i].entry;
+    }
+    table.envp[n] = NULL;
+    environ = table.envp;
+    ++table.generation;
+    ++table.rebuilds;
+}
+
+/*!
+ * \fn static void grow()
+ * \brief Double the number of slots (64 the first time) and insert the variables again.
+ */
+static void grow() {
+    size_t capacity = table.capacity ? 2 * table.capacity : 64;
+    struct var *slots = calloc(capacity, sizeof(struct var));
+    if(slots == NULL) { perror("calloc"); exit(EXIT_FAILURE); }
+    struct var *old = table.slots;
+    size_t old_capacity = table.capacity;
+    table.slots = slots;
+    table.capacity = capacity;
+    for(size_t i = 0; i < old_capacity; ++i) {
+        if(old[i].entry != NULL) table.slots[find(old[i].entry, old[i].name_len, old[i].hash)] = old[i];
+    }
+    free(old);
+}
+
+/*!
+ * \fn static bool put(const char *name, size_t len, const char *value, bool export)
+ * \brief Insert or replace a variable, without rebuilding envp. "value" may point into the entry replaced.
+ *
+ * \return true if envp has to be rebuilt (an exported variable changed).
+ */
+static bool put(const char *name, size_t len, const char *value, bool export) {
+    if(2 * (table.count + 1) > table.capacity) grow();
+    uint64_t hash = hash_name(name, len);
+    size_t i = find(name, len, hash);
+    struct var *v = &table.slots[i];
+    if(v->entry != NULL && strcmp(v->entry + len + 1, value) == 0 && (v->exported || !export)) return false;
+
+    size_t value_len = strlen(value);
+    char *entry = malloc(len + value_len + 2);
+    if(entry == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    memcpy(entry, name, len);
+    entry[len] = '=';
+    memcpy(entry + len + 1, value, value_len + 1);
+
+    if(v->entry == NULL) {
+        ++table.count;
+        v->name_len = len;
+        v->hash = hash;
+        v->exported = false;
+    }
+    free(v->entry);
+    v->entry = entry;
+    if(export && !v->exported) {
+        v->exported = true;
+        ++table.n_exported;
+    }
+    return v->exported;
+}
+
+/*!
+ * \fn static void import_environ()
+ * \brief Fill the table with the environment of the shell, the first time the variables are used.
+ */
+static void import_environ() {
+    if(table.capacity != 0) return;
+    grow();
+    for(char **var = environ; var != NULL && *var != NULL; ++var) {
+        const char *eq = strchr(*var, '=');
+        if(eq != NULL && eq > *var) put(*var, (size_t) (eq - *var), eq + 1, true);
+    }
+    rebuild_envp();
+}
+
+bool vars_valid_name(const char *name, size_t len) {
+    if(len == 0 || !(isalpha((unsigned char) name[0]) || name[0] == '_')) return false;
+    for(size_t i = 1; i < len; ++i) {
+        if(!(isalnum((unsigned char) name[i]) || name[i] == '_')) return false;
+    }
+    return true;
+}
+
+const char *vars_get(const char *name, size_t len) {
+    import_environ();
+    struct var *v = &table.slots[find(name, len, hash_name(name, len))];
+    return v->entry != NULL ? v->entry + len + 1 : NULL;
+}
+
+int vars_set(const char *name, size_t len, const char *value, bool export) {
+    if(!vars_valid_name(name, len)) return -1;
+    import_environ();
+    if(put(name, len, value, export)) rebuild_envp();
+    return 0;
+}
+
+void vars_unset(const char *name, size_t len) {
+    import_environ();
+    size_t mask = table.capacity - 1;
+    size_t i = find(name, len, hash_name(name, len));
+    if(table.slots[i].entry == NULL) return;
+    bool exported = table.slots[i].exported;
+    free(table.slots[i].entry);
+    --table.count;
+    if(exported) --table.n_exported;
+
+    // Backward shift: move back the following variables which cannot be found anymore across the hole
+    for(size_t j = i;;) {
+        j = (j + 1) & mask;
+        if(table.slots[j].entry == NULL) break;
+        size_t home = table.slots[j].hash & mask;
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if(!stays) {
+            table.slots[i] = table.slots[j];
+            i = j;
+        }
+    }
+    table.slots[i].entry = NULL;
+    if(exported) rebuild_envp();
+}
+
+char **vars_envp() {
+    import_environ();
+    return table.envp;
+}
+
+char **vars_envp_with(char *assignments[], size_t n) {
+    import_environ();
+    char **envp = malloc((table.n_exported + n + 1) * sizeof(char *));
+    if(envp == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t count = 0;
+    for(char **var = table.envp; *var != NULL; ++var) {
+        size_t len = strcspn(*var, "=");
+        bool replaced = false;
+        for(size_t k = 0; k < n && !replaced; ++k) replaced = strncmp(assignments[k], *var, len + 1) == 0;
+        if(!replaced) envp[count++] = *var;
+    }
+    for(size_t k = 0; k < n; ++k) {
+        size_t len = strcspn(assignments[k], "=");
+        bool overridden = false; // "A=1 A=2 cmd": the last one wins
+        for(size_t l = k + 1; l < n && !overridden; ++l) overridden = strncmp(assignments[l], assignments[k], len + 1) == 0;
+        if(!overridden) envp[count++] = assignments[k];
+    }
+    envp[count] = NULL;
+    ++table.generation;
+    return envp;
+}
+
+size_t vars_generation() {
+    return table.generation;
+}
+
+size_t vars_assignments(const struct line *pl, size_t cmd_index) {
+    const struct cmd *cmd = &pl->cmds[cmd_index];
+    size_t n = 0;
+    while(n < cmd->n_args && (pl->arg_flags[cmd->first_arg + n] & LINE_ARG_ASSIGN)) ++n;
+    return n;
+}
+
+void vars_assign(char *assignments[], size_t n) {
+    for(size_t k = 0; k < n; ++k) {
+        size_t len = strcspn(assignments[k], "=");
+        vars_set(assignments[k], len, assignments[k] + len + 1, false);
+    }
+}
+
+/*!
+ * \fn static void buf_append(const char *str, size_t len)
+ * \brief Append bytes to the expansion being built.
+ */
+static void buf_append(const char *str, size_t len) {
+    if(expansion.len + len + 1 > expansion.size) {
+        size_t size = expansion.size ? expansion.size : 256;
+        while(expansion.len + len + 1 > size) size *= 2;
+        char *buf = realloc(expansion.buf, size);
+        if(buf == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        expansion.buf = buf;
+        expansion.size = size;
+    }
+    memcpy(expansion.buf + expansion.len, str, len);
+    expansion.len += len;
+}
+
+/*!
+ * \fn static void expand(char **slot, int status)
+ * \brief Replace the variables of the string at "slot" by their values, remembering the original string.
+ */
+static void expand(char **slot, int status) {
+    const char *s = *slot;
+    expansion.len = 0;
+    while(*s != '\0') {
+        const char *dollar = strchrnul(s, '$');
+        buf_append(s, (size_t) (dollar - s));
+        s = dollar;
+        if(*s == '\0') break;
+
+        char number[24];
+        const char *name = s + 1;
+        size_t len = 0;
+        if(name[0] == '?' || name[0] == '$') {
+            int n = snprintf(number, sizeof(number), "%d", name[0] == '?' ? status : (int) getpid());
+            buf_append(number, (size_t) n);
+            s += 2;
+            continue;
+        }
+        if(name[0] == '{') {
+            const char *end = strchr(name, '}');
+            if(end != NULL && vars_valid_name(name + 1, (size_t) (end - name - 1))) {
+                const char *value = vars_get(name + 1, (size_t) (end - name - 1));
+                if(value != NULL) buf_append(value, strlen(value));
+                s = end + 1;
+                continue;
+            }
+        } else if(isalpha((unsigned char) name[0]) || name[0] == '_') {
+            while(isalnum((unsigned char) name[len]) || name[len] == '_') ++len;
+            const char *value = vars_get(name, len);
+            if(value != NULL) buf_append(value, strlen(value));
+            s = name + len;
+            continue;
+        }
+        buf_append("$", 1); // Not a variable: a plain '$'
+        ++s;
+    }
+    expansion.buf[expansion.len] = '\0';
+
+    char *expanded = strdup(expansion.buf);
+    if(expanded == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+    if(expansion.n_undo == expansion.undo_size) {
+        size_t size = expansion.undo_size ? 2 * expansion.undo_size : 16;
+        struct vars_undo *undo = realloc(expansion.undo, size * sizeof(struct vars_undo));
+        if(undo == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        expansion.undo = undo;
+        expansion.undo_size = size;
+    }
+    expansion.undo[expansion.n_undo++] = (struct vars_undo) {slot, *slot};
+    *slot = expanded;
+}
+
+void vars_expand_line(struct line *pl, int status) {
+    if(pl->n_vars == 0) return;
+    for(size_t i = 0; i < pl->n_cmds; ++i) {
+        struct cmd *cmd = &pl->cmds[i];
+        for(size_t j = 0; j < cmd->n_args; ++j) {
+            if(pl->arg_flags[cmd->first_arg + j] & LINE_ARG_VARS) expand(&cmd->args[j], status);
+        }
+    }
+    if(pl->file_input_flags & LINE_ARG_VARS) expand(&pl->file_input, status);
+    if(pl->file_output_flags & LINE_ARG_VARS) expand(&pl->file_output, status);
+}
+
+void vars_restore_line() {
+    while(expansion.n_undo > 0) {
+        struct vars_undo *undo = &expansion.undo[--expansion.n_undo];
+        free(*undo->slot);
+        *undo->slot = undo->original;
+    }
+}
+
+void vars_print_stats(FILE *out) {
+    import_environ();
+    fprintf(out, "vars: %zu variables (%zu exported) in %zu slots, environment built %zu times\n",
+            table.count, table.n_exported, table.capacity, table.rebuilds);
+}
+
+/*!
+ * \fn static int compare_entries(const void *a, const void *b)
+ * \brief Compare two "NAME=value" strings by name for qsort(3).
+ */
+static int compare_entries(const void *a, const void *b) {
+    const char *x = *(char *const *) a, *y = *(char *const *) b;
+    size_t x_len = strcspn(x, "="), y_len = strcspn(y, "=");
+    int cmp = memcmp(x, y, x_len < y_len ? x_len : y_len);
+    return cmp != 0 ? cmp : (x_len > y_len) - (x_len < y_len);
+}
+
+int builtin_export(char *args[], struct line *li) {
+    (void) li;
+    import_environ();
+    if(args[1] == NULL) {
+        char **sorted = malloc((table.n_exported + 1) * sizeof(char *));
+        if(sorted == NULL) { perror("malloc"); return 1; }
+        memcpy(sorted, table.envp, (table.n_exported + 1) * sizeof(char *));
+        qsort(sorted, table.n_exported, sizeof(char *), compare_entries);
+        for(size_t i = 0; i < table.n_exported; ++i) printf("export %s\n", sorted[i]);
+        free(sorted);
+        return 0;
+    }
+    int ret = 0;
+    for(size_t k = 1; args[k] != NULL; ++k) {
+        size_t len = strcspn(args[k], "=");
+        const char *value = args[k][len] == '=' ? args[k] + len + 1 : vars_get(args[k], len);
+        if(!vars_valid_name(args[k], len)) {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", args[k]);
+            ret = 1;
+        } else if(value != NULL) { // "export NAME" of an unset variable does nothing
+            vars_set(args[k], len, value, true);
+        }
+    }
+    return ret;
+}
+
+int builtin_unset(char *args[], struct line *li) {
+    (void) li;
+    int ret = 0;
+    for(size_t k = 1; args[k] != NULL; ++k) {
+        if(!vars_valid_name(args[k], strlen(args[k]))) {
+            fprintf(stderr, "unset: `%s': not a valid identifier\n", args[k]);
+            ret = 1;
+        } else {
+            vars_unset(args[k], strlen(args[k]));
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,154 @@
+/*!
+ * \file vars.h
+ * \brief Header file for the variables of the shell and their expansion.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The variables are kept in an open addressing hash table, filled with the environment of the shell
+ * when it is first used. A variable is a shell variable, or an exported one given to the commands.
+ * The "NAME=value" strings of the exported variables are gathered in an envp array, which is rebuilt
+ * only when an exported variable is set or unset: starting a command costs no copy of the environment.
+ * The array is also installed as environ, so getenv(3) sees the exported variables.
+ *
+ * Before a pipeline is executed, "$NAME", "${NAME}", "$?" (the status of the last pipeline) and "$$"
+ * (the PID of the shell) are replaced in the arguments and the filenames flagged LINE_ARG_VARS by the
+ * parser. A value is neither split into words nor expanded as a pattern, and an unset variable is
+ * replaced by an empty string. The "NAME=value" arguments in front of a command (LINE_ARG_ASSIGN) only
+ * set the variables in its environment; without a command, they set shell variables.
+ */
+#ifndef FISH_VARS_H
+#define FISH_VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cmdline.h"
+
+/*!
+ * \fn bool vars_valid_name(const char *name, size_t len)
+ * \brief Check a variable name: a letter or '_', followed by letters, digits or '_'.
+ *
+ * \param name The name (not necessarily '\0' terminated).
+ * \param len The length of the name.
+ * \return true if the name is valid.
+ */
+bool vars_valid_name(const char *name, size_t len);
+
+/*!
+ * \fn const char *vars_get(const char *name, size_t len)
+ * \brief Get the value of a variable.
+ *
+ * \param name The name (not necessarily '\0' terminated).
+ * \param len The length of the name.
+ * \return The value, valid until the variable is set or unset, NULL if the variable is not set.
+ */
+const char *vars_get(const char *name, size_t len);
+
+/*!
+ * \fn int vars_set(const char *name, size_t len, const char *value, bool export)
+ * \brief Set a variable. An exported variable stays exported.
+ *
+ * \param name The name (not necessarily '\0' terminated).
+ * \param len The length of the name.
+ * \param value The value.
+ * \param export true to export the variable.
+ * \return 0 on success, -1 if the name is not valid.
+ */
+int vars_set(const char *name, size_t len, const char *value, bool export);
+
+/*!
+ * \fn void vars_unset(const char *name, size_t len)
+ * \brief Remove a variable, if it is set.
+ *
+ * \param name The name (not necessarily '\0' terminated).
+ * \param len The length of the name.
+ */
+void vars_unset(const char *name, size_t len);
+
+/*!
+ * \fn char **vars_envp()
+ * \brief Get the "NAME=value" strings of the exported variables, NULL terminated.
+ *
+ * \return The array, valid until an exported variable is set or unset.
+ */
+char **vars_envp();
+
+/*!
+ * \fn char **vars_envp_with(char *assignments[], size_t n)
+ * \brief Build the environment of a command written after "NAME=value" arguments.
+ *
+ * \param assignments The "NAME=value" arguments, which replace the exported variables of the same names.
+ * \param n The number of assignments.
+ * \return An array to free with free(3) (the strings are not copied).
+ */
+char **vars_envp_with(char *assignments[], size_t n);
+
+/*!
+ * \fn size_t vars_generation()
+ * \brief Get a number changed each time an envp array is built, by vars_envp() or vars_envp_with().
+ *
+ * An array and the generation it was seen with identify its content (see zygote_command).
+ *
+ * \return The number of envp arrays built.
+ */
+size_t vars_generation();
+
+/*!
+ * \fn size_t vars_assignments(const struct line *pl, size_t cmd_index)
+ * \brief Count the "NAME=value" arguments (LINE_ARG_ASSIGN) in front of a command.
+ *
+ * \param pl The pipeline.
+ * \param cmd_index The index of the command.
+ * \return The number of assignments (all the arguments for a command made only of assignments).
+ */
+size_t vars_assignments(const struct line *pl, size_t cmd_index);
+
+/*!
+ * \fn void vars_assign(char *assignments[], size_t n)
+ * \brief Set the shell variables of "NAME=value" arguments written without a command.
+ *
+ * \param assignments The arguments.
+ * \param n The number of arguments.
+ */
+void vars_assign(char *assignments[], size_t n);
+
+/*!
+ * \fn void vars_expand_line(struct line *pl, int status)
+ * \brief Replace the variables of the arguments and the filenames of a pipeline flagged LINE_ARG_VARS.
+ *
+ * The expanded strings replace the arguments in place, until vars_restore_line() is called.
+ * The function exits the shell if a memory allocation fails.
+ *
+ * \param pl The pipeline.
+ * \param status The value of "$?".
+ */
+void vars_expand_line(struct line *pl, int status);
+
+/*!
+ * \fn void vars_restore_line()
+ * \brief Give the pipeline given to vars_expand_line() its arguments back, and free the expanded strings.
+ */
+void vars_restore_line();
+
+/*!
+ * \fn void vars_print_stats(FILE *out)
+ * \brief Print the number of variables, of exported variables and of builds of the environment.
+ *
+ * \param out The stream.
+ */
+void vars_print_stats(FILE *out);
+
+/*!
+ * \fn int builtin_export(char *args[], struct line *li)
+ * \brief export [NAME[=value]...]: export variables, setting their value if given, or print the exported ones.
+ */
+int builtin_export(char *args[], struct line *li);
+
+/*!
+ * \fn int builtin_unset(char *args[], struct line *li)
+ * \brief unset NAME...: remove variables.
+ */
+int builtin_unset(char *args[], struct line *li);
+
+#endif //FISH_VARS_H
@@ -0,0 +1,564 @@
+/*!
+ * \file zygote.c
+ * \brief Implementation of the fork server of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * Protocol. The requests go through a stream socket: a struct zygote_request, with the three standard
+ * streams of the command attached (SCM_RIGHTS), followed by request.size bytes of strings, each ending
+ * with '\0': the path, the working directory, the input file, the output file ("" when there is none),
+ * the arguments, then the changes of the environment ("NAME=value" to set, "NAME" to unset).
+ * Each request gets a struct zygote_reply. The changes of state of the commands are sent as
+ * struct zygote_report through a SOCK_SEQPACKET socket, so a report is never split.
+ */
+
+/*!
+ * \def _GNU_SOURCE
+ * \brief Define to enable the use of some GNU extensions.
+ */
+#define _GNU_SOURCE
+
+#include "zygote.h"
+
+#include "vars.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "event.h"
+
+/*!
+ * \def ZYGOTE_BACKGROUND
+ * \brief Flag of a request: the command runs in background.
+ */
+#define ZYGOTE_BACKGROUND 1
+
+/*!
+ * \def ZYGOTE_APPEND
+ * \brief Flag of a request: the output file is opened in append mode.
+ */
+#define ZYGOTE_APPEND 2
+
+/*!
+ * \var environ
+ * \brief The environment of the shell.
+ */
+extern char **environ;
+
+/*!
+ * \struct zygote_request
+ * \brief The fixed part of a request, followed by its strings.
+ */
+struct zygote_request {
+    /*! \brief The number of bytes of the strings. */
+    size_t size;
+    /*! \brief The process group to join, 0 to create one, -1 without job control. */
+    pid_t pgid;
+    /*! \brief ZYGOTE_BACKGROUND, ZYGOTE_APPEND. */
+    int flags;
+    /*! \brief The number of arguments. */
+    size_t argc;
+    /*! \brief The number of changes of the environment. */
+    size_t n_env;
+};
+
+/*!
+ * \struct zygote_reply
+ * \brief The answer to a request.
+ */
+struct zygote_reply {
+    /*! \brief The PID of the command, -1 if it could not be forked. */
+    pid_t pid;
+    /*! \brief The errno value of fork(), 0 on success. */
+    int err;
+};
+
+/*!
+ * \struct zygote_report
+ * \brief A change of state of a command, as returned by wait4().
+ */
+struct zygote_report {
+    /*! \brief The command. */
+    pid_t pid;
+    /*! \brief The status. */
+    int status;
+    /*! \brief The resources used, when it terminated. */
+    struct rusage usage;
+    /*! \brief When the change was reaped (CLOCK_MONOTONIC). */
+    struct timespec ended;
+};
+
+/*!
+ * \struct zygote
+ * \brief The state of the fork server, in the shell.
+ */
+static struct zygote {
+    /*! \brief The PID of the helper, -1 when it is not running. */
+    pid_t pid;
+    /*! \brief The socket of the requests. */
+    int request;
+    /*! \brief The socket of the reports (non-blocking). */
+    int report;
+    /*! \brief environ when the helper was forked: the environment it has. */
+    char **env;
+    /*! \brief Copies of the strings of env. */
+    char **env_copy;
+    /*! \brief The number of variables of env. */
+    size_t n_env;
+    /*! \brief The strings of the request being built. */
+    char *buf;
+    /*! \brief The length of the strings of the request being built. */
+    size_t len;
+    /*! \brief The allocated size of buf. */
+    size_t size;
+    /*! \brief The environment whose changes are in delta, NULL if none. */
+    char **delta_env;
+    /*! \brief vars_generation() when delta was computed. */
+    size_t delta_generation;
+    /*! \brief The changes of delta_env, as appended to a request. */
+    char *delta;
+    /*! \brief The length of delta. */
+    size_t delta_len;
+    /*! \brief The number of changes in delta. */
+    size_t delta_count;
+} zygote = {-1, -1, -1, NULL, NULL, 0, NULL, 0, 0, NULL, 0, NULL, 0, 0};
+
+/*!
+ * \fn static void close_from(int first)
+ * \brief Close all the file descriptors from first.
+ */
+static void close_from(int first) {
+#ifdef SYS_close_range
+    if(syscall(SYS_close_range, (unsigned) first, ~0U, 0) == 0) return;
+#endif
+    for(int fd = first; fd < 1024; ++fd) close(fd);
+}
+
+/*!
+ * \fn static bool read_all(int fd, void *buf, size_t len)
+ * \brief Read exactly len bytes.
+ */
+static bool read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while(len > 0) {
+        ssize_t n = read(fd, p, len);
+        if(n == -1 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+/*!
+ * \fn static bool send_all(int fd, const void *buf, size_t len)
+ * \brief Write exactly len bytes on a socket, without raising SIGPIPE.
+ */
+static bool send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while(len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) return false;
+        p += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+/*!
+ * \fn static void exec_command(char *strings, const struct zygote_request *req, const int fds[3], char **args)
+ * \brief In the child of the helper: set up the command of a request and execute it.
+ */
+static void exec_command(char *strings, const struct zygote_request *req, const int fds[3], char **args) {
+    char *path = strings;
+    char *cwd = path + strlen(path) + 1;
+    char *file_input = cwd + strlen(cwd) + 1;
+    char *file_output = file_input + strlen(file_input) + 1;
+    char *p = file_output + strlen(file_output) + 1;
+    for(size_t i = 0; i < req->argc; ++i, p += strlen(p) + 1) args[i] = p;
+    args[req->argc] = NULL;
+    for(size_t i = 0; i < req->n_env; ++i, p += strlen(p) + 1) {
+        if(strchr(p, '=') != NULL) putenv(p);
+        else unsetenv(p);
+    }
+
+    // The same signal actions as after fork() in the shell, then an empty mask (the helper blocks SIGCHLD)
+    struct sigaction sa_default;
+    sigemptyset(&sa_default.sa_mask);
+    sa_default.sa_flags = 0;
+    sa_default.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &sa_default, NULL);
+    if(!(req->flags & ZYGOTE_BACKGROUND)) sigaction(SIGINT, &sa_default, NULL);
+    if(req->pgid != -1) {
+        if(setpgid(0, req->pgid) == -1) { perror("setpgid"); exit(EXIT_FAILURE); }
+        if(req->pgid == 0 && !(req->flags & ZYGOTE_BACKGROUND) && tcsetpgrp(STDIN_FILENO, getpid()) == -1) {
+            perror("tcsetpgrp");
+            exit(EXIT_FAILURE);
+        }
+        sigaction(SIGTSTP, &sa_default, NULL);
+        sigaction(SIGTTIN, &sa_default, NULL);
+        sigaction(SIGTTOU, &sa_default, NULL);
+    }
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+
+    for(int i = 0; i < 3; ++i) {
+        if(fds[i] != i && dup2(fds[i], i) == -1) { perror("dup2"); exit(EXIT_FAILURE); }
+    }
+    close_from(3);
+    manage_file_input(file_input[0] != '\0' ? file_input : NULL);
+    manage_file_output(file_output[0] != '\0' ? file_output : NULL, req->flags & ZYGOTE_APPEND);
+
+    execv(path, args);
+    if(errno == ENOENT) {
+        fprintf(stderr, "%s: Command not found\n", args[0]);
+    } else {
+        char *msg;
+        asprintf(&msg, "execv of command '%s'", args[0]);
+        perror(msg);
+        free(msg);
+    }
+    exit(102);
+}
+
+/*!
+ * \fn static bool serve_request(int sock)
+ * \brief In the helper: receive a request, fork its command and reply.
+ *
+ * \return false when the shell is gone (end of file or error on the socket).
+ */
+static bool serve_request(int sock) {
+    static char *strings = NULL;
+    static size_t strings_size = 0;
+    static char **args = NULL;
+    static size_t args_size = 0;
+    static char cwd[PATH_MAX] = "";
+
+    struct zygote_request req;
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    ssize_t n;
+    while((n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR) {}
+    if(n != sizeof(req)) return false;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int))) return false;
+    int fds[3];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    if(req.size > strings_size) {
+        char *grown = realloc(strings, req.size);
+        if(grown == NULL) return false;
+        strings = grown;
+        strings_size = req.size;
+    }
+    if(req.argc + 1 > args_size) {
+        char **grown = realloc(args, (req.argc + 1) * sizeof(char *));
+        if(grown == NULL) return false;
+        args = grown;
+        args_size = req.argc + 1;
+    }
+    if(!read_all(sock, strings, req.size)) return false;
+
+    // The helper follows the working directory of the shell, so its children inherit it
+    const char *dir = strings + strlen(strings) + 1;
+    if(dir[0] != '\0' && strcmp(dir, cwd) != 0 && chdir(dir) == 0) strcpy(cwd, dir);
+
+    struct zygote_reply reply = {fork(), 0};
+    if(reply.pid == 0) exec_command(strings, &req, fds, args);
+    if(reply.pid == -1) reply.err = errno;
+    if(reply.pid > 0 && req.pgid != -1) setpgid(reply.pid, req.pgid == 0 ? reply.pid : req.pgid);
+    for(int i = 0; i < 3; ++i) close(fds[i]);
+    return send_all(sock, &reply, sizeof(reply));
+}
+
+/*!
+ * \fn static void zygote_main(int request, int report)
+ * \brief The loop of the helper: start the requested commands and report their changes of state.
+ *
+ * The reports are queued when the socket is full, so the helper keeps serving the requests
+ * while the shell is not reaping.
+ */
+static void zygote_main(int request, int report) {
+    // Keep only the standard streams of the shell and the sockets (as 3 and 4)
+    request = fcntl(request, F_DUPFD_CLOEXEC, 5);
+    report = fcntl(report, F_DUPFD_CLOEXEC, 5);
+    if(request == -1 || report == -1 || dup3(request, 3, O_CLOEXEC) == -1 || dup3(report, 4, O_CLOEXEC) == -1) {
+        _exit(EXIT_FAILURE);
+    }
+    request = 3;
+    report = 4;
+    close_from(5);
+    fcntl(report, F_SETFL, O_NONBLOCK);
+
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    int sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(sfd == -1) _exit(EXIT_FAILURE);
+
+    struct zygote_report *queue = NULL;
+    size_t queued = 0, queue_size = 0;
+    for(;;) {
+        struct pollfd fds[3] = {
+            {request, POLLIN, 0},
+            {sfd, POLLIN, 0},
+            {report, queued > 0 ? POLLOUT : 0, 0},
+        };
+        if(poll(fds, 3, -1) == -1) {
+            if(errno == EINTR) continue;
+            _exit(EXIT_FAILURE);
+        }
+        if(fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while(read(sfd, &info, sizeof(info)) > 0) {}
+            struct zygote_report r;
+            while((r.pid = wait4(-1, &r.status, WNOHANG | WUNTRACED | WCONTINUED, &r.usage)) > 0) {
+                clock_gettime(CLOCK_MONOTONIC, &r.ended);
+                if(queued == queue_size) {
+                    size_t size = queue_size == 0 ? 64 : queue_size * 2;
+                    struct zygote_report *grown = realloc(queue, size * sizeof(*queue));
+                    if(grown == NULL) _exit(EXIT_FAILURE);
+                    queue = grown;
+                    queue_size = size;
+                }
+                queue[queued++] = r;
+            }
+        }
+        size_t sent = 0;
+        while(sent < queued && send(report, &queue[sent], sizeof(*queue), MSG_NOSIGNAL) == sizeof(*queue)) sent++;
+        if(sent < queued && errno != EAGAIN && errno != EINTR) _exit(EXIT_SUCCESS); // The shell is gone
+        memmove(queue, queue + sent, (queued - sent) * sizeof(*queue));
+        queued -= sent;
+
+        if(fds[0].revents & (POLLIN | POLLHUP | POLLERR) && !serve_request(request)) _exit(EXIT_SUCCESS);
+    }
+}
+
+/*!
+ * \fn static void zygote_close()
+ * \brief Forget a helper which does not answer any more. The next commands are started with fork().
+ */
+static void zygote_close() {
+    if(zygote.request != -1) close(zygote.request);
+    if(zygote.report != -1) close(zygote.report);
+    event_watch_children(-1);
+    zygote.request = zygote.report = -1;
+    zygote.pid = -1;
+    for(size_t i = 0; i < zygote.n_env; ++i) free(zygote.env_copy[i]);
+    free(zygote.env);
+    free(zygote.env_copy);
+    zygote.env = zygote.env_copy = NULL;
+    zygote.n_env = 0;
+    zygote.delta_env = NULL; // The changes were computed against the environment of this helper
+}
+
+int zygote_start() {
+    if(zygote.pid != -1) return 0;
+    int request[2], report[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, request) == -1) return -1;
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, report) == -1) {
+        close(request[0]); close(request[1]);
+        return -1;
+    }
+
+    // The environment of the helper, to send only what changed with each request
+    size_t n_env = 0;
+    while(environ[n_env] != NULL) ++n_env;
+    zygote.env = malloc((n_env + 1) * sizeof(char *));
+    zygote.env_copy = malloc((n_env + 1) * sizeof(char *));
+    if(zygote.env == NULL || zygote.env_copy == NULL) { perror("malloc"); exit(EXIT_FAILURE); }
+    for(size_t i = 0; i < n_env; ++i) {
+        zygote.env[i] = environ[i];
+        zygote.env_copy[i] = strdup(environ[i]);
+        if(zygote.env_copy[i] == NULL) { perror("strdup"); exit(EXIT_FAILURE); }
+    }
+    zygote.env[n_env] = NULL;
+    zygote.n_env = n_env;
+
+    fflush(stdout); // The helper must not write again what the shell printed
+    pid_t pid = fork();
+    if(pid == -1) {
+        int err = errno;
+        close(request[0]); close(request[1]);
+        close(report[0]); close(report[1]);
+        zygote_close();
+        errno = err;
+        return -1;
+    }
+    if(pid == 0) {
+        close(request[0]);
+        close(report[0]);
+        zygote_main(request[1], report[1]);
+    }
+
+    close(request[1]);
+    close(report[1]);
+    fcntl(report[0], F_SETFL, O_NONBLOCK);
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    zygote.pid = pid;
+    zygote.request = request[0];
+    zygote.report = report[0];
+    event_watch_children(zygote.report);
+    return 0;
+}
+
+pid_t zygote_pid() {
+    return zygote.pid;
+}
+
+/*!
+ * \fn static void append_bytes(const char *str, size_t len)
+ * \brief Append bytes to the request being built.
+ */
+static void append_bytes(const char *str, size_t len) {
+    if(zygote.len + len > zygote.size) {
+        size_t size = zygote.size == 0 ? 4096 : zygote.size;
+        while(zygote.len + len > size) size *= 2;
+        char *grown = realloc(zygote.buf, size);
+        if(grown == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+        zygote.buf = grown;
+        zygote.size = size;
+    }
+    memcpy(zygote.buf + zygote.len, str, len);
+    zygote.len += len;
+}
+
+/*!
+ * \fn static void append(const char *str)
+ * \brief Append a string, with its '\0', to the request being built.
+ */
+static void append(const char *str) {
+    append_bytes(str, strlen(str) + 1);
+}
+
+/*!
+ * \fn static size_t append_env_changes(char **envp)
+ * \brief Append the changes of envp since the helper was forked.
+ *
+ * The changes are kept until envp or vars_generation() changes, so the environment of the shell is
+ * compared with the one of the helper once per change of an exported variable, not once per command.
+ *
+ * \return The number of changes.
+ */
+static size_t append_env_changes(char **envp) {
+    if(envp == zygote.delta_env && vars_generation() == zygote.delta_generation) {
+        append_bytes(zygote.delta, zygote.delta_len);
+        return zygote.delta_count;
+    }
+    size_t n = 0;
+    while(envp[n] != NULL && n < zygote.n_env && envp[n] == zygote.env[n]) ++n;
+    if(envp[n] == NULL && n == zygote.n_env) return 0; // Unchanged: environ before any variable is set
+
+    size_t start = zygote.len;
+    size_t changes = 0;
+    for(char **var = envp; *var != NULL; ++var) {
+        bool known = false;
+        for(size_t i = 0; i < zygote.n_env && !known; ++i) known = strcmp(*var, zygote.env_copy[i]) == 0;
+        if(!known) { append(*var); ++changes; }
+    }
+    for(size_t i = 0; i < zygote.n_env; ++i) {
+        size_t name_len = strcspn(zygote.env_copy[i], "=");
+        bool set = false;
+        for(char **var = envp; *var != NULL && !set; ++var) {
+            set = strncmp(*var, zygote.env_copy[i], name_len) == 0 && (*var)[name_len] == '=';
+        }
+        if(!set) {
+            char name[name_len + 1];
+            memcpy(name, zygote.env_copy[i], name_len);
+            name[name_len] = '\0';
+            append(name);
+            ++changes;
+        }
+    }
+
+    char *delta = realloc(zygote.delta, zygote.len - start + 1);
+    if(delta == NULL) { perror("realloc"); exit(EXIT_FAILURE); }
+    memcpy(delta, zygote.buf + start, zygote.len - start);
+    zygote.delta = delta;
+    zygote.delta_len = zygote.len - start;
+    zygote.delta_count = changes;
+    zygote.delta_env = envp;
+    zygote.delta_generation = vars_generation();
+    return changes;
+}
+
+int zygote_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl,
+                   size_t cmd_index, bool background, pid_t pgid, char **envp) {
+    if(zygote.request == -1) return ENOTSUP;
+
+    bool not_the_last_one = (cmd_index < line->n_cmds - 1);
+    char *file_input = (cmd_index == 0) ? line->file_input : NULL;
+    char *file_output = not_the_last_one ? NULL : line->file_output;
+    if(background && cmd_index == 0 && file_input == NULL) file_input = "/dev/null";
+
+    struct zygote_request req = {0, pgid, 0, 0, 0};
+    if(background) req.flags |= ZYGOTE_BACKGROUND;
+    if(line->file_output_append) req.flags |= ZYGOTE_APPEND;
+
+    char cwd[PATH_MAX];
+    zygote.len = 0;
+    append(path);
+    append(getcwd(cwd, sizeof(cwd)) != NULL ? cwd : "");
+    append(file_input != NULL ? file_input : "");
+    append(file_output != NULL ? file_output : "");
+    for(; args[req.argc] != NULL; ++req.argc) append(args[req.argc]);
+    req.n_env = append_env_changes(envp);
+    req.size = zygote.len;
+
+    int fds[3] = {
+        pipeControl->pipe_prev[PREAD] != -1 ? pipeControl->pipe_prev[PREAD] : STDIN_FILENO,
+        not_the_last_one ? pipeControl->pipe_next[PWRITE] : STDOUT_FILENO,
+        STDERR_FILENO,
+    };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n;
+    while((n = sendmsg(zygote.request, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR) {}
+    struct zygote_reply reply;
+    if(n == -1 || !send_all(zygote.request, (char *) &req + n, sizeof(req) - (size_t) n)
+       || !send_all(zygote.request, zygote.buf, zygote.len) || !read_all(zygote.request, &reply, sizeof(reply))) {
+        fprintf(stderr, "fork server: %s, using fork\n", n == -1 ? strerror(errno) : "no answer");
+        zygote_close();
+        return ENOTSUP;
+    }
+    if(reply.pid == -1) return reply.err;
+    *pid = reply.pid;
+    return 0;
+}
+
+void zygote_reap(struct job_table *jt) {
+    if(zygote.report == -1) return;
+    struct zygote_report r;
+    ssize_t n;
+    while((n = recv(zygote.report, &r, sizeof(r), MSG_DONTWAIT)) == sizeof(r)) job_update(jt, r.pid, r.status, &r.usage, &r.ended);
+    if(n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+        fprintf(stderr, "fork server: exited, using fork\n");
+        zygote_close();
+    }
+}
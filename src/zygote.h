@@ -0,0 +1,74 @@
+/*!
+ * \file zygote.h
+ * \brief Header file for the fork server of the shell.
+ * \author Romain GALLAND
+ * \version 1
+ *
+ * The fork server ("zygote") is a helper process forked when the launcher "zygote" is selected, while
+ * the shell is still small. It receives the commands to start over a Unix socket (path, arguments,
+ * changes of the environment, working directory, redirections, and the standard streams passed with
+ * SCM_RIGHTS), forks them from its own image and sends back their PID, then their changes of state
+ * (exit, stop, continue, with their resources) over a second socket, watched by the event loop.
+ * The cost of a fork() then depends on the size of the helper, not on the size of the shell.
+ *
+ * The helper exits with the shell (end of file on its socket). The shell becomes a child subreaper
+ * (PR_SET_CHILD_SUBREAPER): if the helper dies first, the commands it started are reparented to the
+ * shell and reaped by job_reap() like the others, and the next commands are started with fork().
+ */
+#ifndef FISH_ZYGOTE_H
+#define FISH_ZYGOTE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "cmdline.h"
+#include "utils.h"
+
+/*!
+ * \fn int zygote_start()
+ * \brief Start the fork server, if it is not running.
+ *
+ * \return 0 on success, -1 on failure (errno is set).
+ */
+int zygote_start();
+
+/*!
+ * \fn pid_t zygote_pid()
+ * \brief The PID of the fork server, -1 if it is not running.
+ */
+pid_t zygote_pid();
+
+/*!
+ * \fn int zygote_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl, size_t cmd_index, bool background, pid_t pgid, char **envp)
+ * \brief Start a command of a pipeline with the fork server.
+ *
+ * Same contract as spawn_command(): the command gets the pipes of pipeControl and the redirections of
+ * line in the same order as with fork(), the signal actions of a foreground or background command,
+ * and joins the process group pgid with job control (taking the terminal if it creates the group of a
+ * foreground job). A redirection or execv() which fails is reported by the command itself, as with fork().
+ *
+ * \param pid Where to store the PID of the new process.
+ * \param path The path of the command to execute (see cmdhash_lookup).
+ * \param args The arguments of the command (NULL terminated).
+ * \param line The line structure of the command executed.
+ * \param pipeControl The pipe control structure.
+ * \param cmd_index The index of the command in the line structure.
+ * \param background true if the command is executed in background.
+ * \param pgid The process group to join, 0 to create a new one (first command of a job), -1 without job control.
+ * \param envp The environment of the command (see vars_envp): only its differences with the environment of the
+ *             helper are sent, computed again only when envp or vars_generation() changes.
+ * \return 0 on success, ENOTSUP if the fork server is not running (the caller falls back to fork()),
+ *         an errno value otherwise.
+ */
+int zygote_command(pid_t *pid, const char *path, char *args[], struct line *line, struct pipe_control *pipeControl,
+                   size_t cmd_index, bool background, pid_t pgid, char **envp);
+
+/*!
+ * \fn void zygote_reap(struct job_table *jt)
+ * \brief Record the changes of state reported by the fork server (see job_update()). Called by job_reap().
+ *
+ * \param jt The job table.
+ */
+void zygote_reap(struct job_table *jt);
+
+#endif //FISH_ZYGOTE_H